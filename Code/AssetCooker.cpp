@@ -0,0 +1,421 @@
+//
+// AssetCooker.cpp : Offline build step for the WorkingDir assets (AssetCooker.exe [directory] [options]).
+// It cooks every model into the .mesh files that ReadModelImport() maps at startup, every texture into
+// the .dds mip chains (block compressed when possible) that LoadTexture2D() maps, and packs the sources
+// into the Assets.pack that Init() mounts. Assets are hashed by content
+// and linked to what they reference (OBJ -> MTL -> textures), so a run only cooks what changed since the
+// last one, plus everything that depends on it. Independent assets are cooked in parallel.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <unordered_map>
+#include "platform.h"
+#include "ModelImporter.h"
+#include "CookedTexture.h"
+#include "AssetPack.h"
+
+#define COOKER_MANIFEST "AssetCooker.manifest"
+
+enum AssetCategory
+{
+    AC_MODEL,
+    AC_MATERIAL,
+    AC_TEXTURE,
+    AC_SHADER,
+    AC_OTHER
+};
+
+const char* assetCategoryNames[] = { "model", "material", "texture", "shader", "other" };
+
+struct CookerAsset
+{
+    std::string path;
+    AssetCategory category = AC_OTHER;
+    u64 contentHash = 0;
+    u64 key = 0;                // Content hash combined with the keys of the dependencies
+    std::vector<u32> dependencies;
+    bool dirty = false;
+    bool failed = false;
+    bool hasOutput = false;     // Cooked to a file of its own (zero copy GLBs are read in place)
+    TextureUsage usage = TU_COLOR; // Textures referenced as normal maps are compressed as such
+    f64 cookTime = 0;
+    std::string detail;         // Appended to the cook log line
+};
+
+struct AssetReference
+{
+    std::string path;
+    TextureUsage usage;
+};
+
+struct CookerOptions
+{
+    const char* directory = ".";
+    VertexFormat vertexFormat = VF_QUANTIZED;
+    bool force = false;
+    bool pack = true;
+    bool compressTextures = true;
+    u32 threads = 0;
+};
+
+struct ManifestEntry
+{
+    u64 key;
+    bool hasOutput;
+};
+
+AssetCategory GetAssetCategory(const std::string& path)
+{
+    const size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return AC_OTHER;
+
+    std::string extension = path.substr(dot + 1);
+    for (size_t i = 0; i < extension.size(); ++i) extension[i] = (char)tolower(extension[i]);
+
+    const char* models[] = { "obj", "fbx", "dae", "gltf", "glb", "3ds", "ply", "stl" };
+    const char* textures[] = { "png", "jpg", "jpeg", "tga", "bmp" };
+    for (u32 i = 0; i < sizeof(models) / sizeof(models[0]); ++i)
+        if (extension == models[i]) return AC_MODEL;
+    for (u32 i = 0; i < sizeof(textures) / sizeof(textures[0]); ++i)
+        if (extension == textures[i]) return AC_TEXTURE;
+    if (extension == "mtl") return AC_MATERIAL;
+    if (extension == "glsl") return AC_SHADER;
+    return AC_OTHER;
+}
+
+// Runs job(i) for every i in [0, count) on up to `threads` threads, each one pulling the next index
+void ParallelFor(u32 count, u32 threads, const std::function<void(u32)>& job)
+{
+    std::atomic<u32> next(0);
+    auto worker = [&]()
+    {
+        for (u32 i = next++; i < count; i = next++)
+            job(i);
+    };
+
+    if (threads > count) threads = count;
+    if (threads <= 1)
+    {
+        worker();
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (u32 i = 0; i < threads; ++i)
+        workers.emplace_back(worker);
+    for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+        it->join();
+}
+
+std::string AssetDirectory(const std::string& path)
+{
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+// Files referenced by an OBJ (material libraries) or an MTL (texture maps)
+void ScanAssetReferences(const CookerAsset& asset, std::vector<AssetReference>& references)
+{
+    const bool obj = asset.category == AC_MODEL && IsObjFile(asset.path.c_str());
+    if (!obj && asset.category != AC_MATERIAL) return;
+
+    MappedFile file = MapFile(asset.path.c_str());
+    if (!file.data) return;
+
+    const std::string directory = AssetDirectory(asset.path);
+    const char* end = (const char*)file.data + file.size;
+    for (const char* p = (const char*)file.data; p < end;)
+    {
+        const char* lineEnd = ObjLineEnd(p, end);
+        const char* c = p;
+        p = lineEnd + 1;
+
+        ObjSkipSpaces(c, lineEnd);
+        const char* keyEnd = c;
+        while (keyEnd < lineEnd && !ObjIsSpace(*keyEnd)) keyEnd++;
+        const std::string key(c, keyEnd);
+        const std::string statement = ObjLineRest(keyEnd, lineEnd);
+        if (statement.empty()) continue;
+
+        AssetReference reference = { std::string(), TU_COLOR };
+        if (obj && key == "mtllib")
+            reference.path = NormalizePackPath((directory + "/" + statement).c_str());
+        else if (!obj && (key == "map_Kd" || key == "map_Ks" || key == "map_Ke" || key == "bump" || key == "map_bump" || key == "map_Bump"))
+            reference.path = NormalizePackPath(ObjTexturePath(statement, directory).c_str());
+        else if (!obj && (key == "norm" || key == "map_Kn"))
+            reference = { NormalizePackPath(ObjTexturePath(statement, directory).c_str()), TU_NORMALS };
+
+        if (!reference.path.empty()) references.push_back(reference);
+    }
+
+    UnmapFile(file);
+}
+
+// What the cooked output depends on besides the content: the format models are cooked to,
+// and what textures are compressed for
+u64 CookSettings(const CookerAsset& asset, const CookerOptions& options)
+{
+    if (asset.category == AC_MODEL) return ((u64)COOKED_MODEL_VERSION << 32) | options.vertexFormat;
+    if (asset.category == AC_TEXTURE) return ((u64)COOKED_TEXTURE_VERSION << 32) | (options.compressTextures << 16) | asset.usage;
+    return 0;
+}
+
+// Depth first over the dependencies, a cycle contributes the content hash only
+u64 ComputeAssetKey(std::vector<CookerAsset>& assets, std::vector<u8>& state, u32 index, const CookerOptions& options)
+{
+    CookerAsset& asset = assets[index];
+    if (state[index] == 2) return asset.key;
+    if (state[index] == 1) return asset.contentHash;
+
+    state[index] = 1;
+    const u64 settings = CookSettings(asset, options);
+    u64 key = settings ? HashBytes(&settings, sizeof(settings), asset.contentHash) : asset.contentHash;
+    for (std::vector<u32>::const_iterator it = asset.dependencies.begin(); it != asset.dependencies.end(); ++it)
+    {
+        const u64 dependencyKey = ComputeAssetKey(assets, state, *it, options);
+        key = HashBytes(&dependencyKey, sizeof(dependencyKey), key);
+    }
+
+    asset.key = key;
+    state[index] = 2;
+    return key;
+}
+
+void ReadCookerManifest(const char* path, std::unordered_map<std::string, ManifestEntry>& manifest)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) return;
+
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned long long key = 0;
+        int hasOutput = 0, consumed = 0;
+        if (sscanf(line, "%llx %d %n", &key, &hasOutput, &consumed) != 2) continue;
+
+        std::string assetPath = line + consumed;
+        while (!assetPath.empty() && (assetPath.back() == '\n' || assetPath.back() == '\r')) assetPath.pop_back();
+        ManifestEntry& entry = manifest[assetPath];
+        entry.key = key;
+        entry.hasOutput = hasOutput != 0;
+    }
+    fclose(file);
+}
+
+bool WriteCookerManifest(const char* path, const std::vector<CookerAsset>& assets)
+{
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+
+    // Failed assets are left out, so the next run tries them again
+    for (std::vector<CookerAsset>::const_iterator it = assets.begin(); it != assets.end(); ++it)
+        if (!it->failed)
+            fprintf(file, "%016llx %d %s\n", (unsigned long long)it->key, it->hasOutput ? 1 : 0, it->path.c_str());
+
+    return fclose(file) == 0;
+}
+
+bool CookModel(CookerAsset& asset, const CookerOptions& options)
+{
+    ModelImport import;
+    if (!ImportModelSource(asset.path.c_str(), import, options.vertexFormat)) return false;
+
+    // GLB files that can be drawn in place are already in their runtime format
+    asset.hasOutput = !import.zeroCopy;
+    const bool written = import.zeroCopy || WriteCookedModel(asset.path.c_str(), import);
+    FreeModelImport(import);
+    return written;
+}
+
+// Decodes the texture as the engine does (flipped) and cooks its filtered mip chain
+bool CookTexture(CookerAsset& asset, const CookerOptions& options)
+{
+    stbi_set_flip_vertically_on_load_thread(true);
+    Image image = {};
+    if (!DecodeImageFile(asset.path.c_str(), image)) return false;
+
+    CookedTexture cooked;
+    TextureEncodeStats stats;
+    BuildCookedTexture(image, asset.usage, options.compressTextures, HashImage(image), cooked, &stats);
+    stbi_image_free(image.pixels);
+    asset.hasOutput = true;
+
+    char detail[160];
+    u32 length = snprintf(detail, sizeof(detail), " (%s, %ux%u, %u levels, filter %.2f ms", BlockFormatName(cooked.format),
+                          cooked.width, cooked.height, cooked.levelCount, stats.filterSeconds * 1000.0);
+    if (cooked.format != BF_RGBA8)
+        length += snprintf(detail + length, sizeof(detail) - length, ", encode %.1f MPixels/s, PSNR %.2f dB", stats.MegaPixelsPerSecond(), stats.psnr);
+    snprintf(detail + length, sizeof(detail) - length, ")");
+    asset.detail = detail;
+
+    return WriteCookedTexture(asset.path.c_str(), cooked, options.compressTextures);
+}
+
+std::string CookedOutputPath(const CookerAsset& asset)
+{
+    return asset.category == AC_TEXTURE ? CookedTexturePath(asset.path.c_str(), asset.usage) : CookedModelPath(asset.path.c_str());
+}
+
+bool CookAsset(CookerAsset& asset, const CookerOptions& options)
+{
+    switch (asset.category)
+    {
+    case AC_MODEL:   return CookModel(asset, options);
+    case AC_TEXTURE: return CookTexture(asset, options);
+    default:         return true; // Materials are baked into the models, shaders are compiled (and cached) by the driver
+    }
+}
+
+bool ParseCookerOptions(int argc, char** argv, CookerOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--float") == 0) options.vertexFormat = VF_FLOAT;
+        else if (strcmp(argv[i], "--force") == 0) options.force = true;
+        else if (strcmp(argv[i], "--no-pack") == 0) options.pack = false;
+        else if (strcmp(argv[i], "--no-compress") == 0) options.compressTextures = false;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) options.threads = (u32)atoi(argv[++i]);
+        else if (argv[i][0] != '-') options.directory = argv[i];
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    CookerOptions options;
+    if (!ParseCookerOptions(argc, argv, options))
+    {
+        ELOG("Usage: AssetCooker [directory] [--float] [--force] [--no-pack] [--no-compress] [--threads N]");
+        return 2;
+    }
+    if (options.threads == 0) options.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Paths are relative to the working directory, exactly as the engine opens them
+    if (!SetWorkingDirectory(options.directory))
+    {
+        ELOG("Could not open directory %s", options.directory);
+        return 1;
+    }
+
+    const f64 start = GetPerformanceTime();
+
+    std::vector<std::string> files;
+    ListFiles(".", files);
+    files.erase(std::remove_if(files.begin(), files.end(), [](const std::string& path) { return !IsPackedFileType(path); }), files.end());
+    std::sort(files.begin(), files.end());
+
+    std::vector<CookerAsset> assets(files.size());
+    std::unordered_map<std::string, u32> indices;
+    for (u32 i = 0; i < files.size(); ++i)
+    {
+        assets[i].path = files[i];
+        assets[i].category = GetAssetCategory(files[i]);
+        indices[files[i]] = i;
+    }
+
+    std::vector<std::vector<AssetReference>> references(assets.size());
+    ParallelFor(assets.size(), options.threads, [&](u32 i)
+    {
+        assets[i].contentHash = HashSourceFile(assets[i].path.c_str());
+        ScanAssetReferences(assets[i], references[i]);
+    });
+
+    for (u32 i = 0; i < assets.size(); ++i)
+    {
+        for (std::vector<AssetReference>::const_iterator it = references[i].begin(); it != references[i].end(); ++it)
+        {
+            std::unordered_map<std::string, u32>::const_iterator found = indices.find(it->path);
+            if (found == indices.end())
+            {
+                ELOG("%s references missing file %s", assets[i].path.c_str(), it->path.c_str());
+                continue;
+            }
+
+            assets[i].dependencies.push_back(found->second);
+            if (it->usage == TU_NORMALS) assets[found->second].usage = TU_NORMALS;
+        }
+    }
+
+    std::vector<u8> state(assets.size(), 0);
+    for (u32 i = 0; i < assets.size(); ++i)
+        ComputeAssetKey(assets, state, i, options);
+
+    std::unordered_map<std::string, ManifestEntry> manifest;
+    if (!options.force) ReadCookerManifest(COOKER_MANIFEST, manifest);
+
+    std::vector<u32> dirty;
+    u32 known = 0;
+    for (u32 i = 0; i < assets.size(); ++i)
+    {
+        CookerAsset& asset = assets[i];
+        std::unordered_map<std::string, ManifestEntry>::const_iterator entry = manifest.find(asset.path);
+        known += entry != manifest.end() ? 1 : 0;
+        asset.dirty = entry == manifest.end() || entry->second.key != asset.key;
+        asset.hasOutput = entry != manifest.end() && entry->second.hasOutput;
+        if (!asset.dirty && asset.hasOutput && GetFileLastWriteTimestamp(CookedOutputPath(asset).c_str()) == 0)
+            asset.dirty = true;
+        if (asset.dirty) dirty.push_back(i);
+    }
+
+    ParallelFor(dirty.size(), options.threads, [&](u32 i)
+    {
+        CookerAsset& asset = assets[dirty[i]];
+        const f64 cookStart = GetPerformanceTime();
+        asset.failed = !CookAsset(asset, options);
+        asset.cookTime = GetPerformanceTime() - cookStart;
+
+        if (asset.failed)
+        {
+            ELOG("FAILED %-8s %s", assetCategoryNames[asset.category], asset.path.c_str());
+        }
+        else
+        {
+            ILOG("%8.2f ms  %-8s %s%s", asset.cookTime * 1000.0, assetCategoryNames[asset.category], asset.path.c_str(), asset.detail.c_str());
+        }
+    });
+
+    u32 failed = 0;
+    f64 cookTime = 0;
+    for (std::vector<u32>::const_iterator it = dirty.begin(); it != dirty.end(); ++it)
+    {
+        failed += assets[*it].failed ? 1 : 0;
+        cookTime += assets[*it].cookTime;
+    }
+
+    // Files removed since the last run are still in the pack too
+    bool ok = failed == 0;
+    const bool removed = known < manifest.size();
+    if (options.pack && (!dirty.empty() || removed || GetFileLastWriteTimestamp(PACK_FILE_NAME) == 0))
+    {
+        const f64 packStart = GetPerformanceTime();
+        AssetPackStats stats;
+        if (BuildAssetPack(".", PACK_FILE_NAME, true, stats))
+        {
+            ILOG("%8.2f ms  pack     %s (%u files, %u compressed, %.2f MB -> %.2f MB)", (GetPerformanceTime() - packStart) * 1000.0, PACK_FILE_NAME,
+                 stats.files, stats.compressed, stats.originalBytes / (1024.0 * 1024.0), stats.packBytes / (1024.0 * 1024.0));
+        }
+        else
+        {
+            ELOG("Could not build %s", PACK_FILE_NAME);
+            ok = false;
+        }
+    }
+
+    if (!WriteCookerManifest(COOKER_MANIFEST, assets))
+    {
+        ELOG("Could not write %s", COOKER_MANIFEST);
+        ok = false;
+    }
+
+    ILOG("%u assets, %u cooked, %u failed, %.2f ms cooking on %u threads, %.2f ms wall time",
+         (u32)assets.size(), (u32)dirty.size() - failed, failed, cookTime * 1000.0, options.threads, (GetPerformanceTime() - start) * 1000.0);
+
+    return ok ? 0 : 1;
+}
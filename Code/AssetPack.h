@@ -0,0 +1,212 @@
+#pragma once
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "platform.h"
+#include "Hash.h"
+#include "Lz4.h"
+
+// Asset pack: every file of a directory in one archive, mapped once at startup (see MountAssetPack()).
+//
+// Layout: [PackHeader][PackEntry x tableSize][names][padding][entry data, each one 4K aligned]
+// The table of contents is an open addressing hash table (linear probing) indexed by the hash of the
+// normalized relative path, so a lookup touches one or two entries. Empty slots don't have the
+// PACK_ENTRY_USED flag. Entries are stored raw or as one LZ4 block when that saves enough space.
+// Everything the runtime reads (header, table, names) is at the start, so a cold start reads the
+// archive front to back.
+
+#define PACK_MAGIC        0x4B434150 // "PACK"
+#define PACK_VERSION      1
+#define PACK_ALIGNMENT    4096
+#define PACK_FILE_NAME    "Assets.pack"
+
+enum PackEntryFlags
+{
+    PACK_ENTRY_USED = 1 << 0,
+    PACK_ENTRY_LZ4  = 1 << 1,
+};
+
+struct PackHeader
+{
+    u32 magic;
+    u32 version;
+    u32 entryCount;
+    u32 tableSize;   // Power of two
+    u64 namesOffset;
+    u64 namesBytes;
+};
+
+struct PackEntry
+{
+    u64 hash;
+    u64 offset;       // From the start of the archive, PACK_ALIGNMENT aligned
+    u64 size;         // Stored bytes
+    u64 originalSize;
+    u32 nameOffset;   // Into the names block, zero terminated
+    u32 flags;
+};
+
+// Paths are looked up relative to the working directory, with forward slashes and without "./"
+inline std::string NormalizePackPath(const char* path)
+{
+    std::string normalized = path;
+    std::replace(normalized.begin(), normalized.end(), '\\', '/');
+    while (normalized.compare(0, 2, "./") == 0) normalized.erase(0, 2);
+
+    for (size_t dup = normalized.find("//"); dup != std::string::npos; dup = normalized.find("//"))
+        normalized.erase(dup, 1);
+    return normalized;
+}
+
+inline const PackEntry* FindPackEntry(const u8* pack, const char* path)
+{
+    const PackHeader* header = (const PackHeader*)pack;
+    const PackEntry* table = (const PackEntry*)(pack + sizeof(PackHeader));
+    const char* names = (const char*)(pack + header->namesOffset);
+
+    const std::string normalized = NormalizePackPath(path);
+    const u64 hash = HashString(normalized.c_str());
+    const u32 mask = header->tableSize - 1;
+    for (u32 slot = (u32)hash & mask, probes = 0; probes < header->tableSize; slot = (slot + 1) & mask, ++probes)
+    {
+        const PackEntry& entry = table[slot];
+        if (!(entry.flags & PACK_ENTRY_USED)) return nullptr;
+        if (entry.hash == hash && normalized == names + entry.nameOffset) return &entry;
+    }
+    return nullptr;
+}
+
+inline bool IsPackedFileType(const std::string& path)
+{
+    // Binaries, debugger files, the cooker bookkeeping, packs themselves and half written files.
+    // Cooked caches (.mesh, .dds) stay on disk too: they are validated against their sources and
+    // refreshed in place, which a packed copy can't be, so it would shadow the up to date file next to it.
+    const char* skipped[] = { ".exe", ".dll", ".pdb", ".ilk", ".ini", ".rdbg", ".pack", ".mesh", ".dds", ".manifest", ".tmp" };
+    for (u32 i = 0; i < sizeof(skipped) / sizeof(skipped[0]); ++i)
+    {
+        const size_t length = strlen(skipped[i]);
+        if (path.size() >= length && path.compare(path.size() - length, length, skipped[i]) == 0) return false;
+    }
+    return true;
+}
+
+struct AssetPackStats
+{
+    u32 files = 0;
+    u32 compressed = 0;
+    u64 originalBytes = 0;
+    u64 storedBytes = 0;
+    u64 packBytes = 0;
+};
+
+// Packs every file under `directory` into `packPath`. Entries are compressed when LZ4 saves at least
+// an eighth of them (already compressed formats like PNG stay raw). Returns false on I/O errors.
+inline bool BuildAssetPack(const char* directory, const char* packPath, bool compress, AssetPackStats& stats)
+{
+    stats = AssetPackStats();
+
+    std::vector<std::string> files;
+    ListFiles(directory, files);
+    files.erase(std::remove_if(files.begin(), files.end(), [](const std::string& path) { return !IsPackedFileType(path); }), files.end());
+    std::sort(files.begin(), files.end());
+
+    u32 tableSize = 16;
+    while (tableSize < files.size() * 2) tableSize *= 2;
+
+    std::vector<PackEntry> table(tableSize);
+    memset(table.data(), 0, table.size() * sizeof(PackEntry));
+    std::string names;
+    for (std::vector<std::string>::const_iterator it = files.begin(); it != files.end(); ++it)
+    {
+        const u64 hash = HashString(it->c_str());
+        u32 slot = (u32)hash & (tableSize - 1);
+        while (table[slot].flags & PACK_ENTRY_USED) slot = (slot + 1) & (tableSize - 1);
+
+        table[slot].hash = hash;
+        table[slot].nameOffset = names.size();
+        table[slot].flags = PACK_ENTRY_USED;
+        names += *it;
+        names += '\0';
+    }
+
+    PackHeader header = {};
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.entryCount = files.size();
+    header.tableSize = tableSize;
+    header.namesOffset = sizeof(PackHeader) + tableSize * sizeof(PackEntry);
+    header.namesBytes = names.size();
+
+    const std::string root = directory;
+    const std::string temporaryPath = std::string(packPath) + ".tmp";
+    FILE* pack = fopen(temporaryPath.c_str(), "wb");
+    if (!pack) return false;
+
+    // The table is written last, once the offsets are known
+    u64 offset = header.namesOffset + header.namesBytes;
+    std::vector<u8> zeros(PACK_ALIGNMENT, 0);
+    std::vector<u8> data;
+    std::vector<u8> packed;
+    bool ok = fseek(pack, (long)offset, SEEK_SET) == 0;
+    for (u32 slot = 0; ok && slot < tableSize; ++slot)
+    {
+        PackEntry& entry = table[slot];
+        if (!(entry.flags & PACK_ENTRY_USED)) continue;
+
+        const std::string path = root + "/" + (names.c_str() + entry.nameOffset);
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            ELOG("Could not read %s", path.c_str());
+            ok = false;
+            break;
+        }
+        fseek(file, 0, SEEK_END);
+        data.resize(ftell(file));
+        fseek(file, 0, SEEK_SET);
+        ok = data.empty() || fread(data.data(), data.size(), 1, file) == 1;
+        fclose(file);
+
+        const u8* stored = data.data();
+        entry.size = entry.originalSize = data.size();
+        if (compress && data.size() > 0)
+        {
+            packed.resize(Lz4CompressBound(data.size()));
+            const u32 packedSize = Lz4Compress(data.data(), data.size(), packed.data(), packed.size());
+            if (packedSize > 0 && packedSize <= data.size() - data.size() / 8)
+            {
+                stored = packed.data();
+                entry.size = packedSize;
+                entry.flags |= PACK_ENTRY_LZ4;
+                stats.compressed++;
+            }
+        }
+
+        const u64 padding = (PACK_ALIGNMENT - offset % PACK_ALIGNMENT) % PACK_ALIGNMENT;
+        ok = ok && (padding == 0 || fwrite(zeros.data(), padding, 1, pack) == 1);
+        offset += padding;
+        entry.offset = offset;
+        ok = ok && (entry.size == 0 || fwrite(stored, entry.size, 1, pack) == 1);
+        offset += entry.size;
+
+        stats.files++;
+        stats.originalBytes += entry.originalSize;
+        stats.storedBytes += entry.size;
+    }
+
+    ok = ok && fseek(pack, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&header, sizeof(header), 1, pack) == 1;
+    ok = ok && fwrite(table.data(), table.size() * sizeof(PackEntry), 1, pack) == 1;
+    ok = ok && (names.empty() || fwrite(names.data(), names.size(), 1, pack) == 1);
+    fclose(pack);
+
+    // Replaced only when complete, the caller unmounts the pack first. Windows can't replace mapped files,
+    // so this fails there while imports still hold views into the old pack.
+    remove(packPath);
+    ok = ok && rename(temporaryPath.c_str(), packPath) == 0;
+    if (!ok) remove(temporaryPath.c_str());
+
+    stats.packBytes = offset;
+    return ok;
+}
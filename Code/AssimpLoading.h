@@ -1,254 +1,820 @@
 #pragma once
-#include <assimp/cimport.h>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 #include "Model.h"
+#include "ModelAsset.h"
+#include "ModelImport.h"
+#include "ModelImporter.h"
 #include "engine.h"
 #include "Material.h"
+#include "Texture.h"
 
-void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Model* myModel, unsigned int baseMeshMaterialIndex, std::vector<unsigned int>& submeshMaterialIndices)
+// Returns the first slot of `count` consecutive material slots, reusing the slots of released assets first
+u32 AllocateMaterialRange(App* app, u32 count)
 {
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
+    for (std::vector<MaterialRange>::iterator it = app->freeMaterials.begin(); it != app->freeMaterials.end(); ++it)
+    {
+        if (it->count < count) continue;
+
+        const u32 first = it->first;
+        it->first += count;
+        it->count -= count;
+        if (it->count == 0) app->freeMaterials.erase(it);
+        return first;
+    }
+
+    const u32 first = (u32)app->materials.size();
+    app->materials.resize(first + count, nullptr);
+    return first;
+}
+
+// The slots must be empty already
+void FreeMaterialRange(App* app, u32 first, u32 count)
+{
+    if (count == 0) return;
 
-    bool hasTexCoords = false;
-    bool hasTangentSpace = false;
+    std::vector<MaterialRange>& ranges = app->freeMaterials;
+    std::vector<MaterialRange>::iterator it = ranges.begin();
+    while (it != ranges.end() && it->first < first) ++it;
 
-    // process vertices
-    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    MaterialRange range;
+    range.first = first;
+    range.count = count;
+    it = ranges.insert(it, range);
+
+    // Merge with the next range, then with the previous one
+    if (it + 1 != ranges.end() && it->first + it->count == (it + 1)->first)
+    {
+        it->count += (it + 1)->count;
+        ranges.erase(it + 1);
+    }
+    if (it != ranges.begin() && (it - 1)->first + (it - 1)->count == it->first)
     {
-        vertices.emplace_back(mesh->mVertices[i].x);
-        vertices.emplace_back(mesh->mVertices[i].y);
-        vertices.emplace_back(mesh->mVertices[i].z);
-        vertices.emplace_back(mesh->mNormals[i].x);
-        vertices.emplace_back(mesh->mNormals[i].y);
-        vertices.emplace_back(mesh->mNormals[i].z);
+        (it - 1)->count += it->count;
+        it = ranges.erase(it) - 1;
+    }
 
-        if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+    // Slots at the end go away, so the material table doesn't keep them
+    if (it->first + it->count == app->materials.size())
+    {
+        app->materials.resize(it->first);
+        ranges.erase(it);
+    }
+}
+
+void CreateModelAssetMaterials(App* app, ModelImport& import, ModelAsset* asset)
+{
+    asset->materialCount = import.materials.size();
+    asset->baseMaterial = AllocateMaterialRange(app, asset->materialCount);
+    u32 material = asset->baseMaterial;
+
+    for (std::vector<ImportedMaterial>::iterator it = import.materials.begin(); it != import.materials.end(); ++it)
+    {
+        Material* mat = new Material();
+        mat->name = it->name;
+        mat->properties.Set(it->properties.Binary());
+        mat->diffuse = it->diffuse;
+        mat->emissive = it->emissive;
+        mat->specular = it->specular;
+        mat->shininess = it->shininess;
+
+        unsigned int* slots[CTS_COUNT] = { &mat->diffuseTex, &mat->specularTex, &mat->emissiveTex, &mat->normalsTex, &mat->bumpTex };
+        for (u32 i = 0; i < CTS_COUNT; ++i)
         {
-            hasTexCoords = true;
-            vertices.emplace_back(mesh->mTextureCoords[0][i].x);
-            vertices.emplace_back(mesh->mTextureCoords[0][i].y);
+            if (it->textures[i].empty()) continue;
+
+            const TextureUsage usage = i == CTS_NORMALS ? TU_NORMALS : TU_COLOR;
+            if (it->images[i].pixels)
+            {
+                // Ownership of the decoded pixels goes to the texture loader
+                *slots[i] = LoadTexture2D(app, it->textures[i].c_str(), it->images[i], usage);
+                it->images[i] = {};
+            }
+            else
+            {
+                *slots[i] = LoadTexture2D(app, it->textures[i].c_str(), usage);
+            }
         }
 
-        if (mesh->mTangents != nullptr && mesh->mBitangents)
-        {
-            hasTangentSpace = true;
-            vertices.emplace_back(mesh->mTangents[i].x);
-            vertices.emplace_back(mesh->mTangents[i].y);
-            vertices.emplace_back(mesh->mTangents[i].z);
+        app->materials[material++] = mat;
+    }
 
-            // For some reason ASSIMP gives me the bitangents flipped.
-            // Maybe it's my fault, but when I generate my own geometry
-            // in other files (see the generation of standard assets)
-            // and all the bitangents have the orientation I expect,
-            // everything works ok.
-            // I think that (even if the documentation says the opposite)
-            // it returns a left-handed tangent space matrix.
-            // SOLUTION: I invert the components of the bitangent here.
-            vertices.emplace_back(-mesh->mBitangents[i].x);
-            vertices.emplace_back(-mesh->mBitangents[i].y);
-            vertices.emplace_back(-mesh->mBitangents[i].z);
-        }
+    for (std::vector<u32>::iterator it = import.meshMaterials.begin(); it != import.meshMaterials.end(); ++it)
+        asset->materials.emplace_back(asset->baseMaterial + (*it));
+}
+
+// Copies the mesh ranges of the streams into the cpu side of the meshes that don't have them yet
+void RetainModelAssetCpuData(ModelAsset* asset, const ModelImport& import)
+{
+    for (std::vector<Mesh*>::iterator it = asset->meshes.begin(); it != asset->meshes.end(); ++it)
+    {
+        Mesh* mesh = (*it);
+        if (mesh->cpuReadable) continue;
+
+        const u8* indices = import.indexData + mesh->indexsOffset;
+        mesh->vertexs.assign(import.vertexData + mesh->vertexOffset, import.vertexData + mesh->vertexOffset + mesh->vertexBytes);
+        if (mesh->indexType == GL_UNSIGNED_SHORT) mesh->indexs.assign((const u16*)indices, (const u16*)indices + mesh->indexCount);
+        else mesh->indexs.assign((const u32*)indices, (const u32*)indices + mesh->indexCount);
+        mesh->cpuReadable = true;
     }
+}
 
-    // process indices
-    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+// Same, for an asset whose import is gone: the data is read back from the geometry arena
+void ReadBackModelAssetCpuData(ModelAsset* asset)
+{
+    for (std::vector<Mesh*>::iterator it = asset->meshes.begin(); it != asset->meshes.end(); ++it)
     {
-        aiFace face = mesh->mFaces[i];
-        for (unsigned int j = 0; j < face.mNumIndices; j++)
+        Mesh* mesh = (*it);
+        if (mesh->cpuReadable) continue;
+
+        mesh->vertexs.resize(mesh->vertexBytes);
+        glBindBuffer(GL_ARRAY_BUFFER, asset->vertexHandle);
+        glGetBufferSubData(GL_ARRAY_BUFFER, asset->vertexBase + mesh->vertexOffset, mesh->vertexBytes, mesh->vertexs.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        mesh->indexs.resize(mesh->indexCount);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, asset->indexHandle);
+        glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, asset->indexBase + mesh->indexsOffset, mesh->indexCount * mesh->IndexSize(), mesh->indexs.data());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        // 16 bit indices were read packed at the start of the vector, widen them in place from the end
+        if (mesh->indexType == GL_UNSIGNED_SHORT)
         {
-            indices.emplace_back(face.mIndices[j]);
+            const u16* packed = (const u16*)mesh->indexs.data();
+            for (u32 i = mesh->indexCount; i-- > 0;)
+                mesh->indexs[i] = packed[i];
         }
+
+        mesh->cpuReadable = true;
     }
+}
+
+// Asks an asset to keep cpu copies of its meshes. Pending assets get them when their upload finishes.
+void SetModelAssetCpuReadable(ModelAsset* asset)
+{
+    if (asset->cpuReadable) return;
+
+    asset->cpuReadable = true;
+    if (asset->resident) ReadBackModelAssetCpuData(asset);
+}
 
-    // store the proper (previously proceessed) material for this mesh
-    submeshMaterialIndices.emplace_back(baseMeshMaterialIndex + mesh->mMaterialIndex);
+// Bounding sphere of every submesh together, in object space
+void ComputeModelAssetBounds(ModelAsset* asset)
+{
+    if (asset->meshes.empty()) return;
 
-    // create the vertex format
-    VertexBufferLayout vertexBufferLayout = {};
-    vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(0, 3));
-    vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(1, 3));
-    if (hasTexCoords) vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(2, 2));
-    if (hasTangentSpace)
+    vec3 aabbMin = asset->meshes[0]->boundsCenter - vec3(asset->meshes[0]->boundsRadius);
+    vec3 aabbMax = asset->meshes[0]->boundsCenter + vec3(asset->meshes[0]->boundsRadius);
+    for (std::vector<Mesh*>::const_iterator it = asset->meshes.begin(); it != asset->meshes.end(); ++it)
     {
-        vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(3, 3));
-        vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(4, 3));
+        aabbMin = glm::min(aabbMin, (*it)->boundsCenter - vec3((*it)->boundsRadius));
+        aabbMax = glm::max(aabbMax, (*it)->boundsCenter + vec3((*it)->boundsRadius));
     }
 
-    vertexBufferLayout.Bound();
+    asset->boundsCenter = (aabbMin + aabbMax) * 0.5f;
+    asset->boundsRadius = 0.f;
+    for (std::vector<Mesh*>::const_iterator it = asset->meshes.begin(); it != asset->meshes.end(); ++it)
+        asset->boundsRadius = glm::max(asset->boundsRadius, glm::length((*it)->boundsCenter - asset->boundsCenter) + (*it)->boundsRadius);
+}
+
+// Creates the materials of the asset, takes the meshes of the import and suballocates its streams
+// in the geometry arena. Without upload, the ranges are filled later with UploadModelAssetMesh().
+void BuildModelAsset(App* app, ModelImport& import, ModelAsset* asset, bool upload)
+{
+    CreateModelAssetMaterials(app, import, asset);
+
+    asset->meshes.swap(import.meshes);
+    ComputeModelAssetBounds(asset);
+
+    GeometryPool& vertices = app->geometry.vertices;
+    asset->vertexAllocation = vertices.Allocate(import.vertexBytes, asset);
+    asset->vertexHandle = vertices.Handle(asset->vertexAllocation);
+    asset->vertexBase = vertices.Offset(asset->vertexAllocation);
 
+    GeometryPool& indices = app->geometry.indices;
+    asset->indexAllocation = indices.Allocate(import.indexBytes, asset);
+    asset->indexHandle = indices.Handle(asset->indexAllocation);
+    asset->indexBase = indices.Offset(asset->indexAllocation);
 
-    // add the submesh into the mesh
-    Mesh* m = new Mesh();
-    m->vertexBufferLayout = vertexBufferLayout;
-    m->vertexs.swap(vertices);
-    m->indexs.swap(indices);
-    myModel->meshes.emplace_back(m);
+    // The import streams are released after the upload, unless the meshes have to stay cpu readable
+    if (asset->cpuReadable) RetainModelAssetCpuData(asset, import);
+
+    if (!upload) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, asset->vertexHandle);
+    glBufferSubData(GL_ARRAY_BUFFER, asset->vertexBase, import.vertexBytes, import.vertexData);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, asset->indexHandle);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, asset->indexBase, import.indexBytes, import.indexData);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
-void ProcessAssimpMaterial(App* app, aiMaterial* material, Material* myMaterial, String directory)
+// Uploads the vertex/index range of one submesh, returns the amount of bytes sent
+u32 UploadModelAssetMesh(ModelAsset* asset, const ModelImport& import, u32 index)
 {
-    aiString name;
-    aiColor3D diffuseColor;
-    aiColor3D emissiveColor;
-    aiColor3D specularColor;
-    ai_real shininess;
-    material->Get(AI_MATKEY_NAME, name);
-    material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuseColor);
-    material->Get(AI_MATKEY_COLOR_EMISSIVE, emissiveColor);
-    material->Get(AI_MATKEY_COLOR_SPECULAR, specularColor);
-    material->Get(AI_MATKEY_SHININESS, shininess);
+    const Mesh* mesh = asset->meshes[index];
+    const u32 indicesSize = mesh->indexCount * mesh->IndexSize();
 
-    myMaterial->name = name.C_Str();
-    myMaterial->diffuse = vec3(diffuseColor.r, diffuseColor.g, diffuseColor.b);
-    myMaterial->emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
-    myMaterial->shininess = shininess / 256.0f;
+    glBindBuffer(GL_ARRAY_BUFFER, asset->vertexHandle);
+    glBufferSubData(GL_ARRAY_BUFFER, asset->vertexBase + mesh->vertexOffset, mesh->vertexBytes, import.vertexData + mesh->vertexOffset);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    aiString aiFilename;
-    if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, asset->indexHandle);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, asset->indexBase + mesh->indexsOffset, indicesSize, import.indexData + mesh->indexsOffset);
+    u32 lodsSize = 0;
+    for (std::vector<MeshLod>::const_iterator it = mesh->lods.begin(); it != mesh->lods.end(); ++it)
     {
-        material->GetTexture(aiTextureType_DIFFUSE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial->diffuseTex = LoadTexture2D(app, filepath.str);
-        myMaterial->properties.Set(aiTextureType_DIFFUSE, true);
+        const u32 lodSize = it->indexCount * mesh->IndexSize();
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, asset->indexBase + it->indexsOffset, lodSize, import.indexData + it->indexsOffset);
+        lodsSize += lodSize;
     }
-    if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    return mesh->vertexBytes + indicesSize + lodsSize;
+}
+
+void DeleteModelAssetVaos(ModelAsset* m)
+{
+    for (std::vector<Mesh*>::iterator it = m->meshes.begin(); it != m->meshes.end(); ++it)
+    {
+        for (std::vector<Vao>::iterator vt = (*it)->vaos.begin(); vt != (*it)->vaos.end(); ++vt)
+            glDeleteVertexArrays(1, &vt->handle);
+        (*it)->vaos.clear();
+    }
+}
+
+// Deletes the VAOs every registered asset built for a program handle, once it is replaced (hot reload)
+void DeleteProgramVaos(App* app, GLuint program)
+{
+    for (std::unordered_map<std::string, ModelAsset*>::iterator it = app->modelAssets.begin(); it != app->modelAssets.end(); ++it)
+    {
+        for (std::vector<Mesh*>::iterator mt = it->second->meshes.begin(); mt != it->second->meshes.end(); ++mt)
+        {
+            std::vector<Vao>& vaos = (*mt)->vaos;
+            for (u32 i = 0; i < vaos.size();)
+            {
+                if (vaos[i].program != program) { ++i; continue; }
+                glDeleteVertexArrays(1, &vaos[i].handle);
+                vaos.erase(vaos.begin() + i);
+            }
+        }
+    }
+}
+
+// Frees the arena ranges, meshes and materials of an asset that is no longer referenced
+void FreeModelAsset(App* app, ModelAsset* m)
+{
+    DeleteModelAssetVaos(m);
+    for (std::vector<Mesh*>::iterator it = m->meshes.begin(); it != m->meshes.end(); ++it)
+        delete (*it);
+    m->meshes.clear();
+    m->materials.clear();
+
+    // The slots are reused by the next assets loaded
+    for (u32 i = m->baseMaterial; i < m->baseMaterial + m->materialCount; ++i)
+    {
+        Material* mat = app->materials[i];
+        const u32 slots[] = { mat->diffuseTex, mat->specularTex, mat->emissiveTex, mat->normalsTex, mat->bumpTex };
+        for (u32 s = 0; s < sizeof(slots) / sizeof(slots[0]); ++s)
+            ReleaseTexture2D(app, slots[s]);
+
+        delete app->materials[i];
+        app->materials[i] = nullptr;
+    }
+    FreeMaterialRange(app, m->baseMaterial, m->materialCount);
+    m->materialCount = 0;
+
+    app->geometry.vertices.Free(m->vertexAllocation);
+    app->geometry.indices.Free(m->indexAllocation);
+    m->vertexAllocation = INVALID_GEOMETRY_ALLOCATION;
+    m->indexAllocation = INVALID_GEOMETRY_ALLOCATION;
+    m->vertexHandle = 0;
+    m->indexHandle = 0;
+}
+
+// Runs one compaction step of the geometry arena (at most byteBudget bytes per pool)
+// and rebinds the assets whose ranges were moved. Their VAOs are rebuilt on the next draw.
+void CompactGeometryArena(App* app, u32 byteBudget)
+{
+    std::vector<GeometryMove> moves;
+    app->geometry.vertices.Compact(byteBudget, moves);
+    for (std::vector<GeometryMove>::iterator it = moves.begin(); it != moves.end(); ++it)
+    {
+        ModelAsset* asset = (ModelAsset*)it->owner;
+        asset->vertexHandle = it->handle;
+        asset->vertexBase = it->offset;
+        DeleteModelAssetVaos(asset);
+    }
+
+    moves.clear();
+    app->geometry.indices.Compact(byteBudget, moves);
+    for (std::vector<GeometryMove>::iterator it = moves.begin(); it != moves.end(); ++it)
+    {
+        ModelAsset* asset = (ModelAsset*)it->owner;
+        asset->indexHandle = it->handle;
+        asset->indexBase = it->offset;
+        DeleteModelAssetVaos(asset);
+    }
+}
+
+// Imports the file of an empty asset and makes it resident, returns false if the import failed
+bool ImportModelAsset(App* app, ModelAsset* m)
+{
+    f64 start = GetPerformanceTime();
+
+    ModelImport import;
+    if (!ReadModelImport(m->path.c_str(), import, true, app->vertexFormat, &app->jobs))
     {
-        material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial->specularTex = LoadTexture2D(app, filepath.str);
-        myMaterial->properties.Set(aiTextureType_EMISSIVE, true);
+        FreeModelImport(import);
+        return false;
+    }
+
+    BuildModelAsset(app, import, m, true);
+    m->resident = true;
+
+    ILOG("Loaded model %s (%s) in %.2f ms", m->path.c_str(), import.fromCache ? "cooked" : "imported", (GetPerformanceTime() - start) * 1000.0);
+
+    FreeModelImport(import);
 
+    return true;
+}
+
+ModelAsset* LoadModelAsset(App* app, const char* filename, bool cpuReadable)
+{
+    ModelAsset* m = new ModelAsset();
+    m->path = filename;
+    m->cpuReadable = cpuReadable;
+    if (!ImportModelAsset(app, m))
+    {
+        delete m;
+        return nullptr;
     }
-    if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
+    return m;
+}
+
+// Pushes the import of a registered asset to the workers, ProcessModelUploads() makes it resident
+void StartModelAssetImport(App* app, ModelAsset* asset)
+{
+    std::string path = asset->path;
+    VertexFormat format = app->vertexFormat;
+    app->jobs.Push([app, asset, path, format]()
+    {
+        ModelUpload upload;
+        upload.asset = asset;
+        upload.import = new ModelImport();
+        upload.success = ReadModelImport(path.c_str(), *upload.import, true, format, &app->jobs);
+
+        app->modelUploadQueue.Push(upload);
+    });
+}
+
+// Returns the registered asset for this path, importing it only the first time
+ModelAsset* AcquireModelAsset(App* app, const char* filename, bool cpuReadable = false)
+{
+    std::unordered_map<std::string, ModelAsset*>::iterator it = app->modelAssets.find(filename);
+    ModelAsset* asset = nullptr;
+
+    if (it != app->modelAssets.end())
     {
-        material->GetTexture(aiTextureType_EMISSIVE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial->emissiveTex = LoadTexture2D(app, filepath.str);
-        myMaterial->properties.Set(aiTextureType_EMISSIVE, true);
+        asset = it->second;
+        if (cpuReadable) SetModelAssetCpuReadable(asset);
+
+        // The file may have been fixed (or finished being written) since, the placed models get it too
+        if (asset->failed)
+        {
+            asset->failed = false;
+            if (!ImportModelAsset(app, asset))
+            {
+                asset->failed = true;
+                return nullptr;
+            }
+        }
     }
-    if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
+    else
     {
-        material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial->normalsTex = LoadTexture2D(app, filepath.str);
-        myMaterial->properties.Set(aiTextureType_NORMALS, true);
+        asset = LoadModelAsset(app, filename, cpuReadable);
+        if (!asset) return nullptr;
+        app->modelAssets[asset->path] = asset;
     }
-    if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
+
+    asset->references++;
+    return asset;
+}
+
+// Same as AcquireModelAsset(), but a new asset is registered right away (not resident)
+// while a worker imports it. ProcessModelUploads() makes it resident on the GL thread.
+ModelAsset* AcquireModelAssetAsync(App* app, const char* filename, bool cpuReadable = false)
+{
+    std::unordered_map<std::string, ModelAsset*>::iterator it = app->modelAssets.find(filename);
+    if (it != app->modelAssets.end())
     {
-        material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial->bumpTex = LoadTexture2D(app, filepath.str);
-        myMaterial->properties.Set(aiTextureType_HEIGHT, true);
+        ModelAsset* asset = it->second;
+        if (cpuReadable) SetModelAssetCpuReadable(asset);
+
+        // A failed import is tried again, the file may have been fixed (or finished being written) since
+        if (asset->failed)
+        {
+            asset->failed = false;
+            StartModelAssetImport(app, asset);
+        }
+
+        asset->references++;
+        return asset;
     }
 
-    //myMaterial.createNormalFromBump();
+    ModelAsset* asset = new ModelAsset();
+    asset->path = filename;
+    asset->cpuReadable = cpuReadable;
+    asset->references++;
+    app->modelAssets[asset->path] = asset;
+    StartModelAssetImport(app, asset);
+
+    return asset;
 }
 
-void ProcessAssimpNode(const aiScene* scene, aiNode* node, Model* myModel, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+void ReleaseModelAsset(App* app, const char* filename)
 {
-    // process all the node's meshes (if any)
-    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    std::unordered_map<std::string, ModelAsset*>::iterator it = app->modelAssets.find(filename);
+    if (it == app->modelAssets.end()) return;
+
+    ModelAsset* asset = it->second;
+    if (--asset->references > 0) return;
+
+    app->modelAssets.erase(it);
+
+    // A worker or the upload queue still points to it, ProcessModelUploads() will free it
+    if (!asset->resident && !asset->failed)
     {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        ProcessAssimpMesh(scene, mesh, myModel, baseMeshMaterialIndex, submeshMaterialIndices);
+        asset->orphaned = true;
+        return;
     }
 
-    // then do the same for each of its children
-    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    FreeModelAsset(app, asset);
+    delete asset;
+}
+
+// Drains the imports finished by the workers and uploads their meshes,
+// spending at most app->uploadBudget bytes per frame (but always at least one mesh)
+void ProcessModelUploads(App* app)
+{
+    app->modelUploadQueue.PopAll(app->modelUploads);
+
+    u32 uploaded = 0;
+    std::vector<ModelUpload>::iterator it = app->modelUploads.begin();
+    while (it != app->modelUploads.end() && (uploaded == 0 || uploaded < app->uploadBudget))
     {
-        ProcessAssimpNode(scene, node->mChildren[i], myModel, baseMeshMaterialIndex, submeshMaterialIndices);
+        ModelUpload& upload = *it;
+        ModelAsset* asset = upload.asset;
+        bool done = false;
+
+        if (asset->orphaned)
+        {
+            FreeModelAsset(app, asset);
+            delete asset;
+            done = true;
+        }
+        else if (!upload.success)
+        {
+            ELOG("Asynchronous load of model %s failed", asset->path.c_str());
+            asset->failed = true;
+            done = true;
+        }
+        else
+        {
+            if (!upload.built)
+            {
+                BuildModelAsset(app, *upload.import, asset, false);
+                upload.built = true;
+            }
+
+            while (upload.uploadedMeshes < asset->meshes.size() && (uploaded == 0 || uploaded < app->uploadBudget))
+                uploaded += UploadModelAssetMesh(asset, *upload.import, upload.uploadedMeshes++);
+
+            if (upload.uploadedMeshes == asset->meshes.size())
+            {
+                if (asset->cpuReadable) RetainModelAssetCpuData(asset, *upload.import);
+
+                asset->resident = true;
+                done = true;
+                ILOG("Model %s resident (%s)", asset->path.c_str(), upload.import->fromCache ? "cooked" : "imported");
+            }
+        }
+
+        if (done)
+        {
+            FreeModelImport(*upload.import);
+            delete upload.import;
+            it = app->modelUploads.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
     }
 }
 
-Model* LoadModel(App* app, const char* filename)
+// Cold path: Assimp import + post-process + upload. Warm path: mapped cooked file + upload.
+void BenchmarkModelLoad(App* app, const char* filename, u32 iterations)
 {
-    const aiScene* scene = aiImportFile(filename,
-        aiProcess_Triangulate |
-        aiProcess_GenSmoothNormals |
-        aiProcess_CalcTangentSpace |
-        aiProcess_JoinIdenticalVertices |
-        aiProcess_PreTransformVertices |
-        aiProcess_ImproveCacheLocality |
-        aiProcess_OptimizeMeshes |
-        aiProcess_SortByPType);
+    // Make sure the cooked file is up to date before timing the warm path
+    {
+        ModelImport import;
+        bool imported = ImportModelSource(filename, import, app->vertexFormat, &app->jobs);
+        if (imported) WriteCookedModel(filename, import);
+        FreeModelImport(import);
+        if (!imported) return;
+    }
+
+    f64 cold = 0.0;
+    f64 warm = 0.0;
 
-    if (!scene)
+    for (u32 i = 0; i < iterations; ++i)
     {
-        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
-        return nullptr;
+        ModelImport coldImport;
+        ModelAsset coldAsset;
+        f64 start = GetPerformanceTime();
+        ImportModelSource(filename, coldImport, app->vertexFormat, &app->jobs);
+        BuildModelAsset(app, coldImport, &coldAsset, true);
+        glFinish();
+        cold += GetPerformanceTime() - start;
+        FreeModelAsset(app, &coldAsset);
+        FreeModelImport(coldImport);
+
+        ModelImport warmImport;
+        ModelAsset warmAsset;
+        start = GetPerformanceTime();
+        ReadCookedModel(filename, warmImport, app->vertexFormat);
+        BuildModelAsset(app, warmImport, &warmAsset, true);
+        glFinish();
+        warm += GetPerformanceTime() - start;
+        FreeModelAsset(app, &warmAsset);
+        FreeModelImport(warmImport);
     }
 
-    //app->meshes.push_back(Mesh{});
-    //Mesh& mesh = app->meshes.back();
-    //u32 meshIdx = (u32)app->meshes.size() - 1u;
+    cold = cold * 1000.0 / iterations;
+    warm = warm * 1000.0 / iterations;
+    ILOG("Model load benchmark %s (%u iterations): cold %.3f ms, warm %.3f ms, speedup x%.1f", filename, iterations, cold, warm, warm > 0.0 ? cold / warm : 0.0);
+}
+
+// Cpu bytes held by mesh copies of every registered asset
+u64 ModelAssetsCpuBytes(App* app, u32* readableMeshes = nullptr)
+{
+    u64 bytes = 0;
+    u32 meshes = 0;
+    for (std::unordered_map<std::string, ModelAsset*>::iterator it = app->modelAssets.begin(); it != app->modelAssets.end(); ++it)
+    {
+        for (std::vector<Mesh*>::iterator mt = it->second->meshes.begin(); mt != it->second->meshes.end(); ++mt)
+        {
+            if (!(*mt)->cpuReadable) continue;
+            bytes += (*mt)->vertexs.capacity() + (*mt)->indexs.capacity() * sizeof(u32);
+            meshes++;
+        }
+    }
 
-    Model* m = new Model();
-    app->objects.emplace_back(m);
-    u32 modelIdx = (u32)app->objects.size() - 1u;
+    if (readableMeshes) *readableMeshes = meshes;
+    return bytes;
+}
 
-    String directory = GetDirectoryPart(MakeString(filename));
-    GetFileName(&m->name, filename);
-    
+// Writes a textured grid of size x size quads as an OBJ file, returns its size in bytes (0 on failure)
+u64 WriteBenchmarkObj(const char* filename, u32 size)
+{
+    FILE* file = fopen(filename, "wb");
+    if (!file) return 0;
 
-    // Create a list of materials
-    u32 baseMeshMaterialIndex = (u32)app->materials.size();
-    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    const u32 side = size + 1;
+    for (u32 y = 0; y < side; ++y)
     {
-        Material* mat = new Material();
-        app->materials.emplace_back(mat);
-        ProcessAssimpMaterial(app, scene->mMaterials[i], mat, directory);
+        for (u32 x = 0; x < side; ++x)
+        {
+            const float u = (float)x / size, v = (float)y / size;
+            fprintf(file, "v %f %f %f\n", u * 100.f - 50.f, sinf(u * 31.f) * cosf(v * 17.f), v * 100.f - 50.f);
+            fprintf(file, "vt %f %f\n", u, v);
+            fprintf(file, "vn %f %f %f\n", 0.f, 1.f, 0.f);
+        }
+    }
+
+    fprintf(file, "usemtl Grid\n");
+    for (u32 y = 0; y < size; ++y)
+    {
+        for (u32 x = 0; x < size; ++x)
+        {
+            const u32 a = y * side + x + 1, b = a + 1, c = a + side, d = c + 1;
+            fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, c, c, c, d, d, d, b, b, b);
+        }
+    }
+
+    const u64 bytes = ftell(file);
+    fclose(file);
+    return bytes;
+}
+
+// Import throughput of the native OBJ parser against Assimp on a generated OBJ.
+// Both paths share the mesh processing (optimization, LODs), so the parse stage is reported apart.
+void BenchmarkObjImport(App* app, u32 gridSize)
+{
+    const char* filename = "BenchmarkGrid.obj";
+    const u64 bytes = WriteBenchmarkObj(filename, gridSize);
+    if (!bytes)
+    {
+        ELOG("Could not write %s", filename);
+        return;
     }
 
-    ProcessAssimpNode(scene, scene->mRootNode, m, baseMeshMaterialIndex, m->materials);
+    const f64 megabytes = bytes / (1024.0 * 1024.0);
+
+    ModelImport native;
+    f64 parse = 0.0;
+    f64 start = GetPerformanceTime();
+    ImportObjModel(filename, native, app->vertexFormat, &parse, &app->jobs);
+    const f64 nativeTime = GetPerformanceTime() - start;
+    const bool match = native.meshes.size() == 1;
+    const u32 nativeVertexBytes = native.vertexBytes;
+    FreeModelImport(native);
+
+    ModelImport assimp;
+    start = GetPerformanceTime();
+    ImportModelData(filename, assimp, app->vertexFormat);
+    const f64 assimpTime = GetPerformanceTime() - start;
+    const u32 assimpVertexBytes = assimp.vertexBytes;
+    FreeModelImport(assimp);
+
+    remove(filename);
+
+    ILOG("OBJ import benchmark (%.2f MB, %u triangles): native %.2f ms (%.1f MB/s, parse %.2f ms / %.1f MB/s), assimp %.2f ms (%.1f MB/s)",
+        megabytes, gridSize * gridSize * 2, nativeTime * 1000.0, megabytes / nativeTime, parse * 1000.0, megabytes / parse,
+        assimpTime * 1000.0, megabytes / assimpTime);
+    ILOG("OBJ import benchmark: vertex stream %u bytes native, %u bytes assimp%s", nativeVertexBytes, assimpVertexBytes, match ? "" : " (unexpected mesh count)");
+}
+
+// Writes a grid of size x size quads as a GLB file with separate position/normal/uv arrays and
+// 32 bit indices, returns its size in bytes (0 on failure)
+u64 WriteBenchmarkGlb(const char* filename, u32 size)
+{
+    const u32 side = size + 1;
+    const u32 vertexCount = side * side;
+    const u32 indexCount = size * size * 6;
 
-    aiReleaseImport(scene);
+    std::vector<u8> bin(vertexCount * (12 + 12 + 8) + indexCount * 4);
+    float* positions = (float*)bin.data();
+    float* normals = positions + vertexCount * 3;
+    float* uvs = normals + vertexCount * 3;
+    u32* indices = (u32*)(uvs + vertexCount * 2);
 
-    u32 vertexBufferSize = 0;
-    u32 indexBufferSize = 0;
+    for (u32 y = 0; y < side; ++y)
+    {
+        for (u32 x = 0; x < side; ++x)
+        {
+            const u32 v = y * side + x;
+            const float u = (float)x / size, t = (float)y / size;
+            positions[v * 3 + 0] = u * 100.f - 50.f;
+            positions[v * 3 + 1] = sinf(u * 31.f) * cosf(t * 17.f);
+            positions[v * 3 + 2] = t * 100.f - 50.f;
+            normals[v * 3 + 0] = 0.f;
+            normals[v * 3 + 1] = 1.f;
+            normals[v * 3 + 2] = 0.f;
+            uvs[v * 2 + 0] = u;
+            uvs[v * 2 + 1] = t;
+        }
+    }
 
-    unsigned int size = m->meshes.size();
-    for (u32 i = 0; i < size; ++i)
+    for (u32 y = 0, i = 0; y < size; ++y)
     {
-        vertexBufferSize += m->meshes[i]->vertexs.size() * sizeof(float);
-        indexBufferSize += m->meshes[i]->indexs.size() * sizeof(u32);
+        for (u32 x = 0; x < size; ++x)
+        {
+            const u32 a = y * side + x, b = a + 1, c = a + side, d = c + 1;
+            indices[i++] = a; indices[i++] = c; indices[i++] = d;
+            indices[i++] = a; indices[i++] = d; indices[i++] = b;
+        }
     }
 
-    glGenBuffers(1, &m->vertexHandle);
-    glBindBuffer(GL_ARRAY_BUFFER, m->vertexHandle);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
+    const u32 p = 0, n = vertexCount * 12, t = n + vertexCount * 12, i = t + vertexCount * 8;
+    char json[2048];
+    int jsonSize = snprintf(json, sizeof(json),
+        "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+        "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3}]}],"
+        "\"accessors\":["
+        "{\"bufferView\":0,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\",\"min\":[-50,-1,-50],\"max\":[50,1,50]},"
+        "{\"bufferView\":1,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+        "{\"bufferView\":2,\"componentType\":5126,\"count\":%u,\"type\":\"VEC2\"},"
+        "{\"bufferView\":3,\"componentType\":5125,\"count\":%u,\"type\":\"SCALAR\"}],"
+        "\"bufferViews\":["
+        "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},"
+        "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u}],"
+        "\"buffers\":[{\"byteLength\":%u}]}",
+        vertexCount, vertexCount, vertexCount, indexCount,
+        p, n - p, n, t - n, t, i - t, i, indexCount * 4, (u32)bin.size());
+
+    // Chunks are padded to 4 bytes, the JSON one with spaces
+    while (jsonSize % 4 != 0) json[jsonSize++] = ' ';
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) return 0;
+
+    const u32 header[5] = { GLB_MAGIC, 2, (u32)(12 + 8 + jsonSize + 8 + bin.size()), (u32)jsonSize, GLB_CHUNK_JSON };
+    const u32 binHeader[2] = { (u32)bin.size(), GLB_CHUNK_BIN };
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(json, jsonSize, 1, file);
+    fwrite(binHeader, sizeof(binHeader), 1, file);
+    fwrite(bin.data(), bin.size(), 1, file);
+
+    const u64 bytes = ftell(file);
+    fclose(file);
+    return bytes;
+}
 
-    glGenBuffers(1, &m->indexHandle);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->indexHandle);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
+// Load time (import + upload) and memory of the zero-copy GLB path against Assimp on a generated GLB.
+// The GLB path runs first: the peak working set only grows, so the Assimp peak includes the GLB one.
+void BenchmarkGlbImport(App* app, u32 gridSize)
+{
+    const char* filename = "BenchmarkGrid.glb";
+    const u64 bytes = WriteBenchmarkGlb(filename, gridSize);
+    if (!bytes)
+    {
+        ELOG("Could not write %s", filename);
+        return;
+    }
 
-    u32 indicesOffset = 0;
-    u32 verticesOffset = 0;
+    const char* names[2] = { "zero-copy", "assimp" };
+    f64 times[2] = {};
+    u64 resident[2] = {};
+    u64 peak[2] = {};
 
-    size = m->meshes.size();
-    for (u32 i = 0; i < size; ++i)
+    for (u32 r = 0; r < 2; ++r)
     {
-        const void* verticesData = m->meshes[i]->vertexs.data();
-        const u32   verticesSize = m->meshes[i]->vertexs.size() * sizeof(float);
-        glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-        m->meshes[i]->vertexOffset = verticesOffset;
-        verticesOffset += verticesSize;
+        const u64 residentBefore = GetResidentMemory();
+        const u64 peakBefore = GetPeakResidentMemory();
+        const f64 start = GetPerformanceTime();
+
+        ModelImport import;
+        const bool imported = r == 0 ? ImportGlbModel(filename, import) : ImportModelData(filename, import, app->vertexFormat);
+        if (!imported)
+        {
+            ELOG("%s import of %s failed", names[r], filename);
+            FreeModelImport(import);
+            continue;
+        }
+
+        ModelAsset* asset = new ModelAsset();
+        BuildModelAsset(app, import, asset, true);
+        glFinish();
+        times[r] = GetPerformanceTime() - start;
+
+        const u64 residentAfter = GetResidentMemory();
+        const u64 peakAfter = GetPeakResidentMemory();
+        resident[r] = residentAfter > residentBefore ? residentAfter - residentBefore : 0;
+        peak[r] = peakAfter > peakBefore ? peakAfter - peakBefore : 0;
 
-        const void* indicesData = m->meshes[i]->indexs.data();
-        const u32   indicesSize = m->meshes[i]->indexs.size() * sizeof(u32);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-        m->meshes[i]->indexsOffset = indicesOffset;
-        indicesOffset += indicesSize;
+        FreeModelImport(import);
+        FreeModelAsset(app, asset);
+        delete asset;
     }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    remove(filename);
 
-    return m;
-}
\ No newline at end of file
+    ILOG("GLB load benchmark (%.2f MB, %u triangles): %s %.2f ms, %s %.2f ms",
+        bytes / (1024.0 * 1024.0), gridSize * gridSize * 2, names[0], times[0] * 1000.0, names[1], times[1] * 1000.0);
+    ILOG("GLB load benchmark: resident +%.2f MB / peak +%.2f MB %s, resident +%.2f MB / peak +%.2f MB %s",
+        resident[0] / (1024.0 * 1024.0), peak[0] / (1024.0 * 1024.0), names[0], resident[1] / (1024.0 * 1024.0), peak[1] / (1024.0 * 1024.0), names[1]);
+}
+
+// Resident memory growth of keeping `copies` instances of a model loaded,
+// with the cpu copies released after upload and with cpu readable meshes
+void BenchmarkResidentMemory(App* app, const char* filename, u32 copies)
+{
+    const bool cpuReadable[2] = { false, true };
+    u64 growth[2] = {};
+
+    for (u32 r = 0; r < 2; ++r)
+    {
+        std::vector<ModelAsset*> assets;
+        u64 before = GetResidentMemory();
+
+        for (u32 i = 0; i < copies; ++i)
+        {
+            ModelImport import;
+            if (!ReadModelImport(filename, import, true, app->vertexFormat, &app->jobs))
+            {
+                FreeModelImport(import);
+                break;
+            }
+
+            ModelAsset* asset = new ModelAsset();
+            asset->cpuReadable = cpuReadable[r];
+            BuildModelAsset(app, import, asset, true);
+            FreeModelImport(import);
+            assets.push_back(asset);
+        }
+
+        glFinish();
+        u64 after = GetResidentMemory();
+        growth[r] = after > before ? after - before : 0;
+
+        for (std::vector<ModelAsset*>::iterator it = assets.begin(); it != assets.end(); ++it)
+        {
+            FreeModelAsset(app, *it);
+            delete (*it);
+        }
+    }
+
+    ILOG("Resident memory benchmark %s (%u copies): released cpu copies +%.2f MB, cpu readable +%.2f MB",
+        filename, copies, growth[0] / (1024.0 * 1024.0), growth[1] / (1024.0 * 1024.0));
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+// Lock-free multiple producer / single consumer queue.
+// Producers push with a CAS on the list head, the consumer grabs the whole list at once
+// and restores the push order, so elements come out oldest first.
+template <typename T>
+class AtomicQueue
+{
+public:
+
+	~AtomicQueue()
+	{
+		std::vector<T> remaining;
+		PopAll(remaining);
+	}
+
+	void Push(const T& value)
+	{
+		Node* node = new Node();
+		node->value = value;
+		node->next = head.load(std::memory_order_relaxed);
+		while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	// Only one thread may consume
+	void PopAll(std::vector<T>& out)
+	{
+		Node* node = head.exchange(nullptr, std::memory_order_acquire);
+
+		Node* reversed = nullptr;
+		while (node)
+		{
+			Node* next = node->next;
+			node->next = reversed;
+			reversed = node;
+			node = next;
+		}
+
+		while (reversed)
+		{
+			Node* next = reversed->next;
+			out.push_back(reversed->value);
+			delete reversed;
+			reversed = next;
+		}
+	}
+
+	bool Empty() const
+	{
+		return head.load(std::memory_order_relaxed) == nullptr;
+	}
+
+private:
+
+	struct Node
+	{
+		T value;
+		Node* next;
+	};
+
+	std::atomic<Node*> head = { nullptr };
+
+};
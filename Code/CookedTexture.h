@@ -0,0 +1,366 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "platform.h"
+#include "Image.h"
+#include "MeshCache.h"
+#include "Texture.h"
+#include "TextureCompression.h"
+#include "MipChain.h"
+
+// Cooked textures are DDS files next to their source, one per usage (Albedo.png -> Albedo.png.color.dds),
+// with the whole mip chain already filtered (see MipChain.h) and block compressed when possible, so a warm load maps the
+// file and uploads every level as it is, with no decoding, flipping or mip generation left to do.
+// Layout: [CookedTextureHeader][level 0][level 1]...
+// The header is a plain DDS header whose reserved words carry the cooking info: the source timestamp and
+// hash (validated like the cooked models, see MeshCache.h), what it was cooked for (usage, compression)
+// and the hash of the decoded pixels, which lets the texture cache share identical textures without
+// decoding them. Textures are stored as the engine samples them, i.e. flipped vertically.
+
+#define COOKED_TEXTURE_MAGIC   0x58544E4E // "NNTX"
+#define COOKED_TEXTURE_VERSION 2
+#define COOKED_TEXTURE_EXTENSION ".dds"
+
+#define DDS_MAGIC       0x20534444 // "DDS "
+#define DDS_FOURCC_DXT1 0x31545844
+#define DDS_FOURCC_DXT5 0x35545844
+#define DDS_FOURCC_ATI2 0x32495441
+
+struct DdsPixelFormat
+{
+    u32 size;
+    u32 flags;
+    u32 fourCC;
+    u32 rgbBitCount;
+    u32 masks[4];
+};
+
+struct CookedTextureHeader
+{
+    u32 ddsMagic;
+    u32 size;
+    u32 flags;
+    u32 height;
+    u32 width;
+    u32 linearSize;
+    u32 depth;
+    u32 mipMapCount;
+    // DDS reserved words
+    u32 magic;
+    u32 version;
+    u64 sourceTimestamp;
+    u64 sourceHash;
+    u64 contentHash;
+    u32 usage;
+    u32 compressed; // Block compression was asked for (the format can still be RGBA8)
+    u32 reserved;
+    DdsPixelFormat format;
+    u32 caps[4];
+    u32 reserved2;
+};
+
+static_assert(sizeof(CookedTextureHeader) == 128, "A DDS header is 124 bytes after the magic");
+
+
+struct TextureEncodeStats
+{
+    f64 seconds = 0.0;       // Encoding only, without measuring the error
+    f64 filterSeconds = 0.0; // Mip chain filtering
+    f64 psnr = 0.0;          // Of the top level
+    u64 texels = 0;          // Of the whole chain
+
+    f64 MegaPixelsPerSecond() const { return seconds > 0.0 ? texels / seconds / 1e6 : 0.0; }
+};
+
+const char* TextureUsageName(TextureUsage usage)
+{
+    return usage == TU_NORMALS ? "normals" : "color";
+}
+
+// A source sampled both as color and as normals has both cooked files, each in its own format
+std::string CookedTexturePath(const char* filename, TextureUsage usage)
+{
+    return std::string(filename) + "." + TextureUsageName(usage) + COOKED_TEXTURE_EXTENSION;
+}
+
+const char* BlockFormatName(BlockFormat format)
+{
+    static const char* names[] = { "BC1", "BC3", "BC5", "RGBA8" };
+    return format < BF_COUNT ? names[format] : "?";
+}
+
+// Of the levels from firstLevel down to the smallest one
+u64 CookedTextureBytes(const CookedTexture& cooked, u32 firstLevel = 0)
+{
+    u64 bytes = 0;
+    for (u32 i = firstLevel; i < cooked.levelCount; ++i)
+        bytes += cooked.levelBytes[i];
+    return bytes;
+}
+
+// Whole blocks only: GL wants the top level of a compressed texture in multiples of 4
+bool CanCompressImage(const Image& image)
+{
+    return image.pixels && (image.nchannels == 3 || image.nchannels == 4) &&
+        image.size.x > 0 && image.size.y > 0 && image.size.x % 4 == 0 && image.size.y % 4 == 0;
+}
+
+BlockFormat SelectBlockFormat(const Image& image, TextureUsage usage, bool compress)
+{
+    if (!compress || !CanCompressImage(image)) return BF_RGBA8;
+    if (usage == TU_NORMALS) return BF_BC5;
+    if (image.nchannels < 4) return BF_BC1;
+
+    const u8* pixels = (const u8*)image.pixels;
+    for (u64 i = 0, count = (u64)image.size.x * image.size.y; i < count; ++i)
+        if (pixels[i * 4 + 3] != 255) return BF_BC3;
+    return BF_BC1;
+}
+
+// Gray images keep their gray in the three color channels, alpha is opaque unless the image has one
+void ExpandToRgba(const Image& image, std::vector<u8>& rgba)
+{
+    const u64 count = (u64)image.size.x * image.size.y;
+    const i32 channels = image.nchannels;
+    rgba.resize(count * 4);
+    const u8* src = (const u8*)image.pixels;
+    for (u64 i = 0; i < count; ++i)
+    {
+        const u8* texel = src + i * channels;
+        for (i32 c = 0; c < 3; ++c) rgba[i * 4 + c] = channels >= 3 ? texel[c] : texel[0];
+        rgba[i * 4 + 3] = channels == 4 ? texel[3] : channels == 2 ? texel[1] : 255;
+    }
+}
+
+// Filters the full mip chain of a decoded image and encodes it for the given usage: block compressed
+// when asked (and CanCompressImage()), RGBA8 otherwise. Color is filtered in linear light.
+void BuildCookedTexture(const Image& image, TextureUsage usage, bool compress, u64 contentHash, CookedTexture& cooked, TextureEncodeStats* stats)
+{
+    cooked = {};
+    cooked.format = SelectBlockFormat(image, usage, compress);
+    cooked.usage = usage;
+    cooked.width = image.size.x;
+    cooked.height = image.size.y;
+    cooked.contentHash = contentHash;
+    cooked.levelCount = std::min(MipLevelCount(cooked.width, cooked.height), (u32)COOKED_TEXTURE_MAX_LEVELS);
+
+    u64 bytes = 0;
+    for (u32 i = 0, width = cooked.width, height = cooked.height; i < cooked.levelCount; ++i, width = MipSize(width), height = MipSize(height))
+    {
+        cooked.levelBytes[i] = LevelBytes(cooked.format, width, height);
+        bytes += cooked.levelBytes[i];
+    }
+    cooked.blocks.resize(bytes);
+
+    // The top level is the source itself, the rest come from the linear chain
+    const bool srgb = usage == TU_COLOR;
+    std::vector<u8> level;
+    std::vector<f32> linear, next;
+    ExpandToRgba(image, level);
+    f64 start = GetPerformanceTime();
+    linear.resize(level.size());
+    LinearizeRgba(level.data(), (u64)cooked.width * cooked.height, srgb, linear.data());
+
+    TextureEncodeStats result;
+    result.filterSeconds = GetPerformanceTime() - start;
+    u32 width = cooked.width, height = cooked.height;
+    u8* blocks = cooked.blocks.data();
+    for (u32 i = 0; i < cooked.levelCount; ++i)
+    {
+        if (i > 0)
+        {
+            start = GetPerformanceTime();
+            next.resize((u64)MipSize(width) * MipSize(height) * 4);
+            DownsampleLinear(linear.data(), width, height, next.data());
+            linear.swap(next);
+            width = MipSize(width);
+            height = MipSize(height);
+            level.resize((u64)width * height * 4);
+            EncodeLinearRgba(linear.data(), (u64)width * height, srgb, level.data());
+            result.filterSeconds += GetPerformanceTime() - start;
+        }
+
+        start = GetPerformanceTime();
+        CompressLevel(level.data(), width, height, cooked.format, blocks);
+        result.seconds += GetPerformanceTime() - start;
+        result.texels += (u64)width * height;
+
+        if (i == 0 && stats && cooked.format != BF_RGBA8)
+        {
+            std::vector<u8> decoded(level.size());
+            DecompressLevel(blocks, width, height, cooked.format, decoded.data());
+            result.psnr = ComputeCompressionPsnr(level.data(), decoded.data(), (u64)width * height, cooked.format);
+        }
+
+        cooked.levels[i] = blocks;
+        blocks += cooked.levelBytes[i];
+    }
+
+    if (stats) *stats = result;
+}
+
+// Writes the cooked version of a texture built from the source file
+bool WriteCookedTexture(const char* filename, const CookedTexture& cooked, bool compressed)
+{
+    static const u32 fourCCs[] = { DDS_FOURCC_DXT1, DDS_FOURCC_DXT5, DDS_FOURCC_ATI2, 0 };
+
+    CookedTextureHeader header = {};
+    header.ddsMagic = DDS_MAGIC;
+    header.size = sizeof(CookedTextureHeader) - sizeof(header.ddsMagic);
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000; // Caps, height, width, pixel format, mip count
+    header.flags |= cooked.format == BF_RGBA8 ? 0x8 : 0x80000; // Pitch or linear size
+    header.height = cooked.height;
+    header.width = cooked.width;
+    header.linearSize = cooked.format == BF_RGBA8 ? cooked.width * 4 : cooked.levelBytes[0];
+    header.mipMapCount = cooked.levelCount;
+    header.magic = COOKED_TEXTURE_MAGIC;
+    header.version = COOKED_TEXTURE_VERSION;
+    header.sourceTimestamp = GetFileLastWriteTimestamp(filename);
+    header.sourceHash = HashSourceFile(filename);
+    header.contentHash = cooked.contentHash;
+    header.usage = cooked.usage;
+    header.compressed = compressed;
+    header.format.size = sizeof(DdsPixelFormat);
+    header.format.flags = 0x4; // FourCC
+    header.format.fourCC = fourCCs[cooked.format];
+    if (cooked.format == BF_RGBA8)
+    {
+        header.format.flags = 0x40 | 0x1; // RGB, alpha pixels
+        header.format.rgbBitCount = 32;
+        header.format.masks[0] = 0x000000ff;
+        header.format.masks[1] = 0x0000ff00;
+        header.format.masks[2] = 0x00ff0000;
+        header.format.masks[3] = 0xff000000;
+    }
+    header.caps[0] = 0x1000 | 0x400000 | 0x8; // Texture, mipmap, complex
+
+    // Renamed over the cached file when complete, same as WriteCookedModel()
+    std::string cookedPath = CookedTexturePath(filename, cooked.usage);
+    std::string temporaryPath = cookedPath + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+    {
+        ELOG("Could not write cooked texture %s", cookedPath.c_str());
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (u32 i = 0; written && i < cooked.levelCount; ++i)
+        written = fwrite(cooked.levels[i], 1, cooked.levelBytes[i], file) == cooked.levelBytes[i];
+    written = fflush(file) == 0 && written;
+    written = fclose(file) == 0 && written;
+
+    if (!written || !MoveFileOver(temporaryPath.c_str(), cookedPath.c_str()))
+    {
+        ELOG("Could not write cooked texture %s", cookedPath.c_str());
+        remove(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// Checks the cooked header against the source file, same rules as IsCookedModelValid()
+bool IsCookedTextureValid(const CookedTextureHeader& header, const char* filename, TextureUsage usage, bool compressed, bool& touched)
+{
+    touched = false;
+    if (header.ddsMagic != DDS_MAGIC || header.magic != COOKED_TEXTURE_MAGIC || header.version != COOKED_TEXTURE_VERSION) return false;
+    if (header.usage != (u32)usage || header.compressed != (u32)compressed) return false;
+
+    u64 timestamp = GetFileLastWriteTimestamp(filename);
+    if (timestamp == header.sourceTimestamp) return true;
+
+    if (HashSourceFile(filename) != header.sourceHash) return false;
+
+    touched = true;
+    return true;
+}
+
+// Validates the header (refreshing the timestamp of touched sources) before the file gets mapped
+bool CheckCookedTexture(const char* filename, TextureUsage usage, bool compressed)
+{
+    std::string cookedPath = CookedTexturePath(filename, usage);
+    FILE* file = fopen(cookedPath.c_str(), "rb");
+    if (!file) return false;
+
+    CookedTextureHeader header = {};
+    bool read = fread(&header, sizeof(header), 1, file) == 1;
+    fclose(file);
+
+    bool touched = false;
+    if (!read || !IsCookedTextureValid(header, filename, usage, compressed, touched)) return false;
+
+    if (touched)
+    {
+        file = fopen(cookedPath.c_str(), "r+b");
+        if (file)
+        {
+            u64 timestamp = GetFileLastWriteTimestamp(filename);
+            fseek(file, offsetof(CookedTextureHeader, sourceTimestamp), SEEK_SET);
+            fwrite(&timestamp, sizeof(timestamp), 1, file);
+            fclose(file);
+        }
+    }
+
+    return true;
+}
+
+// Fills the cooked texture from the cooked file of the source, returns false if there is no valid one
+// for the usage and compression. The levels point into the mapping, which is released with FreeCookedTexture().
+bool ReadCookedTexture(const char* filename, TextureUsage usage, bool compressed, CookedTexture& cooked)
+{
+    cooked = {};
+    if (!CheckCookedTexture(filename, usage, compressed)) return false;
+
+    std::string cookedPath = CookedTexturePath(filename, usage);
+    MappedFile file = MapFile(cookedPath.c_str());
+    if (!file.data) return false;
+
+    const CookedTextureHeader* header = (const CookedTextureHeader*)file.data;
+    if (file.size < sizeof(CookedTextureHeader))
+    {
+        UnmapFile(file);
+        return false;
+    }
+
+    switch (header->format.fourCC)
+    {
+    case DDS_FOURCC_DXT1: cooked.format = BF_BC1; break;
+    case DDS_FOURCC_DXT5: cooked.format = BF_BC3; break;
+    case DDS_FOURCC_ATI2: cooked.format = BF_BC5; break;
+    case 0:
+        if (header->format.rgbBitCount != 32 || header->format.masks[0] != 0x000000ff) { UnmapFile(file); return false; }
+        cooked.format = BF_RGBA8;
+        break;
+    default: UnmapFile(file); return false;
+    }
+
+    cooked.usage = usage;
+    cooked.width = header->width;
+    cooked.height = header->height;
+    cooked.contentHash = header->contentHash;
+
+    u64 offset = sizeof(CookedTextureHeader);
+    u32 width = cooked.width, height = cooked.height;
+    for (u32 i = 0; i < header->mipMapCount && i < COOKED_TEXTURE_MAX_LEVELS; ++i)
+    {
+        const u32 bytes = LevelBytes(cooked.format, width, height);
+        if (offset + bytes > file.size)
+        {
+            UnmapFile(file);
+            return false;
+        }
+
+        cooked.levels[i] = file.data + offset;
+        cooked.levelBytes[i] = bytes;
+        cooked.levelCount++;
+        offset += bytes;
+        width = MipSize(width);
+        height = MipSize(height);
+    }
+    cooked.mapping = file;
+
+    return cooked.levelCount > 0;
+}
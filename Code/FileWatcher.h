@@ -0,0 +1,206 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "platform.h"
+#include "AtomicQueue.h"
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// Background watch of the files assets are loaded from.
+// On Linux, inotify reports writes and renames in the directories of the watched files, so editors that save
+// through a temporary file are seen too. Elsewhere, or when inotify can't be used, the thread compares the
+// timestamps of the watched files every pollInterval.
+// The events of a path are coalesced until it has been quiet for settleTime, then the path is pushed once.
+// The GL thread takes the changes once per frame, which is a single atomic load while nothing changed.
+class FileWatcher
+{
+public:
+
+	~FileWatcher()
+	{
+		Stop();
+	}
+
+	void Start(f64 pollIntervalSeconds = 0.5, f64 settleTimeSeconds = 0.05)
+	{
+		if (thread.joinable()) return;
+
+		pollInterval = pollIntervalSeconds;
+		settleTime = settleTimeSeconds;
+#ifdef __linux__
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+		running = true;
+		thread = std::thread(&FileWatcher::Run, this);
+	}
+
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		condition.notify_all();
+		if (thread.joinable()) thread.join();
+
+#ifdef __linux__
+		if (inotifyFd >= 0) close(inotifyFd);
+		inotifyFd = -1;
+#endif
+		files.clear();
+		directories.clear();
+	}
+
+	// Paths are relative to the working directory, as the loaders open them. Watching a path again does nothing.
+	void Watch(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (files.count(path)) return;
+		files[path] = GetFileLastWriteTimestamp(path.c_str());
+
+#ifdef __linux__
+		if (inotifyFd < 0) return;
+		const size_t slash = path.find_last_of('/');
+		const std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash);
+		for (std::unordered_map<int, std::string>::iterator it = directories.begin(); it != directories.end(); ++it)
+			if (it->second == directory) return;
+
+		const int wd = inotify_add_watch(inotifyFd, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (wd >= 0) directories[wd] = directory;
+		else ELOG("Could not watch the directory of %s", path.c_str());
+#endif
+	}
+
+	// Paths changed since the last call, each one once per burst of writes
+	void PopChanges(std::vector<std::string>& out)
+	{
+		if (!changes.Empty()) changes.PopAll(out);
+	}
+
+	bool Inotify() const
+	{
+#ifdef __linux__
+		return inotifyFd >= 0;
+#else
+		return false;
+#endif
+	}
+
+	u32 WatchedCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return files.size();
+	}
+
+	u32 EventCount() const  { return events.load(std::memory_order_relaxed); }
+	u32 ChangeCount() const { return pushed.load(std::memory_order_relaxed); }
+
+private:
+
+	void Run()
+	{
+		std::unordered_map<std::string, f64> pending; // Path and time of its last event
+		while (true)
+		{
+			if (Inotify()) ReadEvents(pending);
+			else PollTimestamps(pending);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!running) break;
+			}
+
+			const f64 now = GetPerformanceTime();
+			for (std::unordered_map<std::string, f64>::iterator it = pending.begin(); it != pending.end();)
+			{
+				if (now - it->second < settleTime) { ++it; continue; }
+				changes.Push(it->first);
+				pushed.fetch_add(1, std::memory_order_relaxed);
+				it = pending.erase(it);
+			}
+		}
+	}
+
+	// Waits for events (less while some are settling), then queues the watched paths they name
+	void ReadEvents(std::unordered_map<std::string, f64>& pending)
+	{
+#ifdef __linux__
+		pollfd descriptor = { inotifyFd, POLLIN, 0 };
+		const int timeout = (int)((pending.empty() ? 0.1 : settleTime) * 1000.0);
+		if (poll(&descriptor, 1, timeout) <= 0) return;
+
+		alignas(inotify_event) char buffer[4096];
+		ssize_t size;
+		while ((size = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			const f64 now = GetPerformanceTime();
+			std::lock_guard<std::mutex> lock(mutex);
+			for (char* cursor = buffer; cursor < buffer + size;)
+			{
+				const inotify_event* event = (const inotify_event*)cursor;
+				cursor += sizeof(inotify_event) + event->len;
+				events.fetch_add(1, std::memory_order_relaxed);
+
+				// The kernel dropped events, any file could have changed
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					for (std::unordered_map<std::string, u64>::iterator it = files.begin(); it != files.end(); ++it)
+						pending[it->first] = now;
+					continue;
+				}
+
+				std::unordered_map<int, std::string>::const_iterator directory = directories.find(event->wd);
+				if (!event->len || directory == directories.end()) continue;
+
+				const std::string path = directory->second.empty() ? std::string(event->name) : directory->second + '/' + event->name;
+				if (files.count(path)) pending[path] = now;
+			}
+		}
+#endif
+	}
+
+	// Waits for the next interval (Stop() wakes it), then compares the timestamps of every watched file
+	void PollTimestamps(std::unordered_map<std::string, f64>& pending)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		const f64 wait = pending.empty() ? pollInterval : std::min(pollInterval, settleTime);
+		condition.wait_for(lock, std::chrono::microseconds((u64)(wait * 1e6)));
+		if (!running) return;
+
+		const f64 now = GetPerformanceTime();
+		for (std::unordered_map<std::string, u64>::iterator it = files.begin(); it != files.end(); ++it)
+		{
+			const u64 timestamp = GetFileLastWriteTimestamp(it->first.c_str());
+			if (timestamp == it->second) continue;
+			it->second = timestamp;
+			events.fetch_add(1, std::memory_order_relaxed);
+			pending[it->first] = now;
+		}
+	}
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool running = false;
+
+	std::unordered_map<std::string, u64> files;       // Watched paths and their last timestamp (polling only)
+	std::unordered_map<int, std::string> directories; // inotify watch descriptors and their directory
+	int inotifyFd = -1;
+	f64 pollInterval = 0.5;
+	f64 settleTime = 0.05;
+
+	AtomicQueue<std::string> changes;
+	std::atomic<u32> events = { 0 };
+	std::atomic<u32> pushed = { 0 };
+
+};
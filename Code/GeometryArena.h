@@ -0,0 +1,362 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <iterator>
+#include <algorithm>
+#include <glad/glad.h>
+#include "platform.h"
+
+#define GEOMETRY_ALIGNMENT 16
+#define INVALID_GEOMETRY_ALLOCATION UINT32_MAX
+
+// Range moved by a compaction step, the owner must rebind its buffer/offset (and VAOs)
+struct GeometryMove
+{
+	void* owner;
+	u32 allocation;
+	GLuint handle;
+	u32 offset;
+};
+
+struct GeometryPoolStats
+{
+	u32 pages = 0;
+	u32 capacity = 0;
+	u32 used = 0;
+	u32 allocations = 0;
+	u32 freeRanges = 0;
+	u32 largestFreeRange = 0;
+	u32 holes = 0; // Free bytes between live allocations, the free range at the end of each page isn't one
+
+	float Occupancy() const { return capacity ? (float)used / capacity : 0.f; }
+
+	// Share of the free space that compaction can give back, 0 once every page is compacted
+	float Fragmentation() const
+	{
+		const u32 free = capacity - used;
+		return free ? (float)holes / free : 0.f;
+	}
+};
+
+// Large GL buffers of one target (vertex or index) suballocated with a best-fit free list.
+// Allocations are identified by a slot index, so they can be moved by Compact().
+class GeometryPool
+{
+public:
+
+	struct Page
+	{
+		GLuint handle = 0;
+		u32 size = 0;
+		std::map<u32, u32> freeRanges; // offset -> size, coalesced
+	};
+
+	struct Allocation
+	{
+		u32 page = 0;
+		u32 offset = 0;
+		u32 size = 0;
+		void* owner = nullptr;
+		bool live = false;
+	};
+
+	void Init(GLenum target, u32 pageSize)
+	{
+		this->target = target;
+		this->pageSize = pageSize;
+	}
+
+	void Release()
+	{
+		for (std::vector<Page>::iterator it = pages.begin(); it != pages.end(); ++it)
+			glDeleteBuffers(1, &it->handle);
+		pages.clear();
+		allocations.clear();
+		freeSlots.clear();
+
+		if (scratchHandle) glDeleteBuffers(1, &scratchHandle);
+		scratchHandle = 0;
+		scratchSize = 0;
+	}
+
+	u32 Allocate(u32 size, void* owner)
+	{
+		size = AlignSize(size);
+
+		// Best fit among every page
+		u32 bestPage = UINT32_MAX;
+		u32 bestOffset = 0;
+		u32 bestSize = UINT32_MAX;
+		for (u32 p = 0; p < pages.size(); ++p)
+		{
+			for (std::map<u32, u32>::iterator it = pages[p].freeRanges.begin(); it != pages[p].freeRanges.end(); ++it)
+			{
+				if (it->second >= size && it->second < bestSize)
+				{
+					bestPage = p;
+					bestOffset = it->first;
+					bestSize = it->second;
+				}
+			}
+		}
+
+		// Bigger than a page: it gets a dedicated one
+		if (bestPage == UINT32_MAX)
+		{
+			bestPage = CreatePage(std::max(size, pageSize));
+			bestOffset = 0;
+			bestSize = pages[bestPage].size;
+		}
+
+		Page& page = pages[bestPage];
+		page.freeRanges.erase(bestOffset);
+		if (bestSize > size) page.freeRanges[bestOffset + size] = bestSize - size;
+
+		u32 slot = 0;
+		if (!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			slot = allocations.size();
+			allocations.emplace_back();
+		}
+
+		Allocation& allocation = allocations[slot];
+		allocation.page = bestPage;
+		allocation.offset = bestOffset;
+		allocation.size = size;
+		allocation.owner = owner;
+		allocation.live = true;
+
+		return slot;
+	}
+
+	void Free(u32 slot)
+	{
+		if (slot >= allocations.size() || !allocations[slot].live) return;
+
+		Allocation& allocation = allocations[slot];
+		const u32 pageIndex = allocation.page;
+		InsertFreeRange(pages[pageIndex], allocation.offset, allocation.size);
+
+		allocation = {};
+		freeSlots.push_back(slot);
+
+		// Empty pages give their buffer back, except the last regular one (it would be created again right away)
+		Page& page = pages[pageIndex];
+		if (page.freeRanges.size() == 1 && page.freeRanges.begin()->second == page.size)
+		{
+			u32 regularPages = 0;
+			for (std::vector<Page>::const_iterator it = pages.begin(); it != pages.end(); ++it)
+				if (it->handle && it->size <= pageSize) regularPages++;
+			if (page.size > pageSize || regularPages > 1) ReleasePage(page);
+		}
+	}
+
+	GLuint Handle(u32 slot) const { return pages[allocations[slot].page].handle; }
+	u32 Offset(u32 slot) const { return allocations[slot].offset; }
+
+	// Slides live allocations towards the start of their page, moving at most byteBudget bytes.
+	// Returns true when there is nothing left to compact.
+	bool Compact(u32 byteBudget, std::vector<GeometryMove>& moves)
+	{
+		u32 moved = 0;
+		bool done = true;
+
+		for (u32 p = 0; p < pages.size(); ++p)
+		{
+			Page& page = pages[p];
+			if (page.freeRanges.size() <= 1 && (page.freeRanges.empty() || page.freeRanges.rbegin()->first + page.freeRanges.rbegin()->second == page.size))
+				continue;
+
+			std::vector<u32> slots;
+			for (u32 i = 0; i < allocations.size(); ++i)
+				if (allocations[i].live && allocations[i].page == p) slots.push_back(i);
+			std::sort(slots.begin(), slots.end(), [this](u32 a, u32 b) { return allocations[a].offset < allocations[b].offset; });
+
+			u32 cursor = 0;
+			for (std::vector<u32>::iterator it = slots.begin(); it != slots.end(); ++it)
+			{
+				Allocation& allocation = allocations[*it];
+				if (allocation.offset > cursor)
+				{
+					if (moved > 0 && moved + allocation.size > byteBudget)
+					{
+						done = false;
+						break;
+					}
+
+					Move(page, allocation.offset, cursor, allocation.size);
+					allocation.offset = cursor;
+					moved += allocation.size;
+
+					GeometryMove move = { allocation.owner, *it, page.handle, cursor };
+					moves.push_back(move);
+				}
+				cursor = allocation.offset + allocation.size;
+			}
+
+			// Rebuild the free list from the gaps left between live allocations
+			page.freeRanges.clear();
+			cursor = 0;
+			for (std::vector<u32>::iterator it = slots.begin(); it != slots.end(); ++it)
+			{
+				const Allocation& allocation = allocations[*it];
+				if (allocation.offset > cursor) page.freeRanges[cursor] = allocation.offset - cursor;
+				cursor = allocation.offset + allocation.size;
+			}
+			if (cursor < page.size) page.freeRanges[cursor] = page.size - cursor;
+
+			if (!done) break;
+		}
+
+		return done;
+	}
+
+	GeometryPoolStats Stats() const
+	{
+		GeometryPoolStats stats;
+		for (std::vector<Page>::const_iterator it = pages.begin(); it != pages.end(); ++it)
+		{
+			if (!it->handle) continue;
+			stats.pages++;
+			stats.capacity += it->size;
+			stats.freeRanges += it->freeRanges.size();
+			for (std::map<u32, u32>::const_iterator ft = it->freeRanges.begin(); ft != it->freeRanges.end(); ++ft)
+			{
+				stats.used += ft->second;
+				stats.largestFreeRange = std::max(stats.largestFreeRange, ft->second);
+				if (ft->first + ft->second != it->size) stats.holes += ft->second;
+			}
+		}
+		stats.used = stats.capacity - stats.used;
+		stats.allocations = allocations.size() - freeSlots.size();
+		return stats;
+	}
+
+private:
+
+	static u32 AlignSize(u32 size)
+	{
+		size = size ? size : 1;
+		return (size + GEOMETRY_ALIGNMENT - 1) & ~(GEOMETRY_ALIGNMENT - 1);
+	}
+
+	// Released pages keep their entry (allocations refer to pages by index), the next page created takes it
+	u32 CreatePage(u32 size)
+	{
+		Page page;
+		page.size = size;
+		page.freeRanges[0] = size;
+
+		glGenBuffers(1, &page.handle);
+		glBindBuffer(target, page.handle);
+		glBufferData(target, size, NULL, GL_STATIC_DRAW);
+		glBindBuffer(target, 0);
+
+		for (u32 p = 0; p < pages.size(); ++p)
+		{
+			if (pages[p].handle) continue;
+			pages[p] = page;
+			return p;
+		}
+
+		pages.push_back(page);
+		return pages.size() - 1;
+	}
+
+	void ReleasePage(Page& page)
+	{
+		glDeleteBuffers(1, &page.handle);
+		page = Page();
+	}
+
+	void InsertFreeRange(Page& page, u32 offset, u32 size)
+	{
+		std::map<u32, u32>::iterator next = page.freeRanges.lower_bound(offset);
+
+		// Merge with the following range
+		if (next != page.freeRanges.end() && offset + size == next->first)
+		{
+			size += next->second;
+			next = page.freeRanges.erase(next);
+		}
+
+		// Merge with the preceding range
+		if (next != page.freeRanges.begin())
+		{
+			std::map<u32, u32>::iterator prev = std::prev(next);
+			if (prev->first + prev->second == offset)
+			{
+				prev->second += size;
+				return;
+			}
+		}
+
+		page.freeRanges[offset] = size;
+	}
+
+	// Source and destination may overlap inside the same buffer, so the copy goes through a scratch buffer
+	void Move(const Page& page, u32 from, u32 to, u32 size)
+	{
+		if (size > scratchSize)
+		{
+			if (scratchHandle) glDeleteBuffers(1, &scratchHandle);
+			glGenBuffers(1, &scratchHandle);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, scratchHandle);
+			glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_COPY);
+			scratchSize = size;
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, page.handle);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, scratchHandle);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, 0, size);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, scratchHandle);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, page.handle);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, to, size);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+private:
+
+	GLenum target = GL_ARRAY_BUFFER;
+	u32 pageSize = 0;
+
+	std::vector<Page> pages;
+	std::vector<Allocation> allocations;
+	std::vector<u32> freeSlots;
+
+	GLuint scratchHandle = 0;
+	u32 scratchSize = 0;
+
+};
+
+// Shared vertex and index storage of every model asset
+class GeometryArena
+{
+public:
+
+	void Init(u32 vertexPageSize, u32 indexPageSize)
+	{
+		vertices.Init(GL_ARRAY_BUFFER, vertexPageSize);
+		indices.Init(GL_ELEMENT_ARRAY_BUFFER, indexPageSize);
+	}
+
+	void Release()
+	{
+		vertices.Release();
+		indices.Release();
+	}
+
+public:
+
+	GeometryPool vertices;
+	GeometryPool indices;
+
+};
@@ -0,0 +1,463 @@
+#pragma once
+#include <string.h>
+#include <string>
+#include <vector>
+#include <stb_image.h>
+#include <assimp/material.h>
+#include "platform.h"
+#include "ModelImport.h"
+#include "Json.h"
+#include "Meshlet.h"
+
+// Zero-copy binary glTF (GLB) importer. The file is mapped and the vertex/index streams of the import
+// point straight into its BIN chunk: every accessor becomes a VertexBufferAttribute with its own offset
+// and stride, so the buffer views are uploaded as they are, without rewriting a single vertex.
+// Only what the GL path can draw as is gets through here; anything else (node transforms, 8 bit indices,
+// quantized positions, compression extensions, external buffers...) returns false and the caller
+// falls back to Assimp. The source layout is kept, so there is no vertex optimization, quantization or LOD.
+
+#define GLB_MAGIC      0x46546C67 // "glTF"
+#define GLB_CHUNK_JSON 0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN  0x004E4942 // "BIN\0"
+
+#define GLTF_BYTE           5120
+#define GLTF_UNSIGNED_BYTE  5121
+#define GLTF_SHORT          5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT   5125
+#define GLTF_FLOAT          5126
+
+#define GLTF_TRIANGLES 4
+
+// Byte range of an accessor inside the BIN chunk
+struct GltfAccessor
+{
+    u32 begin = 0;
+    u32 end = 0;
+    u32 stride = 0;
+    u32 count = 0;
+    u32 components = 0;
+    u32 componentType = 0;
+    bool normalized = false;
+};
+
+// Primitive resolved in the first pass, before the streams are known
+struct GltfPrimitive
+{
+    GltfAccessor attributes[4]; // Indexed by shader location
+    bool hasAttribute[4] = {};
+    GltfAccessor indices;
+    i32 material = -1;
+};
+
+inline u32 GltfComponentSize(u32 componentType)
+{
+    switch (componentType)
+    {
+        case GLTF_BYTE: case GLTF_UNSIGNED_BYTE: return 1;
+        case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return 2;
+        case GLTF_UNSIGNED_INT: case GLTF_FLOAT: return 4;
+        default: return 0;
+    }
+}
+
+inline u32 GltfComponentCount(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0;
+}
+
+// Sizes and offsets are read as numbers, so that no value out of range of an int gets through a cast
+inline bool ReadGltfSize(const JsonValue& value, const char* key, double fallback, u32 limit, u64& size)
+{
+    const double number = value.Number(key, fallback);
+    if (!(number >= 0.0 && number <= limit)) return false;
+    size = (u64)number;
+    return true;
+}
+
+bool ResolveGltfAccessor(const JsonValue& doc, i32 index, u32 binSize, GltfAccessor& accessor)
+{
+    const JsonValue* accessors = doc.Find("accessors");
+    const JsonValue* views = doc.Find("bufferViews");
+    if (!accessors || !views || index < 0 || (u32)index >= accessors->Size()) return false;
+
+    // Sparse accessors would have to be expanded on the cpu
+    const JsonValue& a = (*accessors)[index];
+    const i32 viewIndex = a.Int("bufferView", -1);
+    if (a.Find("sparse") || viewIndex < 0 || (u32)viewIndex >= views->Size()) return false;
+
+    const JsonValue& view = (*views)[viewIndex];
+    if (view.Int("buffer", 0) != 0) return false;
+
+    accessor.componentType = a.Int("componentType", 0);
+    accessor.components = GltfComponentCount(a.String("type"));
+    accessor.normalized = a.Find("normalized") && a.Find("normalized")->boolean;
+
+    const u32 elementSize = GltfComponentSize(accessor.componentType) * accessor.components;
+    u64 count = 0, stride = 0, viewOffset = 0, viewLength = 0, offset = 0;
+    if (elementSize == 0 || !ReadGltfSize(a, "count", 0, binSize, count) || !ReadGltfSize(view, "byteStride", elementSize, binSize, stride) ||
+        !ReadGltfSize(view, "byteOffset", 0, binSize, viewOffset) || !ReadGltfSize(view, "byteLength", 0, binSize, viewLength) ||
+        !ReadGltfSize(a, "byteOffset", 0, binSize, offset))
+        return false;
+    if (count == 0 || stride < elementSize) return false;
+
+    // In 64 bits, so that no range wraps around before it is checked against the BIN chunk
+    const u64 viewEnd = viewOffset + viewLength;
+    const u64 begin = viewOffset + offset;
+    const u64 end = begin + (count - 1) * stride + elementSize;
+    if (viewEnd > binSize || end > viewEnd) return false;
+
+    accessor.count = (u32)count;
+    accessor.stride = (u32)stride;
+    accessor.begin = (u32)begin;
+    accessor.end = (u32)end;
+
+    // Attribute pointers need aligned components, and the stride has to fit in the attribute
+    return accessor.begin % GltfComponentSize(accessor.componentType) == 0 && accessor.stride <= 255;
+}
+
+// Node transforms would have to be baked into the vertices (Assimp does it with PreTransformVertices)
+bool IsGltfNodeIdentity(const JsonValue& node)
+{
+    // Arrays of any other length are malformed, they are not taken for an identity either
+    const JsonValue* matrix = node.Find("matrix");
+    if (matrix)
+    {
+        if (matrix->Size() != 16) return false;
+        for (u32 i = 0; i < 16; ++i)
+            if ((*matrix)[i].number != (i % 5 == 0 ? 1.0 : 0.0)) return false;
+    }
+
+    const char* keys[3] = { "translation", "rotation", "scale" };
+    const u32 lengths[3] = { 3, 4, 3 };
+    const double identity[3][4] = { { 0, 0, 0, 0 }, { 0, 0, 0, 1 }, { 1, 1, 1, 1 } };
+    for (u32 k = 0; k < 3; ++k)
+    {
+        const JsonValue* value = node.Find(keys[k]);
+        if (!value) continue;
+        if (value->Size() != lengths[k]) return false;
+        for (u32 i = 0; i < lengths[k]; ++i)
+            if ((*value)[i].number != identity[k][i]) return false;
+    }
+    return true;
+}
+
+// Meshes reached from the node, in traversal order (instanced meshes appear once per node)
+bool CollectGltfNode(const JsonValue& doc, i32 index, std::vector<i32>& meshes, u32 depth)
+{
+    const JsonValue* nodes = doc.Find("nodes");
+    if (!nodes || index < 0 || (u32)index >= nodes->Size() || depth > 64) return false;
+
+    const JsonValue& node = (*nodes)[index];
+    const JsonValue* children = node.Find("children");
+    const i32 mesh = node.Int("mesh", -1);
+    if ((mesh >= 0 || children) && !IsGltfNodeIdentity(node)) return false;
+
+    if (mesh >= 0) meshes.push_back(mesh);
+    if (children)
+    {
+        for (u32 i = 0; i < children->Size(); ++i)
+            if (!CollectGltfNode(doc, (i32)(*children)[i].number, meshes, depth + 1)) return false;
+    }
+    return true;
+}
+
+// Decodes the image behind a texture index. glTF has its uv origin at the top left, so unlike
+// every other path the pixels are not flipped; the image key is virtual (file.glb#imageN).
+bool DecodeGltfTexture(const JsonValue& doc, const JsonValue* textureInfo, const u8* bin, u32 binSize, const std::string& filename, const std::string& directory, std::string& path, Image& img)
+{
+    const JsonValue* textures = doc.Find("textures");
+    const JsonValue* images = doc.Find("images");
+    if (!textureInfo || !textures || !images) return false;
+
+    const i32 texture = textureInfo->Int("index", -1);
+    if (texture < 0 || (u32)texture >= textures->Size()) return false;
+
+    const i32 source = (*textures)[texture].Int("source", -1);
+    if (source < 0 || (u32)source >= images->Size()) return false;
+
+    const JsonValue& image = (*images)[source];
+    const JsonValue* views = doc.Find("bufferViews");
+    const i32 viewIndex = image.Int("bufferView", -1);
+    const std::string uri = image.String("uri");
+
+    img = {};
+    stbi_set_flip_vertically_on_load_thread(false);
+    if (viewIndex >= 0 && views && (u32)viewIndex < views->Size())
+    {
+        const JsonValue& view = (*views)[viewIndex];
+        const u32 offset = view.Int("byteOffset", 0);
+        const u32 length = view.Int("byteLength", 0);
+        if (offset + (u64)length <= binSize) img.pixels = stbi_load_from_memory(bin + offset, length, &img.size.x, &img.size.y, &img.nchannels, 0);
+    }
+    else if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+    {
+        DecodeImageFile((directory + "/" + uri).c_str(), img);
+    }
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    if (!img.pixels)
+    {
+        ELOG("Could not decode image %d of %s", source, filename.c_str());
+        return false;
+    }
+
+    img.stride = img.size.x * img.nchannels;
+    path = filename + "#image" + std::to_string(source);
+    return true;
+}
+
+void ProcessGltfMaterial(const JsonValue& doc, const JsonValue& material, const u8* bin, u32 binSize, const std::string& filename, const std::string& directory, ImportedMaterial& myMaterial)
+{
+    myMaterial.name = material.String("name");
+    myMaterial.emissive = vec3(0.f);
+
+    const JsonValue* pbr = material.Find("pbrMetallicRoughness");
+    const JsonValue* baseColor = pbr ? pbr->Find("baseColorFactor") : nullptr;
+    if (baseColor && baseColor->Size() >= 3) myMaterial.diffuse = vec3((*baseColor)[0].number, (*baseColor)[1].number, (*baseColor)[2].number);
+
+    const JsonValue* emissive = material.Find("emissiveFactor");
+    if (emissive && emissive->Size() >= 3) myMaterial.emissive = vec3((*emissive)[0].number, (*emissive)[1].number, (*emissive)[2].number);
+
+    // Same property flags as ProcessAssimpMaterial()
+    if (pbr && DecodeGltfTexture(doc, pbr->Find("baseColorTexture"), bin, binSize, filename, directory, myMaterial.textures[CTS_DIFFUSE], myMaterial.images[CTS_DIFFUSE]))
+        myMaterial.properties.Set(aiTextureType_DIFFUSE, true);
+    if (DecodeGltfTexture(doc, material.Find("emissiveTexture"), bin, binSize, filename, directory, myMaterial.textures[CTS_EMISSIVE], myMaterial.images[CTS_EMISSIVE]))
+        myMaterial.properties.Set(aiTextureType_EMISSIVE, true);
+    if (DecodeGltfTexture(doc, material.Find("normalTexture"), bin, binSize, filename, directory, myMaterial.textures[CTS_NORMALS], myMaterial.images[CTS_NORMALS]))
+        myMaterial.properties.Set(aiTextureType_NORMALS, true);
+}
+
+// Resolves a triangle primitive the GL path can draw from the file as is
+bool ResolveGltfPrimitive(const JsonValue& doc, const JsonValue& primitive, const u8* bin, u32 binSize, GltfPrimitive& result)
+{
+    if (primitive.Int("mode", GLTF_TRIANGLES) != GLTF_TRIANGLES || primitive.Find("targets")) return false;
+
+    const JsonValue* attributes = primitive.Find("attributes");
+    if (!attributes) return false;
+
+    // Locations match the Assimp float layout: position, normal, uv, tangent
+    const char* names[4] = { "POSITION", "NORMAL", "TEXCOORD_0", "TANGENT" };
+    for (u32 i = 0; i < 4; ++i)
+    {
+        const i32 index = attributes->Int(names[i], -1);
+        if (index < 0) continue;
+        if (!ResolveGltfAccessor(doc, index, binSize, result.attributes[i])) return false;
+        if (i > 0 && result.hasAttribute[0] && result.attributes[i].count != result.attributes[0].count) return false;
+        result.hasAttribute[i] = true;
+    }
+
+    // Positions and normals have to be floats (KHR_mesh_quantization would need the decode uniforms)
+    if (!result.hasAttribute[0] || !result.hasAttribute[1]) return false;
+    if (result.attributes[0].componentType != GLTF_FLOAT || result.attributes[1].componentType != GLTF_FLOAT) return false;
+    if (result.hasAttribute[2] && result.attributes[2].componentType != GLTF_FLOAT && !result.attributes[2].normalized) return false;
+
+    if (!ResolveGltfAccessor(doc, primitive.Int("indices", -1), binSize, result.indices)) return false;
+    if (result.indices.componentType != GLTF_UNSIGNED_SHORT && result.indices.componentType != GLTF_UNSIGNED_INT) return false;
+    if (result.indices.count % 3 != 0) return false;
+
+    // Meshlets and bounds index the positions, out of range indices must not get that far
+    const u8* indices = bin + result.indices.begin;
+    const bool shortIndices = result.indices.componentType == GLTF_UNSIGNED_SHORT;
+    for (u32 i = 0; i < result.indices.count; ++i)
+    {
+        const u32 index = shortIndices ? ((const u16*)indices)[i] : ((const u32*)indices)[i];
+        if (index >= result.attributes[0].count) return false;
+    }
+
+    result.material = primitive.Int("material", -1);
+    return true;
+}
+
+bool ImportGlbModel(const char* filename, ModelImport& import)
+{
+    MappedFile file = MapFile(filename);
+    if (!file.data) return false;
+
+    // 12 byte header, then the JSON chunk and the BIN chunk
+    const u32* header = (const u32*)file.data;
+    if (file.size < 20 || header[0] != GLB_MAGIC || header[1] != 2 || header[2] > file.size || header[4] != GLB_CHUNK_JSON || 20 + (u64)header[3] > file.size)
+    {
+        UnmapFile(file);
+        return false;
+    }
+
+    const char* json = (const char*)file.data + 20;
+    const u32 jsonSize = header[3];
+    const u8* bin = nullptr;
+    u32 binSize = 0;
+    const u64 binHeader = 20 + ((jsonSize + 3) & ~3u);
+    if (binHeader + 8 <= file.size && *(const u32*)(file.data + binHeader + 4) == GLB_CHUNK_BIN)
+    {
+        bin = file.data + binHeader + 8;
+        binSize = *(const u32*)(file.data + binHeader);
+        if (binHeader + 8 + binSize > file.size) binSize = 0;
+    }
+
+    JsonValue doc;
+    const JsonValue* buffers = nullptr;
+    bool supported = bin && ParseJson(json, jsonSize, doc) && !doc.Find("extensionsRequired");
+    if (supported)
+    {
+        buffers = doc.Find("buffers");
+        supported = buffers && buffers->Size() == 1 && !(*buffers)[0].Find("uri");
+    }
+
+    // Meshes of the default scene (or all of them if there is none)
+    std::vector<i32> meshIndices;
+    const JsonValue* scenes = supported ? doc.Find("scenes") : nullptr;
+    const JsonValue* meshes = supported ? doc.Find("meshes") : nullptr;
+    if (supported && scenes && scenes->Size() > 0)
+    {
+        const double scene = doc.Number("scene", 0);
+        supported = scene >= 0.0 && scene < scenes->Size();
+        const JsonValue* roots = supported ? (*scenes)[(size_t)scene].Find("nodes") : nullptr;
+        for (u32 i = 0; supported && roots && i < roots->Size(); ++i)
+            supported = CollectGltfNode(doc, (i32)(*roots)[i].number, meshIndices, 0);
+    }
+    else if (supported && meshes)
+    {
+        for (u32 i = 0; i < meshes->Size(); ++i) meshIndices.push_back(i);
+    }
+
+    std::vector<GltfPrimitive> primitives;
+    for (u32 m = 0; supported && m < meshIndices.size(); ++m)
+    {
+        const JsonValue* list = meshes && (u32)meshIndices[m] < meshes->Size() ? (*meshes)[meshIndices[m]].Find("primitives") : nullptr;
+        for (u32 p = 0; supported && list && p < list->Size(); ++p)
+        {
+            primitives.emplace_back();
+            supported = ResolveGltfPrimitive(doc, (*list)[p], bin, binSize, primitives.back());
+        }
+    }
+
+    if (!supported || primitives.empty())
+    {
+        ILOG("%s can't be loaded in place, using Assimp", filename);
+        UnmapFile(file);
+        return false;
+    }
+
+    // The streams are the smallest 4 byte aligned spans covering the vertex and index accessors
+    u32 vertexBegin = UINT32_MAX, vertexEnd = 0, indexBegin = UINT32_MAX, indexEnd = 0;
+    for (std::vector<GltfPrimitive>::const_iterator it = primitives.begin(); it != primitives.end(); ++it)
+    {
+        for (u32 i = 0; i < 4; ++i)
+        {
+            if (!it->hasAttribute[i]) continue;
+            vertexBegin = glm::min(vertexBegin, it->attributes[i].begin);
+            vertexEnd = glm::max(vertexEnd, it->attributes[i].end);
+        }
+        indexBegin = glm::min(indexBegin, it->indices.begin);
+        indexEnd = glm::max(indexEnd, it->indices.end);
+    }
+    vertexBegin &= ~3u;
+    indexBegin &= ~3u;
+
+    import.path = filename;
+    import.vertexFormat = VF_FLOAT;
+    import.zeroCopy = true;
+    import.mapping = file;
+    import.vertexData = bin + vertexBegin;
+    import.vertexBytes = vertexEnd - vertexBegin;
+    import.indexData = bin + indexBegin;
+    import.indexBytes = indexEnd - indexBegin;
+
+    std::string directory = filename;
+    size_t slash = directory.find_last_of("/\\");
+    directory = slash == std::string::npos ? "." : directory.substr(0, slash);
+
+    // Primitives without material use the glTF default one, appended last
+    const JsonValue* materials = doc.Find("materials");
+    import.materials.resize(materials ? materials->Size() : 0);
+    for (u32 i = 0; i < import.materials.size(); ++i)
+        ProcessGltfMaterial(doc, (*materials)[i], bin, binSize, import.path, directory, import.materials[i]);
+
+    u32 defaultMaterial = UINT32_MAX;
+    std::vector<vec3> gathered;
+    for (std::vector<GltfPrimitive>::const_iterator it = primitives.begin(); it != primitives.end(); ++it)
+    {
+        u32 material = it->material;
+        if (it->material < 0 || (u32)it->material >= import.materials.size())
+        {
+            if (defaultMaterial == UINT32_MAX)
+            {
+                defaultMaterial = import.materials.size();
+                import.materials.emplace_back();
+                import.materials.back().name = "Default";
+                import.materials.back().emissive = vec3(0.f);
+            }
+            material = defaultMaterial;
+        }
+
+        const GltfAccessor& position = it->attributes[0];
+        u32 meshBegin = UINT32_MAX, meshEnd = 0;
+        for (u32 i = 0; i < 4; ++i)
+        {
+            if (!it->hasAttribute[i]) continue;
+            meshBegin = glm::min(meshBegin, it->attributes[i].begin);
+            meshEnd = glm::max(meshEnd, it->attributes[i].end);
+        }
+
+        // Every attribute points to its own array (or interleaved buffer view) with its own stride
+        VertexBufferLayout vertexBufferLayout = {};
+        vertexBufferLayout.stride = position.stride;
+        for (u32 i = 0; i < 4; ++i)
+        {
+            if (!it->hasAttribute[i]) continue;
+            const GltfAccessor& accessor = it->attributes[i];
+            GLenum type = GL_FLOAT;
+            if (accessor.componentType == GLTF_UNSIGNED_BYTE) type = GL_UNSIGNED_BYTE;
+            else if (accessor.componentType == GLTF_UNSIGNED_SHORT) type = GL_UNSIGNED_SHORT;
+
+            VertexBufferAttribute* attribute = new VertexBufferAttribute(i, accessor.components, type, accessor.normalized);
+            attribute->offset = accessor.begin - meshBegin;
+            attribute->stride = accessor.stride;
+            vertexBufferLayout.attributes.push_back(attribute);
+        }
+
+        Mesh* m = new Mesh();
+        m->vertexBufferLayout = vertexBufferLayout;
+        m->vertexOffset = meshBegin - vertexBegin;
+        m->vertexBytes = meshEnd - meshBegin;
+        m->indexsOffset = it->indices.begin - indexBegin;
+        m->indexCount = it->indices.count;
+        m->indexType = it->indices.componentType == GLTF_UNSIGNED_SHORT ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+        // Meshlets and bounds read the positions in place unless they are interleaved
+        const vec3* positions = (const vec3*)(bin + position.begin);
+        if (position.stride != sizeof(vec3))
+        {
+            gathered.resize(position.count);
+            for (u32 v = 0; v < position.count; ++v)
+                memcpy(&gathered[v], bin + position.begin + v * position.stride, sizeof(vec3));
+            positions = gathered.data();
+        }
+
+        vec3 aabbMin = positions[0], aabbMax = positions[0];
+        for (u32 v = 1; v < position.count; ++v)
+        {
+            aabbMin = glm::min(aabbMin, positions[v]);
+            aabbMax = glm::max(aabbMax, positions[v]);
+        }
+        m->boundsCenter = (aabbMin + aabbMax) * 0.5f;
+        for (u32 v = 0; v < position.count; ++v)
+            m->boundsRadius = glm::max(m->boundsRadius, glm::length(positions[v] - m->boundsCenter));
+
+        BuildMeshlets(positions, position.count, bin + it->indices.begin, m->indexType, m->indexCount, m->meshlets);
+
+        // Quantized texture coordinates are left unknown, streaming falls back to the bounds for them
+        const GltfAccessor& texCoord = it->attributes[2];
+        if (it->hasAttribute[2] && texCoord.componentType == GLTF_FLOAT && texCoord.components == 2)
+            m->uvDensity = ComputeUvDensity(positions, bin + texCoord.begin, texCoord.stride, bin + it->indices.begin, m->indexType, m->indexCount);
+
+        import.meshes.emplace_back(m);
+        import.meshMaterials.emplace_back(material);
+    }
+
+    return true;
+}
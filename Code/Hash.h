@@ -0,0 +1,38 @@
+#pragma once
+#include <type_traits>
+#include "platform.h"
+
+#define HASH_SEED 0xcbf29ce484222325ull
+
+// 64 bit FNV-1a, used to fingerprint file contents and cache keys
+inline u64 HashBytes(const void* data, u64 size, u64 seed = HASH_SEED)
+{
+    const u8* bytes = (const u8*)data;
+    u64 hash = seed;
+    for (u64 i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline u64 HashString(const char* string, u64 seed = HASH_SEED)
+{
+    u64 hash = seed;
+    while (*string)
+    {
+        hash ^= (u8)*string++;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// 32 bit FNV-1a usable in constant expressions, shader resource names are looked up by it (see Program.h)
+constexpr u32 HashName(const char* name, u32 hash = 0x811c9dc5u)
+{
+    return *name ? HashName(name + 1, (hash ^ (u8)*name) * 0x01000193u) : hash;
+}
+
+// Hash of a string literal, always computed by the compiler
+#define NAME_HASH(name) std::integral_constant<u32, HashName(name)>::value
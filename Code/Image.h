@@ -1,5 +1,8 @@
 #pragma once
+#include <stb_image.h>
+#include "platform.h"
 #include "Typedef.h"
+#include "Hash.h"
 
 struct Image
 {
@@ -7,4 +10,27 @@ struct Image
     ivec2 size;
     i32   nchannels;
     i32   stride;
-};
\ No newline at end of file
+};
+
+// Decodes an image file read through MapFile(), so it can come from the mounted asset pack.
+// The vertical flip follows the stb_image setting of the calling thread.
+inline bool DecodeImageFile(const char* filename, Image& img)
+{
+    img = {};
+    MappedFile file = MapFile(filename);
+    if (!file.data) return false;
+
+    img.pixels = stbi_load_from_memory(file.data, (int)file.size, &img.size.x, &img.size.y, &img.nchannels, 0);
+    UnmapFile(file);
+    if (!img.pixels) return false;
+
+    img.stride = img.size.x * img.nchannels;
+    return true;
+}
+
+// Fingerprint of the decoded pixels and their layout, used to share identical textures
+inline u64 HashImage(const Image& img)
+{
+    const u64 layout = HashBytes(&img.size, sizeof(img.size)) + img.nchannels;
+    return HashBytes(img.pixels, (u64)img.stride * img.size.y, layout);
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <vector>
+
+// Fixed pool of worker threads consuming a FIFO of jobs.
+// Jobs must not touch OpenGL: results that need the GL thread are handed back through a queue.
+class JobSystem
+{
+public:
+
+	~JobSystem()
+	{
+		Stop();
+	}
+
+	void Start(unsigned int threadCount = 0)
+	{
+		if (!workers.empty()) return;
+
+		if (threadCount == 0)
+		{
+			// Leave one core to the GL thread
+			unsigned int cores = std::thread::hardware_concurrency();
+			threadCount = cores > 1 ? cores - 1 : 1;
+		}
+
+		running = true;
+		for (unsigned int i = 0; i < threadCount; ++i)
+			workers.emplace_back(&JobSystem::Work, this);
+	}
+
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		condition.notify_all();
+
+		for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+			it->join();
+		workers.clear();
+	}
+
+	void Push(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(job);
+		}
+		condition.notify_one();
+	}
+
+	unsigned int ThreadCount() const
+	{
+		return workers.size();
+	}
+
+	// Runs job(i) for every i in [0, count) on the calling thread and on the workers that are free.
+	// Indices are claimed one at a time, so a job picked up late finds none left and returns: the caller
+	// only waits for indices that are already running, which makes it safe to call from a job.
+	void ParallelFor(unsigned int count, const std::function<void(unsigned int)>& job)
+	{
+		struct Batch
+		{
+			std::function<void(unsigned int)> job;
+			unsigned int count = 0;
+			std::atomic<unsigned int> next = { 0 };
+			std::atomic<unsigned int> done = { 0 };
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+
+		if (count == 0) return;
+
+		std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+		batch->job = job;
+		batch->count = count;
+		std::function<void()> claim = [batch]()
+		{
+			for (unsigned int i = batch->next.fetch_add(1); i < batch->count; i = batch->next.fetch_add(1))
+			{
+				batch->job(i);
+				if (batch->done.fetch_add(1) + 1 == batch->count)
+				{
+					std::lock_guard<std::mutex> lock(batch->mutex);
+					batch->finished.notify_all();
+				}
+			}
+		};
+
+		const unsigned int helpers = std::min<unsigned int>(count - 1, workers.size());
+		for (unsigned int i = 0; i < helpers; ++i)
+			Push(claim);
+		claim();
+
+		std::unique_lock<std::mutex> lock(batch->mutex);
+		batch->finished.wait(lock, [&batch] { return batch->done.load() == batch->count; });
+	}
+
+private:
+
+	void Work()
+	{
+		while (true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return !running || !jobs.empty(); });
+				if (!running && jobs.empty()) return;
+
+				job = jobs.front();
+				jobs.pop_front();
+			}
+
+			job();
+		}
+	}
+
+private:
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool running = false;
+
+};
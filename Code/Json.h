@@ -0,0 +1,191 @@
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+// Minimal JSON reader (DOM), enough for asset manifests like glTF.
+// No validation beyond what is needed to walk the document, strings keep their escapes
+// except the simple ones (\" \\ \/ \n \t \r \b \f), \u sequences are kept as is.
+
+struct JsonValue
+{
+    enum Type { J_NULL, J_BOOL, J_NUMBER, J_STRING, J_ARRAY, J_OBJECT };
+
+    Type type = J_NULL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* Find(const char* key) const
+    {
+        for (std::vector<std::pair<std::string, JsonValue>>::const_iterator it = members.begin(); it != members.end(); ++it)
+            if (it->first == key) return &it->second;
+        return nullptr;
+    }
+
+    size_t Size() const { return type == J_ARRAY ? items.size() : 0; }
+    const JsonValue& operator[](size_t index) const { return items[index]; }
+
+    double Number(const char* key, double fallback) const
+    {
+        const JsonValue* value = Find(key);
+        return value && value->type == J_NUMBER ? value->number : fallback;
+    }
+
+    int Int(const char* key, int fallback) const
+    {
+        return (int)Number(key, fallback);
+    }
+
+    std::string String(const char* key, const char* fallback = "") const
+    {
+        const JsonValue* value = Find(key);
+        return value && value->type == J_STRING ? value->string : fallback;
+    }
+};
+
+struct JsonParser
+{
+    const char* p;
+    const char* end;
+
+    void SkipSpaces()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    }
+
+    bool Match(const char* literal)
+    {
+        const char* q = p;
+        for (; *literal; ++literal, ++q)
+            if (q >= end || *q != *literal) return false;
+        p = q;
+        return true;
+    }
+
+    bool ParseString(std::string& out)
+    {
+        if (p >= end || *p != '"') return false;
+        ++p;
+
+        out.clear();
+        while (p < end && *p != '"')
+        {
+            char c = *p++;
+            if (c == '\\' && p < end)
+            {
+                c = *p++;
+                switch (c)
+                {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'u': out += "\\u"; continue;
+                    default: break; // \" \\ \/
+                }
+            }
+            out += c;
+        }
+
+        if (p >= end) return false;
+        ++p;
+        return true;
+    }
+
+    bool ParseValue(JsonValue& value, unsigned int depth)
+    {
+        if (depth > 64) return false;
+
+        SkipSpaces();
+        if (p >= end) return false;
+
+        switch (*p)
+        {
+            case '{':
+            {
+                value.type = JsonValue::J_OBJECT;
+                ++p;
+                SkipSpaces();
+                if (p < end && *p == '}') { ++p; return true; }
+
+                while (true)
+                {
+                    SkipSpaces();
+                    std::pair<std::string, JsonValue> member;
+                    if (!ParseString(member.first)) return false;
+
+                    SkipSpaces();
+                    if (p >= end || *p != ':') return false;
+                    ++p;
+
+                    if (!ParseValue(member.second, depth + 1)) return false;
+                    value.members.push_back(std::move(member));
+
+                    SkipSpaces();
+                    if (p < end && *p == ',') { ++p; continue; }
+                    if (p < end && *p == '}') { ++p; return true; }
+                    return false;
+                }
+            }
+            case '[':
+            {
+                value.type = JsonValue::J_ARRAY;
+                ++p;
+                SkipSpaces();
+                if (p < end && *p == ']') { ++p; return true; }
+
+                while (true)
+                {
+                    value.items.emplace_back();
+                    if (!ParseValue(value.items.back(), depth + 1)) return false;
+
+                    SkipSpaces();
+                    if (p < end && *p == ',') { ++p; continue; }
+                    if (p < end && *p == ']') { ++p; return true; }
+                    return false;
+                }
+            }
+            case '"':
+                value.type = JsonValue::J_STRING;
+                return ParseString(value.string);
+            case 't':
+                value.type = JsonValue::J_BOOL;
+                value.boolean = true;
+                return Match("true");
+            case 'f':
+                value.type = JsonValue::J_BOOL;
+                value.boolean = false;
+                return Match("false");
+            case 'n':
+                value.type = JsonValue::J_NULL;
+                return Match("null");
+            default:
+            {
+                // strtod needs a terminated string, numbers are short
+                char buffer[64];
+                size_t length = 0;
+                while (p + length < end && length < sizeof(buffer) - 1 && strchr("+-0123456789.eE", p[length])) length++;
+                if (length == 0) return false;
+
+                memcpy(buffer, p, length);
+                buffer[length] = '\0';
+                value.type = JsonValue::J_NUMBER;
+                value.number = strtod(buffer, nullptr);
+                p += length;
+                return true;
+            }
+        }
+    }
+};
+
+inline bool ParseJson(const char* text, size_t size, JsonValue& root)
+{
+    JsonParser parser = { text, text + size };
+    return parser.ParseValue(root, 0);
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <string.h>
+#include <vector>
+#include "platform.h"
+
+// LZ4 block format (no frame), compatible with the reference decoder: sequences of a token,
+// literals, a 16 bit little endian offset and the match length extension. The compressor is a
+// greedy single probe hash matcher, fast enough to pack the assets offline; decompression is
+// the part that runs at load time and it is bounds checked on both sides.
+
+#define LZ4_MIN_MATCH   4
+#define LZ4_MAX_OFFSET  65535
+#define LZ4_HASH_BITS   16
+#define LZ4_LAST_LITERALS 5  // The last bytes of a block are always literals
+#define LZ4_MATCH_LIMIT   12 // The last match starts at least this far from the end
+
+inline u32 Lz4CompressBound(u32 size)
+{
+    return size + size / 255 + 16;
+}
+
+inline u32 Lz4Read32(const u8* p)
+{
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline bool Lz4WriteLength(u8*& op, const u8* end, u32 length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (op >= end) return false;
+        *op++ = 255;
+    }
+    if (op >= end) return false;
+    *op++ = (u8)length;
+    return true;
+}
+
+// One sequence: literals [literals, literals + literalCount) followed by a match (matchLength 0 for the last one)
+inline bool Lz4WriteSequence(u8*& op, const u8* end, const u8* literals, u32 literalCount, u32 offset, u32 matchLength)
+{
+    if (op >= end) return false;
+    u8* token = op++;
+    *token = (u8)((literalCount >= 15 ? 15 : literalCount) << 4);
+    if (literalCount >= 15 && !Lz4WriteLength(op, end, literalCount - 15)) return false;
+
+    if ((u64)(end - op) < literalCount) return false;
+    memcpy(op, literals, literalCount);
+    op += literalCount;
+
+    if (matchLength == 0) return true;
+
+    if (end - op < 2) return false;
+    *op++ = (u8)(offset & 0xff);
+    *op++ = (u8)(offset >> 8);
+
+    const u32 extra = matchLength - LZ4_MIN_MATCH;
+    *token |= (u8)(extra >= 15 ? 15 : extra);
+    return extra < 15 || Lz4WriteLength(op, end, extra - 15);
+}
+
+// Returns the compressed size, or 0 if it doesn't fit in capacity (use Lz4CompressBound())
+inline u32 Lz4Compress(const u8* src, u32 size, u8* dst, u32 capacity)
+{
+    u8* op = dst;
+    const u8* end = dst + capacity;
+    u32 anchor = 0;
+
+    if (size > LZ4_MATCH_LIMIT)
+    {
+        std::vector<u32> table(1u << LZ4_HASH_BITS, 0);
+        const u32 matchLimit = size - LZ4_MATCH_LIMIT;
+        const u32 copyLimit = size - LZ4_LAST_LITERALS;
+
+        u32 i = 0;
+        while (i < matchLimit)
+        {
+            const u32 sequence = Lz4Read32(src + i);
+            const u32 hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+            const u32 candidate = table[hash];
+            table[hash] = i;
+
+            if (candidate >= i || i - candidate > LZ4_MAX_OFFSET || Lz4Read32(src + candidate) != sequence)
+            {
+                i++;
+                continue;
+            }
+
+            u32 length = LZ4_MIN_MATCH;
+            while (i + length < copyLimit && src[candidate + length] == src[i + length]) length++;
+
+            if (!Lz4WriteSequence(op, end, src + anchor, i - anchor, i - candidate, length)) return 0;
+            i += length;
+            anchor = i;
+        }
+    }
+
+    if (!Lz4WriteSequence(op, end, src + anchor, size - anchor, 0, 0)) return 0;
+    return (u32)(op - dst);
+}
+
+// Decompresses a whole block, returns false if it is malformed or doesn't produce exactly dstSize bytes
+inline bool Lz4Decompress(const u8* src, u32 srcSize, u8* dst, u32 dstSize)
+{
+    const u8* ip = src;
+    const u8* ipEnd = src + srcSize;
+    u8* op = dst;
+    const u8* opEnd = dst + dstSize;
+
+    while (ip < ipEnd)
+    {
+        const u8 token = *ip++;
+
+        u32 literalCount = token >> 4;
+        if (literalCount == 15)
+        {
+            u8 byte;
+            do
+            {
+                if (ip >= ipEnd) return false;
+                byte = *ip++;
+                literalCount += byte;
+            } while (byte == 255);
+        }
+
+        if ((u64)(ipEnd - ip) < literalCount || (u64)(opEnd - op) < literalCount) return false;
+        memcpy(op, ip, literalCount);
+        ip += literalCount;
+        op += literalCount;
+
+        // The last sequence has no match
+        if (ip == ipEnd) break;
+
+        if (ipEnd - ip < 2) return false;
+        const u32 offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (u64)(op - dst)) return false;
+
+        u32 matchLength = (token & 15) + LZ4_MIN_MATCH;
+        if ((token & 15) == 15)
+        {
+            u8 byte;
+            do
+            {
+                if (ip >= ipEnd) return false;
+                byte = *ip++;
+                matchLength += byte;
+            } while (byte == 255);
+        }
+
+        if ((u64)(opEnd - op) < matchLength) return false;
+
+        // Matches can overlap their own output (offset < length), copied forward byte by byte then
+        const u8* match = op - offset;
+        if (offset >= matchLength) memcpy(op, match, matchLength);
+        else for (u32 i = 0; i < matchLength; ++i) op[i] = match[i];
+        op += matchLength;
+    }
+
+    return op == opEnd;
+}
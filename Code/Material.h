@@ -14,10 +14,10 @@ public:
 	vec3 specular = vec3(0.5f);
 	float shininess = 32;
 	
-	unsigned int diffuseTex;
-	unsigned int emissiveTex;
-	unsigned int specularTex;
-	unsigned int normalsTex;
-	unsigned int bumpTex;
+	unsigned int diffuseTex = UINT32_MAX;
+	unsigned int emissiveTex = UINT32_MAX;
+	unsigned int specularTex = UINT32_MAX;
+	unsigned int normalsTex = UINT32_MAX;
+	unsigned int bumpTex = UINT32_MAX;
 
 };
\ No newline at end of file
@@ -1,16 +1,77 @@
 #pragma once
 
+#include <string.h>
+#include <glm/glm.hpp>
 #include "VertexBufferLayout.h"
+#include "Vao.h"
+#include "Meshlet.h"
+
+#define MESH_MAX_LODS 3
+
+// Simplified index range drawn with the same vertices as the full detail mesh
+struct MeshLod
+{
+	unsigned int indexsOffset = 0;
+	unsigned int indexCount = 0;
+};
 
 class Mesh
 {
 public:
 
 	VertexBufferLayout vertexBufferLayout;
-	std::vector<float> vertexs;
+	// Cpu copies of the gpu ranges, only kept for cpuReadable meshes (picking, physics)
+	std::vector<unsigned char> vertexs;
 	std::vector<unsigned int> indexs;
-	unsigned int vertexOffset;
-	unsigned int indexsOffset;
+	bool cpuReadable = false;
+	unsigned int vertexOffset = 0;
+	unsigned int vertexBytes = 0;
+	unsigned int indexsOffset = 0;
+	unsigned int indexCount = 0;
+
+	// GL_UNSIGNED_SHORT for submeshes with up to 65536 vertices, GL_UNSIGNED_INT otherwise
+	GLenum indexType = GL_UNSIGNED_INT;
+	unsigned int IndexSize() const { return indexType == GL_UNSIGNED_SHORT ? 2 : 4; }
+
+	// Vertex decode parameters (identity for float vertices), see VertexFormat.h
+	glm::vec3 positionOffset = glm::vec3(0.f);
+	glm::vec3 positionScale = glm::vec3(1.f);
+	bool octahedralNormals = false;
 	std::vector<Vao> vaos;
 
-};
\ No newline at end of file
+	// Clusters of the index range, for per-cluster frustum and back-face culling
+	std::vector<Meshlet> meshlets;
+
+	// Bounding sphere in object space
+	glm::vec3 boundsCenter = glm::vec3(0.f);
+	float boundsRadius = 0.f;
+
+	// Texture coordinate units per object space unit (square root of the UV area over the surface area),
+	// 0 if unknown. Texture streaming turns it into the texel density of the mesh on screen.
+	float uvDensity = 0.f;
+
+	// Levels 1..n with about 50%, 25% and 12% of the triangles, level 0 is the range above
+	std::vector<MeshLod> lods;
+
+};
+
+// UV density of an indexed triangle list (see Mesh::uvDensity), texture coordinates are float pairs
+inline float ComputeUvDensity(const vec3* positions, const u8* texCoords, u32 texCoordStride, const u8* indices, GLenum indexType, u32 indexCount)
+{
+	double uvArea = 0.0, area = 0.0;
+	for (u32 i = 0; i + 2 < indexCount; i += 3)
+	{
+		u32 v[3];
+		for (u32 c = 0; c < 3; ++c)
+			v[c] = indexType == GL_UNSIGNED_SHORT ? ((const u16*)indices)[i + c] : ((const u32*)indices)[i + c];
+
+		glm::vec2 uv[3];
+		for (u32 c = 0; c < 3; ++c)
+			memcpy(&uv[c], texCoords + (u64)v[c] * texCoordStride, sizeof(glm::vec2));
+
+		const glm::vec2 du = uv[1] - uv[0], dv = uv[2] - uv[0];
+		uvArea += glm::abs(du.x * dv.y - du.y * dv.x) * 0.5f;
+		area += glm::length(glm::cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]])) * 0.5f;
+	}
+	return area > 0.0 ? (float)sqrt(uvArea / area) : 0.f;
+}
\ No newline at end of file
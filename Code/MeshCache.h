@@ -0,0 +1,433 @@
+#pragma once
+#include <algorithm>
+#include "ModelImport.h"
+#include "Hash.h"
+
+// Cooked model layout (all offsets are relative to the start of the file):
+// [CookedModelHeader][CookedDependency * dependencyCount][CookedMesh * meshCount][CookedMaterial * materialCount][Meshlet * meshletCount]
+// [vertex stream][index stream (full detail ranges, then the simplified LOD ranges)]
+// The vertex and index streams are stored exactly as they are uploaded to the GPU,
+// so a warm load maps the file and hands both streams straight to glBufferData.
+// Reading and writing only deals with a ModelImport, so it is safe from worker threads.
+
+#define COOKED_MODEL_MAGIC   0x434D4E4E // "NNMC"
+#define COOKED_MODEL_VERSION 9
+#define COOKED_MODEL_EXTENSION ".mesh"
+#define COOKED_MAX_ATTRIBUTES 8
+#define COOKED_MAX_PATH 256
+
+struct CookedModelHeader
+{
+    u32 magic;
+    u32 version;
+    u32 vertexFormat;
+    u32 dependencyCount;
+    u64 sourceTimestamp;
+    u64 sourceHash;
+    u32 meshCount;
+    u32 materialCount;
+    u32 meshletCount;
+    u32 padding2;
+    u32 vertexBytes;
+    u32 indexBytes;
+};
+
+// Other file the model was cooked from (material library, external buffer), validated like the source
+struct CookedDependency
+{
+    char path[COOKED_MAX_PATH];
+    u64  timestamp;
+    u64  hash;
+};
+
+struct CookedAttribute
+{
+    u8  location;
+    u8  componentCount;
+    u8  offset;
+    u8  normalized;
+    u32 type;
+};
+
+struct CookedLod
+{
+    u32 indexsOffset;
+    u32 indexCount;
+};
+
+struct CookedMesh
+{
+    u32 vertexOffset;
+    u32 vertexBytes;
+    u32 indexsOffset;
+    u32 indexCount;
+    u32 materialIndex; // Relative to the first material of the model
+    u32 firstMeshlet;
+    u32 meshletCount;
+    f32 positionOffset[3];
+    f32 positionScale[3];
+    f32 boundsCenter[3];
+    f32 boundsRadius;
+    f32 uvDensity;
+    u32 lodCount;
+    CookedLod lods[MESH_MAX_LODS];
+    u8  stride;
+    u8  attributeCount;
+    u8  octahedralNormals;
+    u8  indexSize; // 2 or 4 bytes
+    CookedAttribute attributes[COOKED_MAX_ATTRIBUTES];
+};
+
+struct CookedMaterial
+{
+    char name[64];
+    f32  diffuse[3];
+    f32  emissive[3];
+    f32  specular[3];
+    f32  shininess;
+    u64  properties;
+    char textures[CTS_COUNT][COOKED_MAX_PATH]; // Empty string if the slot is not used
+};
+
+std::string CookedModelPath(const char* filename)
+{
+    return std::string(filename) + COOKED_MODEL_EXTENSION;
+}
+
+u64 HashSourceFile(const char* filename)
+{
+    MappedFile source = MapFile(filename);
+    if (!source.data) return 0;
+
+    u64 hash = HashBytes(source.data, source.size);
+    UnmapFile(source);
+    return hash;
+}
+
+void CopyCookedString(char* dst, u32 capacity, const std::string& src)
+{
+    dst[0] = '\0';
+    if (src.size() >= capacity) return;
+    memcpy(dst, src.c_str(), src.size() + 1);
+}
+
+// Writes the cooked version of an import that was packed from the source file
+bool WriteCookedModel(const char* filename, const ModelImport& import)
+{
+    CookedModelHeader header = {};
+    header.magic = COOKED_MODEL_MAGIC;
+    header.version = COOKED_MODEL_VERSION;
+    header.vertexFormat = import.vertexFormat;
+    header.sourceTimestamp = GetFileLastWriteTimestamp(filename);
+    header.sourceHash = HashSourceFile(filename);
+    header.meshCount = import.meshes.size();
+    header.materialCount = import.materials.size();
+    header.vertexBytes = import.vertexBytes;
+    header.indexBytes = import.indexBytes;
+
+    // What the import read besides the source. Textures are only named by path here, their own cache
+    // (see CookedTexture.h) takes care of their edits.
+    std::vector<std::string> paths = import.dependencies;
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+    std::vector<CookedDependency> dependencies;
+    for (std::vector<std::string>::const_iterator it = paths.begin(); it != paths.end(); ++it)
+    {
+        if (*it == filename) continue;
+        if (it->size() >= COOKED_MAX_PATH)
+        {
+            // It couldn't be checked, the cooked version would go stale without notice
+            ELOG("Not cooking %s, the path of its dependency %s is too long", filename, it->c_str());
+            return false;
+        }
+
+        CookedDependency dependency = {};
+        CopyCookedString(dependency.path, COOKED_MAX_PATH, *it);
+        dependency.timestamp = GetFileLastWriteTimestamp(it->c_str());
+        dependency.hash = HashSourceFile(it->c_str());
+        dependencies.push_back(dependency);
+    }
+    header.dependencyCount = dependencies.size();
+
+    std::vector<CookedMesh> meshes(header.meshCount);
+    std::vector<Meshlet> meshlets;
+    for (u32 i = 0; i < header.meshCount; ++i)
+    {
+        const Mesh* mesh = import.meshes[i];
+        const VertexBufferLayout& layout = mesh->vertexBufferLayout;
+        if (layout.attributes.size() > COOKED_MAX_ATTRIBUTES) return false;
+
+        CookedMesh& cooked = meshes[i];
+        cooked = {};
+        cooked.vertexOffset = mesh->vertexOffset;
+        cooked.vertexBytes = mesh->vertexBytes;
+        cooked.indexsOffset = mesh->indexsOffset;
+        cooked.indexCount = mesh->indexCount;
+        cooked.materialIndex = import.meshMaterials[i];
+        cooked.firstMeshlet = meshlets.size();
+        cooked.meshletCount = mesh->meshlets.size();
+        meshlets.insert(meshlets.end(), mesh->meshlets.begin(), mesh->meshlets.end());
+        memcpy(cooked.positionOffset, &mesh->positionOffset, sizeof(cooked.positionOffset));
+        memcpy(cooked.positionScale, &mesh->positionScale, sizeof(cooked.positionScale));
+        memcpy(cooked.boundsCenter, &mesh->boundsCenter, sizeof(cooked.boundsCenter));
+        cooked.boundsRadius = mesh->boundsRadius;
+        cooked.uvDensity = mesh->uvDensity;
+        cooked.lodCount = mesh->lods.size();
+        for (u32 l = 0; l < cooked.lodCount && l < MESH_MAX_LODS; ++l)
+        {
+            cooked.lods[l].indexsOffset = mesh->lods[l].indexsOffset;
+            cooked.lods[l].indexCount = mesh->lods[l].indexCount;
+        }
+        cooked.octahedralNormals = mesh->octahedralNormals;
+        cooked.indexSize = mesh->IndexSize();
+        cooked.stride = layout.stride;
+        cooked.attributeCount = layout.attributes.size();
+        for (u32 a = 0; a < cooked.attributeCount; ++a)
+        {
+            cooked.attributes[a].location = layout.attributes[a]->location;
+            cooked.attributes[a].componentCount = layout.attributes[a]->componentCount;
+            cooked.attributes[a].offset = layout.attributes[a]->offset;
+            cooked.attributes[a].normalized = layout.attributes[a]->normalized;
+            cooked.attributes[a].type = layout.attributes[a]->type;
+        }
+    }
+
+    header.meshletCount = meshlets.size();
+
+    std::vector<CookedMaterial> materials(header.materialCount);
+    for (u32 i = 0; i < header.materialCount; ++i)
+    {
+        const ImportedMaterial& mat = import.materials[i];
+        CookedMaterial& cooked = materials[i];
+        cooked = {};
+        strncpy(cooked.name, mat.name.c_str(), sizeof(cooked.name) - 1);
+        memcpy(cooked.diffuse, &mat.diffuse, sizeof(cooked.diffuse));
+        memcpy(cooked.emissive, &mat.emissive, sizeof(cooked.emissive));
+        memcpy(cooked.specular, &mat.specular, sizeof(cooked.specular));
+        cooked.shininess = mat.shininess;
+        cooked.properties = mat.properties.Binary();
+        for (u32 t = 0; t < CTS_COUNT; ++t)
+            CopyCookedString(cooked.textures[t], COOKED_MAX_PATH, mat.textures[t]);
+    }
+
+    // Written next to it and renamed over it when complete, a reader may have the old file mapped
+    std::string cookedPath = CookedModelPath(filename);
+    std::string temporaryPath = cookedPath + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+    {
+        ELOG("Could not write cooked model %s", cookedPath.c_str());
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    written = written && fwrite(dependencies.data(), sizeof(CookedDependency), dependencies.size(), file) == dependencies.size();
+    written = written && fwrite(meshes.data(), sizeof(CookedMesh), meshes.size(), file) == meshes.size();
+    written = written && fwrite(materials.data(), sizeof(CookedMaterial), materials.size(), file) == materials.size();
+    written = written && fwrite(meshlets.data(), sizeof(Meshlet), meshlets.size(), file) == meshlets.size();
+    written = written && fwrite(import.vertexData, 1, import.vertexBytes, file) == import.vertexBytes;
+    written = written && fwrite(import.indexData, 1, import.indexBytes, file) == import.indexBytes;
+    written = fflush(file) == 0 && written;
+    written = fclose(file) == 0 && written;
+
+    if (!written || !MoveFileOver(temporaryPath.c_str(), cookedPath.c_str()))
+    {
+        ELOG("Could not write cooked model %s", cookedPath.c_str());
+        remove(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// Checks a file the cooked model was built from. The timestamp is the fast path, the content hash
+// rescues files that were touched (e.g. checked out) without changes, their timestamp is updated then.
+bool IsCookedSourceValid(const char* filename, u64& timestamp, u64 hash, bool& touched)
+{
+    const u64 current = GetFileLastWriteTimestamp(filename);
+    if (current == timestamp) return true;
+
+    if (HashSourceFile(filename) != hash) return false;
+
+    timestamp = current;
+    touched = true;
+    return true;
+}
+
+// Checks the cooked header against the source file and every dependency
+bool IsCookedModelValid(CookedModelHeader& header, std::vector<CookedDependency>& dependencies, const char* filename, VertexFormat format, bool& touched)
+{
+    touched = false;
+    if (header.magic != COOKED_MODEL_MAGIC || header.version != COOKED_MODEL_VERSION) return false;
+    if (header.vertexFormat != format) return false;
+
+    if (!IsCookedSourceValid(filename, header.sourceTimestamp, header.sourceHash, touched)) return false;
+    for (std::vector<CookedDependency>::iterator it = dependencies.begin(); it != dependencies.end(); ++it)
+    {
+        it->path[COOKED_MAX_PATH - 1] = '\0';
+        if (!IsCookedSourceValid(it->path, it->timestamp, it->hash, touched)) return false;
+    }
+
+    return true;
+}
+
+// Validates the header and the dependencies (refreshing the timestamps of touched files) before the file gets mapped
+bool CheckCookedModel(const char* filename, VertexFormat format)
+{
+    std::string cookedPath = CookedModelPath(filename);
+    FILE* file = fopen(cookedPath.c_str(), "rb");
+    if (!file) return false;
+
+    CookedModelHeader header = {};
+    std::vector<CookedDependency> dependencies;
+    bool read = fread(&header, sizeof(header), 1, file) == 1 && header.magic == COOKED_MODEL_MAGIC && header.version == COOKED_MODEL_VERSION;
+    if (read)
+    {
+        dependencies.resize(header.dependencyCount);
+        read = fread(dependencies.data(), sizeof(CookedDependency), dependencies.size(), file) == dependencies.size();
+    }
+    fclose(file);
+
+    bool touched = false;
+    if (!read || !IsCookedModelValid(header, dependencies, filename, format, touched)) return false;
+
+    if (touched)
+    {
+        file = fopen(cookedPath.c_str(), "r+b");
+        if (file)
+        {
+            fwrite(&header, sizeof(header), 1, file);
+            fwrite(dependencies.data(), sizeof(CookedDependency), dependencies.size(), file);
+            fclose(file);
+        }
+    }
+
+    return true;
+}
+
+// Ranges of a cooked mesh, a file from another build (or a corrupt one) must not index past the
+// material table or the streams
+bool IsCookedMeshValid(const CookedModelHeader& header, const CookedMesh& mesh)
+{
+    if (mesh.materialIndex >= header.materialCount) return false;
+    if (mesh.attributeCount > COOKED_MAX_ATTRIBUTES || mesh.lodCount > MESH_MAX_LODS || mesh.stride == 0) return false;
+    if (mesh.indexSize != 2 && mesh.indexSize != 4) return false;
+    if ((u64)mesh.firstMeshlet + mesh.meshletCount > header.meshletCount) return false;
+    if ((u64)mesh.vertexOffset + mesh.vertexBytes > header.vertexBytes || mesh.vertexBytes % mesh.stride != 0) return false;
+    if ((u64)mesh.indexsOffset + (u64)mesh.indexCount * mesh.indexSize > header.indexBytes) return false;
+
+    for (u32 l = 0; l < mesh.lodCount; ++l)
+        if ((u64)mesh.lods[l].indexsOffset + (u64)mesh.lods[l].indexCount * mesh.indexSize > header.indexBytes) return false;
+
+    for (u32 a = 0; a < mesh.attributeCount; ++a)
+        if (mesh.attributes[a].offset >= mesh.stride) return false;
+
+    return true;
+}
+
+// Fills the import from the cooked file, returns false if there is no valid cooked version
+// in the requested vertex format. The streams point into the mapping, which is released with FreeModelImport().
+bool ReadCookedModel(const char* filename, ModelImport& import, VertexFormat format)
+{
+    if (!CheckCookedModel(filename, format)) return false;
+
+    std::string cookedPath = CookedModelPath(filename);
+    MappedFile file = MapFile(cookedPath.c_str());
+    if (!file.data) return false;
+
+    const CookedModelHeader* header = (const CookedModelHeader*)file.data;
+    if (file.size < sizeof(CookedModelHeader))
+    {
+        UnmapFile(file);
+        return false;
+    }
+    const u64 meshesOffset = sizeof(CookedModelHeader) + header->dependencyCount * sizeof(CookedDependency);
+    const u64 materialsOffset = meshesOffset + header->meshCount * sizeof(CookedMesh);
+    const u64 meshletsOffset = materialsOffset + header->materialCount * sizeof(CookedMaterial);
+    const u64 vertexsOffset = meshletsOffset + header->meshletCount * sizeof(Meshlet);
+    const u64 indexsOffset = vertexsOffset + header->vertexBytes;
+    if (file.size < sizeof(CookedModelHeader) || file.size < indexsOffset + header->indexBytes)
+    {
+        UnmapFile(file);
+        return false;
+    }
+
+    const CookedMesh* meshes = (const CookedMesh*)(file.data + meshesOffset);
+    const CookedMaterial* materials = (const CookedMaterial*)(file.data + materialsOffset);
+    const Meshlet* meshlets = (const Meshlet*)(file.data + meshletsOffset);
+
+    // Rejected as a whole, the caller imports the source again
+    for (u32 i = 0; i < header->meshCount; ++i)
+    {
+        if (IsCookedMeshValid(*header, meshes[i])) continue;
+        ELOG("Cooked model %s is corrupt", cookedPath.c_str());
+        UnmapFile(file);
+        return false;
+    }
+
+    import.path = filename;
+    import.materials.resize(header->materialCount);
+    for (u32 i = 0; i < header->materialCount; ++i)
+    {
+        const CookedMaterial& cooked = materials[i];
+        ImportedMaterial& mat = import.materials[i];
+        mat.name = cooked.name;
+        mat.diffuse = vec3(cooked.diffuse[0], cooked.diffuse[1], cooked.diffuse[2]);
+        mat.emissive = vec3(cooked.emissive[0], cooked.emissive[1], cooked.emissive[2]);
+        mat.specular = vec3(cooked.specular[0], cooked.specular[1], cooked.specular[2]);
+        mat.shininess = cooked.shininess;
+        mat.properties.Set(cooked.properties);
+        for (u32 t = 0; t < CTS_COUNT; ++t)
+            mat.textures[t] = cooked.textures[t];
+    }
+
+    for (u32 i = 0; i < header->meshCount; ++i)
+    {
+        const CookedMesh& cooked = meshes[i];
+
+        VertexBufferLayout vertexBufferLayout = {};
+        for (u32 a = 0; a < cooked.attributeCount; ++a)
+        {
+            const CookedAttribute& ca = cooked.attributes[a];
+            VertexBufferAttribute* attribute = new VertexBufferAttribute(ca.location, ca.componentCount, ca.type, ca.normalized != 0);
+            attribute->offset = ca.offset;
+            vertexBufferLayout.attributes.push_back(attribute);
+        }
+        vertexBufferLayout.stride = cooked.stride;
+
+        Mesh* mesh = new Mesh();
+        mesh->vertexBufferLayout = vertexBufferLayout;
+        mesh->vertexOffset = cooked.vertexOffset;
+        mesh->vertexBytes = cooked.vertexBytes;
+        mesh->indexsOffset = cooked.indexsOffset;
+        mesh->indexCount = cooked.indexCount;
+        mesh->positionOffset = vec3(cooked.positionOffset[0], cooked.positionOffset[1], cooked.positionOffset[2]);
+        mesh->positionScale = vec3(cooked.positionScale[0], cooked.positionScale[1], cooked.positionScale[2]);
+        mesh->boundsCenter = vec3(cooked.boundsCenter[0], cooked.boundsCenter[1], cooked.boundsCenter[2]);
+        mesh->boundsRadius = cooked.boundsRadius;
+        mesh->uvDensity = cooked.uvDensity;
+        for (u32 l = 0; l < cooked.lodCount; ++l)
+        {
+            MeshLod lod;
+            lod.indexsOffset = cooked.lods[l].indexsOffset;
+            lod.indexCount = cooked.lods[l].indexCount;
+            mesh->lods.push_back(lod);
+        }
+        mesh->octahedralNormals = cooked.octahedralNormals != 0;
+        mesh->indexType = cooked.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        mesh->meshlets.assign(meshlets + cooked.firstMeshlet, meshlets + cooked.firstMeshlet + cooked.meshletCount);
+        import.meshes.emplace_back(mesh);
+        import.meshMaterials.emplace_back(cooked.materialIndex);
+    }
+
+    import.mapping = file;
+    import.vertexData = file.data + vertexsOffset;
+    import.vertexBytes = header->vertexBytes;
+    import.indexData = file.data + indexsOffset;
+    import.indexBytes = header->indexBytes;
+    import.vertexFormat = format;
+    import.fromCache = true;
+
+    return true;
+}
@@ -0,0 +1,279 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "platform.h"
+#include "Typedef.h"
+
+// Index/vertex order optimizations for indexed triangle lists, run at import time:
+// 1. OptimizeVertexCache: Tipsify (Sander et al. 2007) triangle order for the post-transform cache
+// 2. OptimizeOverdraw: splits the result into clusters and sorts them so outer, outward facing
+//    clusters are drawn first, keeping the cache efficiency within a threshold
+// 3. OptimizeVertexFetch: renumbers the vertices in first use order, for linear vertex fetches
+
+#define VERTEX_CACHE_SIZE 16
+
+// ACMR: transformed vertices per triangle (0.5 is ideal on regular meshes, 3 is the worst).
+// ATVR: transformed vertices per vertex (1 is ideal).
+struct VertexCacheStats
+{
+    float acmr = 0.f;
+    float atvr = 0.f;
+};
+
+// FIFO cache simulation, returns the cache misses of one triangle
+inline u32 SimulateVertexCache(const u32* triangle, std::vector<u32>& timestamps, u32& time, u32 cacheSize)
+{
+    u32 misses = 0;
+    for (u32 k = 0; k < 3; ++k)
+    {
+        const u32 v = triangle[k];
+        if (time - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+inline VertexCacheStats AnalyzeVertexCache(const u32* indices, u32 indexCount, u32 vertexCount, u32 cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStats stats;
+    if (indexCount < 3 || vertexCount == 0) return stats;
+
+    std::vector<u32> timestamps(vertexCount, 0);
+    u32 time = cacheSize + 1;
+    u32 misses = 0;
+    for (u32 i = 0; i + 2 < indexCount; i += 3)
+        misses += SimulateVertexCache(&indices[i], timestamps, time, cacheSize);
+
+    std::vector<u8> used(vertexCount, 0);
+    u32 usedCount = 0;
+    for (u32 i = 0; i < indexCount; ++i)
+    {
+        if (used[indices[i]]) continue;
+        used[indices[i]] = 1;
+        usedCount++;
+    }
+
+    stats.acmr = (float)misses / (indexCount / 3);
+    stats.atvr = (float)misses / usedCount;
+    return stats;
+}
+
+// Tipsify: fans around the last vertex while its neighbours still fit in the cache,
+// falls back to recently used vertices (dead-end stack) and then to the next vertex in input order.
+inline void OptimizeVertexCache(std::vector<u32>& indices, u32 vertexCount, u32 cacheSize = VERTEX_CACHE_SIZE)
+{
+    const u32 triangleCount = indices.size() / 3;
+    if (triangleCount < 2 || vertexCount == 0) return;
+
+    // Vertex -> triangles adjacency (compressed)
+    std::vector<u32> liveTriangles(vertexCount, 0);
+    for (u32 i = 0; i < triangleCount * 3; ++i) liveTriangles[indices[i]]++;
+
+    std::vector<u32> adjacencyOffsets(vertexCount + 1, 0);
+    for (u32 v = 0; v < vertexCount; ++v) adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<u32> adjacency(triangleCount * 3);
+    {
+        std::vector<u32> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (u32 t = 0; t < triangleCount; ++t)
+            for (u32 k = 0; k < 3; ++k)
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+    }
+
+    std::vector<u32> timestamps(vertexCount, 0);
+    std::vector<u8> emitted(triangleCount, 0);
+    std::vector<u32> deadEnds;
+    std::vector<u32> candidates;
+    std::vector<u32> result;
+    result.reserve(triangleCount * 3);
+
+    u32 time = cacheSize + 1;
+    u32 cursor = 0;
+    i64 fanning = indices[0];
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+
+        for (u32 a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a)
+        {
+            const u32 t = adjacency[a];
+            if (emitted[t]) continue;
+
+            for (u32 k = 0; k < 3; ++k)
+            {
+                const u32 v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - timestamps[v] > cacheSize) timestamps[v] = time++;
+            }
+            emitted[t] = 1;
+        }
+
+        // Best candidate: the oldest one that would still be in the cache after fanning around it
+        fanning = -1;
+        i64 bestPriority = -1;
+        for (u32 v : candidates)
+        {
+            if (liveTriangles[v] == 0) continue;
+
+            i64 priority = 0;
+            if (time - timestamps[v] + 2 * liveTriangles[v] <= cacheSize) priority = time - timestamps[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanning = v;
+            }
+        }
+
+        if (fanning >= 0) continue;
+
+        // Dead end: most recent vertex with triangles left, then the next one in input order
+        while (!deadEnds.empty() && fanning < 0)
+        {
+            const u32 v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0) fanning = v;
+        }
+        while (fanning < 0 && cursor < vertexCount)
+        {
+            if (liveTriangles[cursor] > 0) fanning = cursor;
+            cursor++;
+        }
+    }
+
+    indices.swap(result);
+}
+
+// Linear-speed overdraw ordering (Sander et al. 2007): clusters start where the cache simulation
+// restarts (hard boundaries) and are split further while their ACMR stays under threshold times the
+// one of the whole cluster (soft boundaries). Clusters are then sorted by how far out they face.
+inline void OptimizeOverdraw(std::vector<u32>& indices, const vec3* positions, u32 vertexCount, u32 cacheSize = VERTEX_CACHE_SIZE, float threshold = 1.05f)
+{
+    const u32 triangleCount = indices.size() / 3;
+    if (triangleCount < 2 || vertexCount == 0) return;
+
+    // Hard boundaries: triangles missing the cache on all three vertices
+    std::vector<u32> hardClusters;
+    {
+        std::vector<u32> timestamps(vertexCount, 0);
+        u32 time = cacheSize + 1;
+        for (u32 t = 0; t < triangleCount; ++t)
+            if (SimulateVertexCache(&indices[t * 3], timestamps, time, cacheSize) == 3) hardClusters.push_back(t);
+    }
+    if (hardClusters.empty() || hardClusters[0] != 0) hardClusters.insert(hardClusters.begin(), 0);
+
+    // Soft boundaries inside every hard cluster
+    std::vector<u32> clusters;
+    {
+        std::vector<u32> timestamps(vertexCount, 0);
+        u32 time = cacheSize + 1;
+        for (u32 c = 0; c < hardClusters.size(); ++c)
+        {
+            const u32 begin = hardClusters[c];
+            const u32 end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : triangleCount;
+
+            u32 clusterMisses = 0;
+            for (u32 t = begin; t < end; ++t)
+                clusterMisses += SimulateVertexCache(&indices[t * 3], timestamps, time, cacheSize);
+            const float clusterThreshold = threshold * clusterMisses / (end - begin);
+
+            // Fresh cache for the split, as if every sub-cluster started cold
+            time += cacheSize + 1;
+            clusters.push_back(begin);
+            u32 start = begin;
+            u32 misses = 0;
+            for (u32 t = begin; t < end; ++t)
+            {
+                misses += SimulateVertexCache(&indices[t * 3], timestamps, time, cacheSize);
+                if (t + 1 < end && (float)misses / (t - start + 1) <= clusterThreshold)
+                {
+                    clusters.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    time += cacheSize + 1;
+                }
+            }
+        }
+    }
+    if (clusters.size() < 2) return;
+
+    // Mesh centroid, weighted by triangle area
+    vec3 meshCentroid = vec3(0.f);
+    float meshArea = 0.f;
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        const vec3 a = positions[indices[t * 3]], b = positions[indices[t * 3 + 1]], c = positions[indices[t * 3 + 2]];
+        const float area = glm::length(glm::cross(b - a, c - a));
+        meshCentroid += (a + b + c) * (area / 3.f);
+        meshArea += area;
+    }
+    meshCentroid = meshArea > 0.f ? meshCentroid / meshArea : vec3(0.f);
+
+    // Sort key: how far the cluster centroid lies along the cluster normal, seen from the mesh centroid
+    std::vector<std::pair<float, u32>> order(clusters.size());
+    for (u32 c = 0; c < clusters.size(); ++c)
+    {
+        const u32 begin = clusters[c];
+        const u32 end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        vec3 centroid = vec3(0.f);
+        vec3 normal = vec3(0.f);
+        float area = 0.f;
+        for (u32 t = begin; t < end; ++t)
+        {
+            const vec3 a = positions[indices[t * 3]], b = positions[indices[t * 3 + 1]], c = positions[indices[t * 3 + 2]];
+            const vec3 n = glm::cross(b - a, c - a);
+            const float triangleArea = glm::length(n);
+            centroid += (a + b + c) * (triangleArea / 3.f);
+            normal += n;
+            area += triangleArea;
+        }
+
+        centroid = area > 0.f ? centroid / area : vec3(0.f);
+        const float normalLength = glm::length(normal);
+        normal = normalLength > 0.f ? normal / normalLength : vec3(0.f);
+
+        order[c] = std::make_pair(-glm::dot(centroid - meshCentroid, normal), c);
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    std::vector<u32> result;
+    result.reserve(indices.size());
+    for (u32 i = 0; i < order.size(); ++i)
+    {
+        const u32 c = order[i].second;
+        const u32 begin = clusters[c];
+        const u32 end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        result.insert(result.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+    }
+
+    indices.swap(result);
+}
+
+// Renumbers the vertices in the order the indices first reference them. vertexOrder receives the
+// old index of every new vertex; unreferenced vertices are kept at the end.
+inline void OptimizeVertexFetch(std::vector<u32>& indices, u32 vertexCount, std::vector<u32>& vertexOrder)
+{
+    std::vector<u32> remap(vertexCount, UINT32_MAX);
+    vertexOrder.clear();
+    vertexOrder.reserve(vertexCount);
+
+    for (std::vector<u32>::iterator it = indices.begin(); it != indices.end(); ++it)
+    {
+        if (remap[*it] == UINT32_MAX)
+        {
+            remap[*it] = vertexOrder.size();
+            vertexOrder.push_back(*it);
+        }
+        *it = remap[*it];
+    }
+
+    for (u32 v = 0; v < vertexCount; ++v)
+        if (remap[v] == UINT32_MAX) vertexOrder.push_back(v);
+}
@@ -0,0 +1,269 @@
+#pragma once
+#include <vector>
+#include "ModelImport.h"
+#include "VertexFormat.h"
+#include "MeshSimplify.h"
+#include "MeshOptimize.h"
+
+// Importer independent part of the import pipeline: every loader (Assimp, native OBJ) describes its
+// submeshes as a MeshSource and ProcessMeshSource() optimizes them and writes the gpu streams.
+
+struct MeshSource
+{
+    u32 vertexCount = 0;
+    const vec3* positions = nullptr;
+    const vec3* normals = nullptr;
+    const vec3* texCoords = nullptr;  // Only xy is used, null if the mesh has none
+    const vec3* tangents = nullptr;   // Null if the mesh has no tangent space
+    const vec3* bitangents = nullptr; // Left-handed, like Assimp gives them
+    std::vector<u32> indices;
+    u32 materialIndex = 0;
+    bool triangles = true;            // False for point/line meshes, which are not optimized
+};
+
+// Bytes per vertex emitted by ProcessMeshSource(), matches the layout it creates
+u32 MeshVertexStride(bool hasTexCoords, bool hasTangentSpace, VertexFormat format)
+{
+    if (format == VF_QUANTIZED)
+        return 12 + (hasTexCoords ? 4 : 0) + (hasTangentSpace ? 4 : 0);
+
+    return 24 + (hasTexCoords ? 8 : 0) + (hasTangentSpace ? 24 : 0);
+}
+
+u32 MeshVertexStride(const MeshSource& source, VertexFormat format)
+{
+    return MeshVertexStride(source.texCoords != nullptr, source.tangents != nullptr && source.bitangents, format);
+}
+
+// Submeshes small enough get 16 bit indices
+u32 MeshIndexSize(u32 vertexCount)
+{
+    return vertexCount <= 65536 ? sizeof(u16) : sizeof(u32);
+}
+
+// Index ranges are padded to 4 bytes, so 16 and 32 bit ranges can follow each other in the stream
+u32 MeshIndexBytes(u32 indexCount, u32 vertexCount)
+{
+    return (indexCount * MeshIndexSize(vertexCount) + 3) & ~3u;
+}
+
+// Simplified levels at about 50%, 25% and 12% of the triangles, each one built from the previous level.
+// They are written to the LOD stream with the index size of the mesh, FinishModelImportStreams() rebases them.
+void BuildMeshLods(const std::vector<vec3>& positions, const std::vector<u32>& indices, Mesh* m, ModelImport& myModel)
+{
+    std::vector<u32> source = indices;
+    std::vector<u32> simplified;
+    for (u32 level = 0; level < MESH_MAX_LODS; ++level)
+    {
+        // Not worth an extra level for small meshes
+        if (source.size() < 64 * 3) break;
+
+        SimplifyMesh(positions.data(), positions.size(), source, (source.size() / 6) * 3, simplified);
+
+        // Locked borders and seams can keep a mesh from shrinking, the next levels would be the same
+        if (simplified.size() > source.size() * 3 / 4) break;
+
+        OptimizeVertexCache(simplified, positions.size());
+
+        MeshLod lod;
+        lod.indexsOffset = myModel.lodStream.size();
+        lod.indexCount = simplified.size();
+        myModel.lodStream.resize(lod.indexsOffset + ((lod.indexCount * m->IndexSize() + 3) & ~3u));
+
+        u8* lodIndices = myModel.lodStream.data() + lod.indexsOffset;
+        for (u32 i = 0; i < lod.indexCount; ++i)
+        {
+            if (m->indexType == GL_UNSIGNED_SHORT) ((u16*)lodIndices)[i] = (u16)simplified[i];
+            else ((u32*)lodIndices)[i] = simplified[i];
+        }
+
+        m->lods.push_back(lod);
+        source.swap(simplified);
+    }
+}
+
+// Writes the mesh straight into the import streams (sized beforehand by the loader),
+// at the current end given by import.vertexBytes/indexBytes
+void ProcessMeshSource(MeshSource& source, ModelImport& myModel, VertexFormat format)
+{
+    u8* vertices = myModel.vertexStream.data() + myModel.vertexBytes;
+    u8* indices = myModel.indexStream.data() + myModel.indexBytes;
+    const bool shortIndices = MeshIndexSize(source.vertexCount) == sizeof(u16);
+
+    bool hasTexCoords = source.texCoords != nullptr; // does the mesh contain texture coordinates?
+    bool hasTangentSpace = source.tangents != nullptr && source.bitangents;
+    bool quantized = format == VF_QUANTIZED;
+
+    // AABB of the submesh, quantized positions are stored relative to it
+    vec3 aabbMin = vec3(0.f);
+    vec3 aabbMax = vec3(0.f);
+    if (source.vertexCount > 0)
+    {
+        aabbMax = aabbMin = source.positions[0];
+        for (u32 i = 1; i < source.vertexCount; i++)
+        {
+            aabbMin = glm::min(aabbMin, source.positions[i]);
+            aabbMax = glm::max(aabbMax, source.positions[i]);
+        }
+    }
+
+    vec3 positionOffset = vec3(0.f);
+    vec3 aabbExtent = vec3(1.f);
+    if (quantized)
+    {
+        positionOffset = aabbMin;
+        aabbExtent = aabbMax - aabbMin;
+        for (int c = 0; c < 3; ++c)
+            if (aabbExtent[c] <= 0.f) aabbExtent[c] = 1.f;
+    }
+
+    // Triangle order for the post-transform cache and overdraw, then vertex order for fetch locality
+    std::vector<u32>& faceIndices = source.indices;
+    std::vector<u32> vertexOrder(source.vertexCount);
+    for (u32 i = 0; i < source.vertexCount; i++) vertexOrder[i] = i;
+
+    // Before the reordering, the face indices still point to the source vertices
+    float uvDensity = 0.f;
+    if (source.triangles && hasTexCoords)
+        uvDensity = ComputeUvDensity(source.positions, (const u8*)source.texCoords, sizeof(vec3), (const u8*)faceIndices.data(), GL_UNSIGNED_INT, faceIndices.size());
+
+    if (source.triangles)
+    {
+        const VertexCacheStats before = AnalyzeVertexCache(faceIndices.data(), faceIndices.size(), source.vertexCount);
+
+        OptimizeVertexCache(faceIndices, source.vertexCount);
+        OptimizeOverdraw(faceIndices, source.positions, source.vertexCount);
+        OptimizeVertexFetch(faceIndices, source.vertexCount, vertexOrder);
+
+        const VertexCacheStats after = AnalyzeVertexCache(faceIndices.data(), faceIndices.size(), source.vertexCount);
+        ILOG("%s mesh %u: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", myModel.path.c_str(), (u32)myModel.meshes.size(), before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+
+    std::vector<vec3> positions(source.vertexCount);
+    for (u32 i = 0; i < source.vertexCount; i++)
+        positions[i] = source.positions[vertexOrder[i]];
+
+    // process vertices, in the optimized order
+    for (u32 n = 0; n < source.vertexCount; n++)
+    {
+        const u32 i = vertexOrder[n];
+        vec3 position = source.positions[i];
+        vec3 normal = source.normals[i];
+        vec3 tangent = vec3(0.f);
+        vec3 bitangent = vec3(0.f);
+
+        if (hasTangentSpace)
+        {
+            tangent = source.tangents[i];
+
+            // For some reason ASSIMP gives me the bitangents flipped.
+            // Maybe it's my fault, but when I generate my own geometry
+            // in other files (see the generation of standard assets)
+            // and all the bitangents have the orientation I expect,
+            // everything works ok.
+            // I think that (even if the documentation says the opposite)
+            // it returns a left-handed tangent space matrix.
+            // SOLUTION: I invert the components of the bitangent here.
+            bitangent = -source.bitangents[i];
+        }
+
+        if (!quantized)
+        {
+            WriteVertexValue(vertices, position);
+            WriteVertexValue(vertices, normal);
+            if (hasTexCoords) WriteVertexValue(vertices, vec2(source.texCoords[i].x, source.texCoords[i].y));
+            if (hasTangentSpace)
+            {
+                WriteVertexValue(vertices, tangent);
+                WriteVertexValue(vertices, bitangent);
+            }
+            continue;
+        }
+
+        vec3 local = (position - positionOffset) / aabbExtent;
+        WriteVertexValue<u16>(vertices, QuantizeUnorm16(local.x));
+        WriteVertexValue<u16>(vertices, QuantizeUnorm16(local.y));
+        WriteVertexValue<u16>(vertices, QuantizeUnorm16(local.z));
+        WriteVertexValue<i16>(vertices, glm::dot(glm::cross(normal, tangent), bitangent) < 0.f ? -32767 : 32767);
+
+        WriteOctahedralSnorm16(vertices, normal);
+        if (hasTexCoords) WriteHalf2(vertices, source.texCoords[i].x, source.texCoords[i].y);
+        if (hasTangentSpace) WriteOctahedralSnorm16(vertices, tangent);
+    }
+
+    // process indices
+    const u32 indexCount = faceIndices.size();
+    for (u32 i = 0; i < indexCount; i++)
+    {
+        if (shortIndices) ((u16*)indices)[i] = (u16)faceIndices[i];
+        else ((u32*)indices)[i] = faceIndices[i];
+    }
+
+    // store the proper (previously proceessed) material for this mesh
+    myModel.meshMaterials.emplace_back(source.materialIndex);
+
+    // create the vertex format
+    VertexBufferLayout vertexBufferLayout = {};
+    if (!quantized)
+    {
+        vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(0, 3));
+        vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(1, 3));
+        if (hasTexCoords) vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(2, 2));
+        if (hasTangentSpace)
+        {
+            vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(3, 3));
+            vertexBufferLayout.AddAttribute<float>(new VertexBufferAttribute(4, 3));
+        }
+    }
+    else
+    {
+        vertexBufferLayout.AddAttribute<u16>(new VertexBufferAttribute(0, 3, GL_UNSIGNED_SHORT, true));
+        vertexBufferLayout.AddAttribute<i16>(new VertexBufferAttribute(4, 1, GL_SHORT, true));
+        vertexBufferLayout.AddAttribute<i16>(new VertexBufferAttribute(1, 2, GL_SHORT, true));
+        if (hasTexCoords) vertexBufferLayout.AddAttribute<u16>(new VertexBufferAttribute(2, 2, GL_HALF_FLOAT));
+        if (hasTangentSpace) vertexBufferLayout.AddAttribute<i16>(new VertexBufferAttribute(3, 2, GL_SHORT, true));
+    }
+
+    vertexBufferLayout.Bound();
+    assert(vertexBufferLayout.stride == MeshVertexStride(source, format));
+
+
+    // add the submesh into the mesh
+    Mesh* m = new Mesh();
+    m->vertexBufferLayout = vertexBufferLayout;
+    m->vertexOffset = myModel.vertexBytes;
+    m->vertexBytes = source.vertexCount * vertexBufferLayout.stride;
+    m->indexsOffset = myModel.indexBytes;
+    m->indexCount = indexCount;
+    m->indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    m->positionOffset = positionOffset;
+    m->positionScale = aabbExtent;
+    m->octahedralNormals = quantized;
+    m->uvDensity = uvDensity;
+    BuildMeshlets(positions.data(), source.vertexCount, indices, m->indexType, indexCount, m->meshlets);
+
+    m->boundsCenter = (aabbMin + aabbMax) * 0.5f;
+    for (std::vector<vec3>::const_iterator it = positions.begin(); it != positions.end(); ++it)
+        m->boundsRadius = glm::max(m->boundsRadius, glm::length((*it) - m->boundsCenter));
+
+    if (source.triangles) BuildMeshLods(positions, faceIndices, m, myModel);
+    myModel.meshes.emplace_back(m);
+
+    myModel.vertexBytes += m->vertexBytes;
+    myModel.indexBytes += MeshIndexBytes(indexCount, source.vertexCount);
+}
+
+// Appends the LOD ranges after every full detail range and points the import at its streams
+void FinishModelImportStreams(ModelImport& import)
+{
+    const u32 lodBase = import.indexStream.size();
+    import.indexStream.insert(import.indexStream.end(), import.lodStream.begin(), import.lodStream.end());
+    import.indexBytes = import.indexStream.size();
+    std::vector<u8>().swap(import.lodStream);
+    for (std::vector<Mesh*>::iterator it = import.meshes.begin(); it != import.meshes.end(); ++it)
+        for (std::vector<MeshLod>::iterator lt = (*it)->lods.begin(); lt != (*it)->lods.end(); ++lt)
+            lt->indexsOffset += lodBase;
+
+    import.vertexData = import.vertexStream.data();
+    import.indexData = import.indexStream.data();
+}
@@ -0,0 +1,192 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "platform.h"
+#include "Typedef.h"
+
+// Quadric error metric simplification through half-edge collapses: a vertex is always collapsed
+// onto one of its neighbours, so simplified index lists keep using the original vertex buffer.
+// Vertices on open borders and on attribute seams (several vertices sharing a position) are locked,
+// which keeps silhouettes and UV/normal seams crack-free at the cost of some reduction.
+
+struct Quadric
+{
+    // Symmetric 4x4 matrix, upper triangle
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+
+    void AddPlane(double a, double b, double c, double d, double weight)
+    {
+        a00 += weight * a * a; a01 += weight * a * b; a02 += weight * a * c; a03 += weight * a * d;
+        a11 += weight * b * b; a12 += weight * b * c; a13 += weight * b * d;
+        a22 += weight * c * c; a23 += weight * c * d;
+        a33 += weight * d * d;
+    }
+
+    void Add(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+    }
+
+    double Error(const vec3& p) const
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        return a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+             + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+             + a22 * z * z + 2 * a23 * z
+             + a33;
+    }
+};
+
+struct EdgeCollapse
+{
+    u32 from;
+    u32 to;
+    double cost;
+};
+
+inline u64 EdgeKey(u32 a, u32 b)
+{
+    return a < b ? ((u64)a << 32) | b : ((u64)b << 32) | a;
+}
+
+// Writes into `result` a triangle list of about targetIndexCount indices (never more than the input).
+// It stops earlier when every remaining collapse would flip a triangle or move a locked vertex.
+inline void SimplifyMesh(const vec3* positions, u32 vertexCount, const std::vector<u32>& indices, u32 targetIndexCount, std::vector<u32>& result)
+{
+    result = indices;
+    if (indices.size() <= targetIndexCount || vertexCount == 0) return;
+
+    // Lock seam vertices (same position as another vertex) and open border vertices
+    std::vector<u8> locked(vertexCount, 0);
+    {
+        std::unordered_map<u64, u32> firstAtPosition;
+        firstAtPosition.reserve(vertexCount);
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            const u32* bits = (const u32*)&positions[v];
+            const u64 key = ((u64)bits[0] * 73856093ull) ^ ((u64)bits[1] * 19349663ull) ^ ((u64)bits[2] * 83492791ull);
+            std::unordered_map<u64, u32>::iterator it = firstAtPosition.find(key);
+            if (it == firstAtPosition.end()) firstAtPosition[key] = v;
+            else if (positions[it->second] == positions[v]) locked[v] = locked[it->second] = 1;
+        }
+
+        std::unordered_map<u64, u32> edgeUses;
+        edgeUses.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (u32 e = 0; e < 3; ++e)
+                edgeUses[EdgeKey(indices[i + e], indices[i + (e + 1) % 3])]++;
+
+        for (std::unordered_map<u64, u32>::iterator it = edgeUses.begin(); it != edgeUses.end(); ++it)
+        {
+            if (it->second != 1) continue;
+            locked[(u32)(it->first >> 32)] = 1;
+            locked[(u32)(it->first & 0xffffffff)] = 1;
+        }
+    }
+
+    // Area weighted plane quadrics
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const vec3& p0 = positions[indices[i]];
+        const vec3& p1 = positions[indices[i + 1]];
+        const vec3& p2 = positions[indices[i + 2]];
+        vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float area = glm::length(n);
+        if (area <= 0.f) continue;
+        n /= area;
+
+        const double d = -glm::dot(n, p0);
+        for (u32 k = 0; k < 3; ++k)
+            quadrics[indices[i + k]].AddPlane(n.x, n.y, n.z, d, area);
+    }
+
+    std::vector<u32> remap(vertexCount);
+    std::vector<u8> touched(vertexCount);
+    std::vector<std::vector<u32>> vertexTriangles(vertexCount);
+    std::vector<EdgeCollapse> collapses;
+
+    while (result.size() > targetIndexCount)
+    {
+        // Adjacency of the current triangles
+        for (u32 v = 0; v < vertexCount; ++v) vertexTriangles[v].clear();
+        for (u32 t = 0; t < result.size() / 3; ++t)
+            for (u32 k = 0; k < 3; ++k)
+                vertexTriangles[result[t * 3 + k]].push_back(t);
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (u32 e = 0; e < 3; ++e)
+            {
+                const u32 a = result[i + e];
+                const u32 b = result[i + (e + 1) % 3];
+                if (!locked[a]) { EdgeCollapse c = { a, b, quadrics[a].Error(positions[b]) }; collapses.push_back(c); }
+                if (!locked[b]) { EdgeCollapse c = { b, a, quadrics[b].Error(positions[a]) }; collapses.push_back(c); }
+            }
+        }
+        if (collapses.empty()) break;
+
+        std::sort(collapses.begin(), collapses.end(), [](const EdgeCollapse& l, const EdgeCollapse& r) { return l.cost < r.cost; });
+
+        for (u32 v = 0; v < vertexCount; ++v) remap[v] = v;
+        std::fill(touched.begin(), touched.end(), 0);
+
+        // Each collapse removes about two triangles
+        const u32 trianglesToRemove = (u32)(result.size() - targetIndexCount) / 3;
+        u32 applied = 0;
+        for (std::vector<EdgeCollapse>::iterator it = collapses.begin(); it != collapses.end() && applied * 2 < trianglesToRemove; ++it)
+        {
+            if (touched[it->from] || touched[it->to]) continue;
+
+            // Reject the collapse if it flips any remaining triangle around the removed vertex
+            bool flips = false;
+            for (u32 t : vertexTriangles[it->from])
+            {
+                const u32* tri = &result[t * 3];
+                if (tri[0] == it->to || tri[1] == it->to || tri[2] == it->to) continue;
+
+                vec3 p[3], q[3];
+                for (u32 k = 0; k < 3; ++k)
+                {
+                    p[k] = positions[tri[k]];
+                    q[k] = tri[k] == it->from ? positions[it->to] : p[k];
+                }
+                const vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                const vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                if (glm::dot(before, after) <= 0.f) { flips = true; break; }
+            }
+            if (flips) continue;
+
+            // Neighbours of both ends can't collapse again in this pass, their adjacency is stale
+            for (u32 t : vertexTriangles[it->from])
+                for (u32 k = 0; k < 3; ++k) touched[result[t * 3 + k]] = 1;
+            for (u32 t : vertexTriangles[it->to])
+                for (u32 k = 0; k < 3; ++k) touched[result[t * 3 + k]] = 1;
+
+            remap[it->from] = it->to;
+            quadrics[it->to].Add(quadrics[it->from]);
+            applied++;
+        }
+        if (applied == 0) break;
+
+        // Rewrite the triangles, dropping the degenerate ones
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            const u32 a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a == b || b == c || a == c) continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+}
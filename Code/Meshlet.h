@@ -0,0 +1,153 @@
+#pragma once
+#include <vector>
+#include <glad/glad.h>
+#include "platform.h"
+#include "Typedef.h"
+
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+
+// Cluster of consecutive triangles of a submesh index range.
+// The bounds are in mesh (object) space.
+struct Meshlet
+{
+    u32 firstIndex;    // Relative to the submesh index range
+    u32 triangleCount;
+    vec3 center;
+    float radius;
+    vec3 coneAxis;
+    float coneCutoff;  // 1 means the cone is too wide to ever be back-facing
+};
+
+// Splits an indexed triangle list into meshlets in its current triangle order, so every meshlet
+// is a contiguous index range (no index reordering needed for drawing them).
+inline void BuildMeshlets(const vec3* positions, u32 vertexCount, const u8* indices, GLenum indexType, u32 indexCount, std::vector<Meshlet>& meshlets)
+{
+    meshlets.clear();
+    if (indexCount < 3) return;
+
+    const u32 triangleCount = indexCount / 3;
+    std::vector<u32> vertexStamp(vertexCount, UINT32_MAX);
+    std::vector<u32> meshletVertices;
+    meshletVertices.reserve(MESHLET_MAX_VERTICES);
+
+    Meshlet meshlet = {};
+    u32 stamp = 0;
+
+    auto Index = [indices, indexType](u32 i) -> u32
+    {
+        return indexType == GL_UNSIGNED_SHORT ? ((const u16*)indices)[i] : ((const u32*)indices)[i];
+    };
+
+    auto Close = [&]()
+    {
+        // Bounding sphere: center of the AABB, radius to the farthest vertex
+        vec3 aabbMin = positions[meshletVertices[0]];
+        vec3 aabbMax = aabbMin;
+        for (u32 v : meshletVertices)
+        {
+            aabbMin = glm::min(aabbMin, positions[v]);
+            aabbMax = glm::max(aabbMax, positions[v]);
+        }
+        meshlet.center = (aabbMin + aabbMax) * 0.5f;
+        meshlet.radius = 0.f;
+        for (u32 v : meshletVertices)
+            meshlet.radius = glm::max(meshlet.radius, glm::length(positions[v] - meshlet.center));
+
+        // Normal cone: average triangle normal and the widest deviation from it
+        std::vector<vec3> normals(meshlet.triangleCount);
+        vec3 axis = vec3(0.f);
+        for (u32 t = 0; t < meshlet.triangleCount; ++t)
+        {
+            const u32 base = meshlet.firstIndex + t * 3;
+            const vec3 a = positions[Index(base)], b = positions[Index(base + 1)], c = positions[Index(base + 2)];
+            const vec3 n = glm::cross(b - a, c - a);
+            const float length = glm::length(n);
+            normals[t] = length > 0.f ? n / length : vec3(0.f);
+            axis += normals[t];
+        }
+
+        const float axisLength = glm::length(axis);
+        meshlet.coneAxis = axisLength > 0.f ? axis / axisLength : vec3(0.f, 0.f, 1.f);
+
+        float minDot = 1.f;
+        for (const vec3& n : normals)
+            minDot = glm::min(minDot, glm::dot(n, meshlet.coneAxis));
+
+        // Cones wider than ~84 degrees are never fully back-facing
+        meshlet.coneCutoff = axisLength > 0.f && minDot > 0.1f ? glm::sqrt(1.f - minDot * minDot) : 1.f;
+
+        meshlets.push_back(meshlet);
+        meshletVertices.clear();
+        stamp++;
+    };
+
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        const u32 tri[3] = { Index(t * 3), Index(t * 3 + 1), Index(t * 3 + 2) };
+
+        u32 newVertices = 0;
+        for (u32 k = 0; k < 3; ++k)
+            if (vertexStamp[tri[k]] != stamp && (k == 0 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1])) newVertices++;
+
+        if (meshlet.triangleCount > 0 &&
+            (meshletVertices.size() + newVertices > MESHLET_MAX_VERTICES || meshlet.triangleCount + 1 > MESHLET_MAX_TRIANGLES))
+        {
+            Close();
+            meshlet = {};
+            meshlet.firstIndex = t * 3;
+        }
+
+        for (u32 k = 0; k < 3; ++k)
+        {
+            if (vertexStamp[tri[k]] == stamp) continue;
+            vertexStamp[tri[k]] = stamp;
+            meshletVertices.push_back(tri[k]);
+        }
+        meshlet.triangleCount++;
+    }
+
+    Close();
+}
+
+// Frustum planes and camera position in the object space of one draw
+struct MeshletCuller
+{
+    vec4 planes[6];
+    vec3 cameraPosition;
+
+    // clip = projection * view * world
+    void Setup(const glm::mat4& clip, const glm::mat4& world, vec3 worldCameraPosition)
+    {
+        const glm::mat4 m = glm::transpose(clip);
+        planes[0] = m[3] + m[0]; // left
+        planes[1] = m[3] - m[0]; // right
+        planes[2] = m[3] + m[1]; // bottom
+        planes[3] = m[3] - m[1]; // top
+        planes[4] = m[3] + m[2]; // near
+        planes[5] = m[3] - m[2]; // far
+        for (u32 i = 0; i < 6; ++i)
+            planes[i] /= glm::length(vec3(planes[i]));
+
+        cameraPosition = vec3(glm::inverse(world) * vec4(worldCameraPosition, 1.f));
+    }
+
+    bool SphereVisible(const vec3& center, float radius) const
+    {
+        for (u32 i = 0; i < 6; ++i)
+            if (glm::dot(vec3(planes[i]), center) + planes[i].w < -radius) return false;
+        return true;
+    }
+
+    // The cone test assumes a uniform scale in the world matrix
+    bool Visible(const Meshlet& meshlet) const
+    {
+        if (!SphereVisible(meshlet.center, meshlet.radius)) return false;
+
+        const vec3 toCenter = meshlet.center - cameraPosition;
+        const float distance = glm::length(toCenter);
+        if (glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * distance + meshlet.radius) return false;
+
+        return true;
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <math.h>
+#include <string.h>
+#include "platform.h"
+#include "TextureCompression.h"
+
+// Mip chains are filtered on the CPU when textures are cooked, so every level is known before the upload.
+// The chain is kept in linear light as floats (one RGBA texel per SSE register): color textures are decoded
+// from sRGB once, every level is the 2x2 box average of the previous one, and each level is encoded back
+// to 8 bits on its own, so the rounding of a level never feeds the next one. Alpha and data textures
+// (normal maps) are filtered as they are.
+
+struct SrgbTables
+{
+    f32 toLinear[256];
+    u8  toSrgb[4096]; // Indexed by the linear value quantized to 12 bits
+
+    SrgbTables()
+    {
+        for (u32 i = 0; i < 256; ++i)
+        {
+            const f32 c = i / 255.f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (u32 i = 0; i < 4096; ++i)
+        {
+            const f32 l = i / 4095.f;
+            const f32 c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.f / 2.4f) - 0.055f;
+            toSrgb[i] = (u8)(c * 255.f + 0.5f);
+        }
+    }
+};
+
+// Built on first use, safe from any thread
+inline const SrgbTables& GetSrgbTables()
+{
+    static const SrgbTables tables;
+    return tables;
+}
+
+inline void LinearizeRgba(const u8* rgba, u64 count, bool srgb, f32* linear)
+{
+    const f32* table = GetSrgbTables().toLinear;
+    for (u64 i = 0; i < count * 4; i += 4)
+    {
+        for (u32 c = 0; c < 3; ++c)
+            linear[i + c] = srgb ? table[rgba[i + c]] : rgba[i + c] / 255.f;
+        linear[i + 3] = rgba[i + 3] / 255.f;
+    }
+}
+
+inline void EncodeLinearRgba(const f32* linear, u64 count, bool srgb, u8* rgba)
+{
+    const u8* table = GetSrgbTables().toSrgb;
+#ifdef BLOCK_COMPRESSION_SSE2
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), half = _mm_set1_ps(0.5f);
+    const __m128 scale = srgb ? _mm_setr_ps(4095.f, 4095.f, 4095.f, 255.f) : _mm_set1_ps(255.f);
+    for (u64 i = 0; i < count; ++i)
+    {
+        const __m128 texel = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(linear + i * 4), zero), one);
+        i32 q[4];
+        _mm_storeu_si128((__m128i*)q, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(texel, scale), half)));
+        for (u32 c = 0; c < 3; ++c)
+            rgba[i * 4 + c] = srgb ? table[q[c]] : (u8)q[c];
+        rgba[i * 4 + 3] = (u8)q[3];
+    }
+#else
+    for (u64 i = 0; i < count * 4; i += 4)
+    {
+        for (u32 c = 0; c < 4; ++c)
+        {
+            const f32 value = fminf(fmaxf(linear[i + c], 0.f), 1.f);
+            rgba[i + c] = srgb && c < 3 ? table[(u32)(value * 4095.f + 0.5f)] : (u8)(value * 255.f + 0.5f);
+        }
+    }
+#endif
+}
+
+inline u32 MipSize(u32 size)
+{
+    return size > 1 ? size / 2 : 1;
+}
+
+inline u32 MipLevelCount(u32 width, u32 height)
+{
+    u32 levels = 1;
+    for (u32 size = width > height ? width : height; size > 1; size >>= 1) levels++;
+    return levels;
+}
+
+// Next level of a linear chain, averaging 2x2 texels (a 1 texel wide side stays 1 texel wide)
+inline void DownsampleLinearScalar(const f32* src, u32 width, u32 height, f32* dst)
+{
+    const u32 dstWidth = MipSize(width), dstHeight = MipSize(height);
+    const u32 dx = width > 1 ? 1 : 0;
+    const u64 dy = height > 1 ? width : 0;
+    for (u32 y = 0; y < dstHeight; ++y)
+    {
+        const f32* row = src + (u64)(height > 1 ? y * 2 : 0) * width * 4;
+        for (u32 x = 0; x < dstWidth; ++x)
+        {
+            const f32* texel = row + (u64)(width > 1 ? x * 2 : 0) * 4;
+            for (u32 c = 0; c < 4; ++c)
+                dst[((u64)y * dstWidth + x) * 4 + c] = (texel[c] + texel[dx * 4 + c] + texel[dy * 4 + c] + texel[(dy + dx) * 4 + c]) * 0.25f;
+        }
+    }
+}
+
+inline void DownsampleLinear(const f32* src, u32 width, u32 height, f32* dst)
+{
+#ifdef BLOCK_COMPRESSION_SSE2
+    const u32 dstWidth = MipSize(width), dstHeight = MipSize(height);
+    const u32 dx = width > 1 ? 4 : 0;
+    const u64 dy = height > 1 ? (u64)width * 4 : 0;
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for (u32 y = 0; y < dstHeight; ++y)
+    {
+        const f32* row = src + (u64)(height > 1 ? y * 2 : 0) * width * 4;
+        f32* out = dst + (u64)y * dstWidth * 4;
+        for (u32 x = 0; x < dstWidth; ++x)
+        {
+            const f32* texel = row + (u64)(width > 1 ? x * 2 : 0) * 4;
+            const __m128 top = _mm_add_ps(_mm_loadu_ps(texel), _mm_loadu_ps(texel + dx));
+            const __m128 bottom = _mm_add_ps(_mm_loadu_ps(texel + dy), _mm_loadu_ps(texel + dy + dx));
+            _mm_storeu_ps(out + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+        }
+    }
+#else
+    DownsampleLinearScalar(src, width, height, dst);
+#endif
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+#include <string>
+#include "Mesh.h"
+#include "Program.h"
+
+// Geometry and materials of a model file, shared by every Model placed from it.
+// It is owned by the App registry and lives while at least one Model references it.
+class ModelAsset
+{
+public:
+
+	unsigned int FindVAO(unsigned int index, const Program* program)
+	{
+		Mesh* mesh = meshes[index];
+
+		unsigned int size = mesh->vaos.size();
+		for (unsigned int i = 0; i < size; ++i)
+		{
+			if (mesh->vaos[i].program == program->handle)
+				return mesh->vaos[i].handle;
+		}
+
+		// Create new vao for this mesh/program
+		unsigned int vaoHandle = CreateNewVao(program, mesh);
+
+		// Store it in the list of vaos for this mesh
+		mesh->vaos.emplace_back(Vao(vaoHandle, program->handle));
+
+		return vaoHandle;
+	}
+
+	unsigned int CreateNewVao(const Program* program, Mesh* mesh)
+	{
+		GLuint vaoHandle = 0;
+		glGenVertexArrays(1, &vaoHandle);
+		glBindVertexArray(vaoHandle);
+
+		glBindBuffer(GL_ARRAY_BUFFER, vertexHandle);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexHandle);
+
+		for (VertexShaderLayout::const_iterator it = program->attributes.begin(); it != program->attributes.end(); ++it)
+		{
+			bool attributeWasLinked = false;
+
+			for (std::vector<VertexBufferAttribute*>::const_iterator ot = mesh->vertexBufferLayout.attributes.begin(); ot != mesh->vertexBufferLayout.attributes.end(); ++ot)
+			{
+				if ((*it)->location != (*ot)->location) continue;
+
+				const unsigned int index = (*ot)->location;
+				const unsigned int ncomp = (*ot)->componentCount;
+				const unsigned int offset = (*ot)->offset + vertexBase + mesh->vertexOffset;
+				const unsigned int stride = (*ot)->stride ? (*ot)->stride : mesh->vertexBufferLayout.stride;
+
+				const GLenum type = (*ot)->type;
+				const GLboolean normalized = (*ot)->normalized ? GL_TRUE : GL_FALSE;
+
+				glVertexAttribPointer(index, ncomp, type, normalized, stride, (void*)(u64)offset);
+				glEnableVertexAttribArray(index);
+
+				attributeWasLinked = true;
+				break;
+			}
+
+			assert(attributeWasLinked);
+		}
+
+		glBindVertexArray(0);
+
+		return vaoHandle;
+	}
+
+public:
+
+	std::string path;
+
+	// Ranges suballocated in the App geometry arena: handle of the shared buffer,
+	// arena allocation and base offset of the streams (mesh offsets are relative to it)
+	GLuint vertexHandle = 0;
+	GLuint indexHandle = 0;
+	unsigned int vertexAllocation = UINT32_MAX;
+	unsigned int indexAllocation = UINT32_MAX;
+	unsigned int vertexBase = 0;
+	unsigned int indexBase = 0;
+
+	std::vector<Mesh*> meshes;
+	std::vector<unsigned int> materials;
+
+	// Bounding sphere of all the meshes in object space, for LOD selection
+	glm::vec3 boundsCenter = glm::vec3(0.f);
+	float boundsRadius = 0.f;
+
+	// Range of app->materials created for this asset
+	unsigned int baseMaterial = 0;
+	unsigned int materialCount = 0;
+
+	// Number of Models placed from this asset
+	unsigned int references = 0;
+
+	// Keep cpu copies of the mesh data after upload (see Mesh::vertexs/indexs)
+	bool cpuReadable = false;
+
+	// Asynchronous imports: not drawn until resident, freed by the upload queue once orphaned
+	bool resident = false;
+	bool failed = false;
+	bool orphaned = false;
+
+};
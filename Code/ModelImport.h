@@ -0,0 +1,96 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <stb_image.h>
+#include "platform.h"
+#include "Typedef.h"
+#include "Image.h"
+#include "Flag.h"
+#include "Mesh.h"
+#include "VertexFormat.h"
+
+// Cpu side result of reading a model file (through an importer or from its cooked version).
+// It never touches OpenGL, so it can be produced on any thread and handed to the GL thread
+// that creates the ModelAsset and uploads the streams.
+
+enum CookedTextureSlot
+{
+    CTS_DIFFUSE,
+    CTS_SPECULAR,
+    CTS_EMISSIVE,
+    CTS_NORMALS,
+    CTS_BUMP,
+    CTS_COUNT
+};
+
+struct ImportedMaterial
+{
+    std::string name;
+    Flag properties;
+    vec3 diffuse = vec3(1.f);
+    vec3 emissive = vec3(1.f);
+    vec3 specular = vec3(0.5f);
+    float shininess = 32;
+
+    // Texture paths, empty if the slot is not used
+    std::string textures[CTS_COUNT];
+
+    // Decoded ahead of time by asynchronous imports, null pixels otherwise
+    Image images[CTS_COUNT] = {};
+};
+
+struct ModelImport
+{
+    std::string path;
+    // Other files the import read (material libraries, external buffers), a cooked version checks them too
+    std::vector<std::string> dependencies;
+
+    // Submeshes, their offsets are relative to the vertex/index streams below
+    std::vector<Mesh*> meshes;
+    // Per submesh material, relative to the materials of this import
+    std::vector<u32> meshMaterials;
+    std::vector<ImportedMaterial> materials;
+
+    // Final gpu streams, pointing either to the owned vectors or into the file mapping (cooked file or GLB)
+    const u8* vertexData = nullptr;
+    u32       vertexBytes = 0;
+    const u8* indexData = nullptr;
+    u32       indexBytes = 0;
+
+    std::vector<u8> vertexStream;
+    std::vector<u8> indexStream;
+    // Simplified index ranges, appended to indexStream once every mesh is processed
+    std::vector<u8> lodStream;
+    MappedFile      mapping = {};
+
+    VertexFormat vertexFormat = VF_QUANTIZED;
+
+    bool fromCache = false;
+    // The streams are ranges of the source file (GLB), there is nothing to cook
+    bool zeroCopy = false;
+};
+
+// Releases everything still owned by the import, except the meshes handed to an asset
+void FreeModelImport(ModelImport& import)
+{
+    for (std::vector<Mesh*>::iterator it = import.meshes.begin(); it != import.meshes.end(); ++it)
+        delete (*it);
+    import.meshes.clear();
+
+    for (std::vector<ImportedMaterial>::iterator it = import.materials.begin(); it != import.materials.end(); ++it)
+    {
+        for (u32 i = 0; i < CTS_COUNT; ++i)
+        {
+            if (it->images[i].pixels) stbi_image_free(it->images[i].pixels);
+            it->images[i] = {};
+        }
+    }
+
+    std::vector<u8>().swap(import.vertexStream);
+    std::vector<u8>().swap(import.indexStream);
+    std::vector<u8>().swap(import.lodStream);
+    UnmapFile(import.mapping);
+
+    import.vertexData = nullptr;
+    import.indexData = nullptr;
+}
@@ -0,0 +1,286 @@
+#pragma once
+#include <string.h>
+#include <ctype.h>
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/cfileio.h>
+#include "ModelImport.h"
+#include "MeshCache.h"
+#include "VertexFormat.h"
+#include "MeshProcessing.h"
+#include "ObjLoading.h"
+#include "GltfLoading.h"
+
+// Cpu side of model loading: reads a source model (Assimp, native OBJ or in place GLB), or its cooked
+// version, into a ModelImport. Nothing here touches OpenGL or the App, so the asset cooker builds it too.
+
+u32 AssimpIndexCount(const aiMesh* mesh)
+{
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) return mesh->mNumFaces * 3;
+
+    u32 count = 0;
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        count += mesh->mFaces[i].mNumIndices;
+    return count;
+}
+
+// Sums the exact stream sizes of every mesh reached from the node, in processing order
+void MeasureAssimpNode(const aiScene* scene, const aiNode* node, VertexFormat format, u32& vertexBytes, u32& indexBytes)
+{
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    {
+        const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        vertexBytes += mesh->mNumVertices * MeshVertexStride(mesh->mTextureCoords[0] != nullptr, mesh->mTangents != nullptr && mesh->mBitangents, format);
+        indexBytes += MeshIndexBytes(AssimpIndexCount(mesh), mesh->mNumVertices);
+    }
+
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+        MeasureAssimpNode(scene, node->mChildren[i], format, vertexBytes, indexBytes);
+}
+
+void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, ModelImport& myModel, VertexFormat format)
+{
+    MeshSource source;
+    source.vertexCount = mesh->mNumVertices;
+    source.positions = (const vec3*)mesh->mVertices;
+    source.normals = (const vec3*)mesh->mNormals;
+    source.texCoords = (const vec3*)mesh->mTextureCoords[0];
+    if (mesh->mTangents && mesh->mBitangents)
+    {
+        source.tangents = (const vec3*)mesh->mTangents;
+        source.bitangents = (const vec3*)mesh->mBitangents;
+    }
+    source.materialIndex = mesh->mMaterialIndex;
+    source.triangles = mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE;
+
+    source.indices.reserve(AssimpIndexCount(mesh));
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        source.indices.insert(source.indices.end(), mesh->mFaces[i].mIndices, mesh->mFaces[i].mIndices + mesh->mFaces[i].mNumIndices);
+
+    ProcessMeshSource(source, myModel, format);
+}
+
+void ProcessAssimpTexture(aiMaterial* material, aiTextureType type, const std::string& directory, std::string& filepath)
+{
+    aiString aiFilename;
+    material->GetTexture(type, 0, &aiFilename);
+    filepath = directory + "/" + aiFilename.C_Str();
+}
+
+void ProcessAssimpMaterial(aiMaterial* material, ImportedMaterial& myMaterial, const std::string& directory)
+{
+    aiString name;
+    aiColor3D diffuseColor;
+    aiColor3D emissiveColor;
+    aiColor3D specularColor;
+    ai_real shininess;
+    material->Get(AI_MATKEY_NAME, name);
+    material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuseColor);
+    material->Get(AI_MATKEY_COLOR_EMISSIVE, emissiveColor);
+    material->Get(AI_MATKEY_COLOR_SPECULAR, specularColor);
+    material->Get(AI_MATKEY_SHININESS, shininess);
+
+    myMaterial.name = name.C_Str();
+    myMaterial.diffuse = vec3(diffuseColor.r, diffuseColor.g, diffuseColor.b);
+    myMaterial.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
+    myMaterial.shininess = shininess / 256.0f;
+
+    if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+    {
+        ProcessAssimpTexture(material, aiTextureType_DIFFUSE, directory, myMaterial.textures[CTS_DIFFUSE]);
+        myMaterial.properties.Set(aiTextureType_DIFFUSE, true);
+    }
+    if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
+    {
+        ProcessAssimpTexture(material, aiTextureType_SPECULAR, directory, myMaterial.textures[CTS_SPECULAR]);
+        myMaterial.properties.Set(aiTextureType_EMISSIVE, true);
+
+    }
+    if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
+    {
+        ProcessAssimpTexture(material, aiTextureType_EMISSIVE, directory, myMaterial.textures[CTS_EMISSIVE]);
+        myMaterial.properties.Set(aiTextureType_EMISSIVE, true);
+    }
+    if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
+    {
+        ProcessAssimpTexture(material, aiTextureType_NORMALS, directory, myMaterial.textures[CTS_NORMALS]);
+        myMaterial.properties.Set(aiTextureType_NORMALS, true);
+    }
+    if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
+    {
+        ProcessAssimpTexture(material, aiTextureType_HEIGHT, directory, myMaterial.textures[CTS_BUMP]);
+        myMaterial.properties.Set(aiTextureType_HEIGHT, true);
+    }
+
+    //myMaterial.createNormalFromBump();
+}
+
+void ProcessAssimpNode(const aiScene* scene, aiNode* node, ModelImport& myModel, VertexFormat format)
+{
+    // process all the node's meshes (if any)
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    {
+        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        ProcessAssimpMesh(scene, mesh, myModel, format);
+    }
+
+    // then do the same for each of its children
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        ProcessAssimpNode(scene, node->mChildren[i], myModel, format);
+    }
+}
+
+// Assimp reads the model (and the files it references, like OBJ materials) through MapFile(),
+// so the ones in the mounted asset pack never touch the disk
+struct AssimpMappedFile
+{
+    aiFile file;
+    MappedFile mapping;
+    size_t cursor;
+};
+
+size_t AssimpMappedRead(aiFile* file, char* buffer, size_t size, size_t count)
+{
+    AssimpMappedFile* mapped = (AssimpMappedFile*)file->UserData;
+    if (size == 0) return 0;
+
+    count = glm::min(count, (size_t)(mapped->mapping.size - mapped->cursor) / size);
+    memcpy(buffer, mapped->mapping.data + mapped->cursor, count * size);
+    mapped->cursor += count * size;
+    return count;
+}
+
+size_t AssimpMappedWrite(aiFile*, const char*, size_t, size_t)
+{
+    return 0;
+}
+
+size_t AssimpMappedTell(aiFile* file)
+{
+    return ((AssimpMappedFile*)file->UserData)->cursor;
+}
+
+size_t AssimpMappedSize(aiFile* file)
+{
+    return ((AssimpMappedFile*)file->UserData)->mapping.size;
+}
+
+aiReturn AssimpMappedSeek(aiFile* file, size_t offset, aiOrigin origin)
+{
+    AssimpMappedFile* mapped = (AssimpMappedFile*)file->UserData;
+    const size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? mapped->cursor : mapped->mapping.size;
+    if (base + offset > mapped->mapping.size) return aiReturn_FAILURE;
+
+    mapped->cursor = base + offset;
+    return aiReturn_SUCCESS;
+}
+
+void AssimpMappedFlush(aiFile*)
+{
+}
+
+// The user data of the io is the dependency list of the import, every file Assimp asks for goes there (found or not)
+aiFile* AssimpMappedOpen(aiFileIO* io, const char* path, const char* mode)
+{
+    if (strchr(mode, 'w') || strchr(mode, 'a')) return nullptr;
+    if (io->UserData) ((std::vector<std::string>*)io->UserData)->push_back(path);
+
+    MappedFile mapping = MapFile(path);
+    if (!mapping.data) return nullptr;
+
+    AssimpMappedFile* mapped = new AssimpMappedFile();
+    mapped->file = { AssimpMappedRead, AssimpMappedWrite, AssimpMappedTell, AssimpMappedSize, AssimpMappedSeek, AssimpMappedFlush, (aiUserData)mapped };
+    mapped->mapping = mapping;
+    mapped->cursor = 0;
+    return &mapped->file;
+}
+
+void AssimpMappedClose(aiFileIO*, aiFile* file)
+{
+    AssimpMappedFile* mapped = (AssimpMappedFile*)file->UserData;
+    UnmapFile(mapped->mapping);
+    delete mapped;
+}
+
+// Reads the model through Assimp into cpu streams, without touching OpenGL
+bool ImportModelData(const char* filename, ModelImport& import, VertexFormat format = VF_QUANTIZED)
+{
+    aiFileIO io = { AssimpMappedOpen, AssimpMappedClose, (aiUserData)&import.dependencies };
+    const aiScene* scene = aiImportFileEx(filename,
+        aiProcess_Triangulate |
+        aiProcess_GenSmoothNormals |
+        aiProcess_CalcTangentSpace |
+        aiProcess_JoinIdenticalVertices |
+        aiProcess_PreTransformVertices |
+        aiProcess_OptimizeMeshes |
+        aiProcess_SortByPType,
+        &io);
+
+    if (!scene)
+    {
+        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
+        return false;
+    }
+
+    import.path = filename;
+    import.vertexFormat = format;
+
+    std::string directory = filename;
+    size_t slash = directory.find_last_of("/\\");
+    directory = slash == std::string::npos ? "." : directory.substr(0, slash);
+
+    // Create a list of materials
+    import.materials.resize(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+        ProcessAssimpMaterial(scene->mMaterials[i], import.materials[i], directory);
+
+    // Streams are sized exactly before the meshes are written in place
+    u32 vertexBytes = 0;
+    u32 indexBytes = 0;
+    MeasureAssimpNode(scene, scene->mRootNode, format, vertexBytes, indexBytes);
+    import.vertexStream.resize(vertexBytes);
+    import.indexStream.resize(indexBytes);
+
+    ProcessAssimpNode(scene, scene->mRootNode, import, format);
+
+    aiReleaseImport(scene);
+
+    FinishModelImportStreams(import);
+
+    return true;
+}
+
+bool IsObjFile(const char* filename)
+{
+    const char* extension = strrchr(filename, '.');
+    return extension && tolower(extension[1]) == 'o' && tolower(extension[2]) == 'b' && tolower(extension[3]) == 'j' && extension[4] == '\0';
+}
+
+bool IsGlbFile(const char* filename)
+{
+    const char* extension = strrchr(filename, '.');
+    return extension && tolower(extension[1]) == 'g' && tolower(extension[2]) == 'l' && tolower(extension[3]) == 'b' && extension[4] == '\0';
+}
+
+// Reads the source file: OBJ goes through the native parser, GLB is mapped in place when it can be
+// drawn as is (always float vertices), anything else goes through Assimp
+bool ImportModelSource(const char* filename, ModelImport& import, VertexFormat format, JobSystem* jobs = nullptr)
+{
+    if (IsObjFile(filename)) return ImportObjModel(filename, import, format, nullptr, jobs);
+    if (IsGlbFile(filename) && ImportGlbModel(filename, import)) return true;
+    return ImportModelData(filename, import, format);
+}
+
+// Uses the cooked version when it is valid, otherwise imports the source (and cooks it if asked)
+bool ReadModelImport(const char* filename, ModelImport& import, bool cook, VertexFormat format, JobSystem* jobs = nullptr)
+{
+    if (ReadCookedModel(filename, import, format)) return true;
+
+    if (!ImportModelSource(filename, import, format, jobs)) return false;
+
+    if (cook && !import.zeroCopy) WriteCookedModel(filename, import);
+
+    return true;
+}
@@ -0,0 +1,697 @@
+#pragma once
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <assimp/material.h>
+#include "platform.h"
+#include "JobSystem.h"
+#include "ModelImport.h"
+#include "MeshProcessing.h"
+
+// Native Wavefront OBJ/MTL importer, used instead of Assimp for .obj files.
+// The file is mapped and split into line aligned chunks that are parsed in parallel on the job system
+// when the caller gives one, serially otherwise (one pass counts
+// the vertex attributes of each chunk so absolute and relative indices resolve, a second one parses them).
+// Faces are fan triangulated and merged per material, corners are deduplicated with a hash table,
+// missing normals are smoothed per position and tangents follow Assimp's CalcTangentSpace,
+// so the result matches what the Assimp path produces.
+
+#define OBJ_MIN_CHUNK_SIZE MB(1)
+
+// Zero based attribute indices of a face corner, -1 when missing
+struct ObjCorner
+{
+    i32 v;
+    i32 vt;
+    i32 vn;
+};
+
+struct ObjMaterialSwitch
+{
+    u32 triangle;
+    std::string name;
+};
+
+struct ObjChunk
+{
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    // Attributes declared by the chunks before this one
+    u32 positionBase = 0;
+    u32 texCoordBase = 0;
+    u32 normalBase = 0;
+
+    u32 positionCount = 0;
+    u32 texCoordCount = 0;
+    u32 normalCount = 0;
+
+    std::vector<vec3> positions;
+    std::vector<vec3> texCoords;
+    std::vector<vec3> normals;
+    std::vector<ObjCorner> corners; // 3 per triangle
+    std::vector<ObjMaterialSwitch> materials;
+    std::vector<std::string> libraries;
+};
+
+inline bool ObjIsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline void ObjSkipSpaces(const char*& p, const char* end)
+{
+    while (p < end && ObjIsSpace(*p)) p++;
+}
+
+// Rest of the line without surrounding spaces
+inline std::string ObjLineRest(const char* p, const char* end)
+{
+    ObjSkipSpaces(p, end);
+    while (end > p && ObjIsSpace(end[-1])) end--;
+    return std::string(p, end);
+}
+
+// Decimal float parser: accumulates up to 19 significant digits in an integer mantissa and
+// scales it once, with exact powers of ten for the usual exponents
+inline float ObjParseFloat(const char*& p, const char* end)
+{
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    ObjSkipSpaces(p, end);
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    u64 mantissa = 0;
+    i32 exponent = 0;
+    u32 digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p)
+    {
+        if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits += mantissa != 0; }
+        else exponent++;
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p)
+        {
+            if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits += mantissa != 0; exponent--; }
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) negativeExponent = *p++ == '-';
+
+        i32 value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+            if (value < 10000) value = value * 10 + (*p - '0');
+        exponent += negativeExponent ? -value : value;
+    }
+
+    double result = (double)mantissa;
+    if (exponent >= -22 && exponent <= 22) result = exponent < 0 ? result / powers[-exponent] : result * powers[exponent];
+    else result *= pow(10.0, exponent);
+
+    return (float)(negative ? -result : result);
+}
+
+inline i32 ObjParseInt(const char*& p, const char* end)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    i32 value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p)
+        value = value * 10 + (*p - '0');
+    return negative ? -value : value;
+}
+
+// OBJ indices are 1 based, negative ones are relative to the attributes declared so far
+inline i32 ObjResolveIndex(i32 index, u32 declared)
+{
+    if (index > 0) return index - 1;
+    if (index < 0) return (i32)declared + index;
+    return -1;
+}
+
+inline const char* ObjLineEnd(const char* p, const char* end)
+{
+    const char* newline = (const char*)memchr(p, '\n', end - p);
+    return newline ? newline : end;
+}
+
+// First pass: attribute counts of the chunk
+void CountObjChunk(ObjChunk& chunk)
+{
+    for (const char* p = chunk.begin; p < chunk.end;)
+    {
+        const char* lineEnd = ObjLineEnd(p, chunk.end);
+        if (lineEnd - p > 2 && p[0] == 'v')
+        {
+            if (ObjIsSpace(p[1])) chunk.positionCount++;
+            else if (p[1] == 't' && ObjIsSpace(p[2])) chunk.texCoordCount++;
+            else if (p[1] == 'n' && ObjIsSpace(p[2])) chunk.normalCount++;
+        }
+        p = lineEnd + 1;
+    }
+}
+
+// Second pass: attributes, triangles (with resolved absolute indices) and material switches
+void ParseObjChunk(ObjChunk& chunk)
+{
+    chunk.positions.reserve(chunk.positionCount);
+    chunk.texCoords.reserve(chunk.texCoordCount);
+    chunk.normals.reserve(chunk.normalCount);
+
+    std::vector<ObjCorner> face;
+    for (const char* p = chunk.begin; p < chunk.end;)
+    {
+        const char* lineEnd = ObjLineEnd(p, chunk.end);
+        const char* c = p;
+        p = lineEnd + 1;
+
+        if (lineEnd - c < 2) continue;
+
+        if (c[0] == 'v')
+        {
+            if (ObjIsSpace(c[1]))
+            {
+                c += 1;
+                vec3 v;
+                v.x = ObjParseFloat(c, lineEnd);
+                v.y = ObjParseFloat(c, lineEnd);
+                v.z = ObjParseFloat(c, lineEnd);
+                chunk.positions.push_back(v);
+            }
+            else if (c[1] == 't' && ObjIsSpace(c[2]))
+            {
+                c += 2;
+                vec3 vt = vec3(0.f);
+                vt.x = ObjParseFloat(c, lineEnd);
+                vt.y = ObjParseFloat(c, lineEnd);
+                chunk.texCoords.push_back(vt);
+            }
+            else if (c[1] == 'n' && ObjIsSpace(c[2]))
+            {
+                c += 2;
+                vec3 vn;
+                vn.x = ObjParseFloat(c, lineEnd);
+                vn.y = ObjParseFloat(c, lineEnd);
+                vn.z = ObjParseFloat(c, lineEnd);
+                chunk.normals.push_back(vn);
+            }
+        }
+        else if (c[0] == 'f' && ObjIsSpace(c[1]))
+        {
+            const u32 positions = chunk.positionBase + chunk.positions.size();
+            const u32 texCoords = chunk.texCoordBase + chunk.texCoords.size();
+            const u32 normals = chunk.normalBase + chunk.normals.size();
+
+            face.clear();
+            c += 1;
+            while (true)
+            {
+                ObjSkipSpaces(c, lineEnd);
+                if (c >= lineEnd || (*c != '-' && (*c < '0' || *c > '9'))) break;
+
+                ObjCorner corner = { ObjResolveIndex(ObjParseInt(c, lineEnd), positions), -1, -1 };
+                if (c < lineEnd && *c == '/')
+                {
+                    ++c;
+                    if (c < lineEnd && *c != '/') corner.vt = ObjResolveIndex(ObjParseInt(c, lineEnd), texCoords);
+                    if (c < lineEnd && *c == '/')
+                    {
+                        ++c;
+                        corner.vn = ObjResolveIndex(ObjParseInt(c, lineEnd), normals);
+                    }
+                }
+                face.push_back(corner);
+
+                // Skip whatever is left of a malformed corner
+                while (c < lineEnd && !ObjIsSpace(*c)) ++c;
+            }
+
+            // Fan triangulation
+            for (u32 i = 2; i < face.size(); ++i)
+            {
+                chunk.corners.push_back(face[0]);
+                chunk.corners.push_back(face[i - 1]);
+                chunk.corners.push_back(face[i]);
+            }
+        }
+        else if (lineEnd - c > 7 && strncmp(c, "usemtl", 6) == 0 && ObjIsSpace(c[6]))
+        {
+            ObjMaterialSwitch materialSwitch = { (u32)chunk.corners.size() / 3, ObjLineRest(c + 6, lineEnd) };
+            chunk.materials.push_back(materialSwitch);
+        }
+        else if (lineEnd - c > 7 && strncmp(c, "mtllib", 6) == 0 && ObjIsSpace(c[6]))
+        {
+            chunk.libraries.push_back(ObjLineRest(c + 6, lineEnd));
+        }
+    }
+}
+
+// Runs the job over every chunk, spread over the job system when there is one (the import itself
+// usually is a job, see JobSystem::ParallelFor())
+template <typename Job>
+void ForEachObjChunk(std::vector<ObjChunk>& chunks, JobSystem* jobs, Job job)
+{
+    if (!jobs || chunks.size() == 1)
+    {
+        for (std::vector<ObjChunk>::iterator it = chunks.begin(); it != chunks.end(); ++it)
+            job(*it);
+        return;
+    }
+
+    jobs->ParallelFor(chunks.size(), [&chunks, job](unsigned int i) { job(chunks[i]); });
+}
+
+// Texture path of a map_* statement: the last token, options come before it
+inline std::string ObjTexturePath(const std::string& statement, const std::string& directory)
+{
+    size_t start = statement.find_last_of(" \t");
+    return directory + "/" + (start == std::string::npos ? statement : statement.substr(start + 1));
+}
+
+void ReadObjMaterialLibrary(const std::string& path, const std::string& directory, std::vector<ImportedMaterial>& materials, std::unordered_map<std::string, u32>& names)
+{
+    MappedFile file = MapFile(path.c_str());
+    if (!file.data)
+    {
+        ELOG("Could not open material library %s", path.c_str());
+        return;
+    }
+
+    const char* end = (const char*)file.data + file.size;
+    ImportedMaterial* mat = nullptr;
+    for (const char* p = (const char*)file.data; p < end;)
+    {
+        const char* lineEnd = ObjLineEnd(p, end);
+        const char* c = p;
+        p = lineEnd + 1;
+
+        ObjSkipSpaces(c, lineEnd);
+        const char* keyEnd = c;
+        while (keyEnd < lineEnd && !ObjIsSpace(*keyEnd)) keyEnd++;
+        const std::string key(c, keyEnd);
+        c = keyEnd;
+
+        if (key == "newmtl")
+        {
+            // Same defaults as Assimp's OBJ importer
+            ImportedMaterial material;
+            material.name = ObjLineRest(c, lineEnd);
+            material.diffuse = vec3(0.6f);
+            material.emissive = vec3(0.f);
+            material.shininess = 0.f;
+            names[material.name] = materials.size();
+            materials.push_back(material);
+            mat = &materials.back();
+            continue;
+        }
+        if (!mat) continue;
+
+        // Same values and property flags as ProcessAssimpMaterial()
+        if (key == "Kd")
+        {
+            mat->diffuse.r = ObjParseFloat(c, lineEnd);
+            mat->diffuse.g = ObjParseFloat(c, lineEnd);
+            mat->diffuse.b = ObjParseFloat(c, lineEnd);
+        }
+        else if (key == "Ke")
+        {
+            mat->emissive.r = ObjParseFloat(c, lineEnd);
+            mat->emissive.g = ObjParseFloat(c, lineEnd);
+            mat->emissive.b = ObjParseFloat(c, lineEnd);
+        }
+        else if (key == "Ns")
+        {
+            mat->shininess = ObjParseFloat(c, lineEnd) / 256.0f;
+        }
+        else if (key == "map_Kd")
+        {
+            mat->textures[CTS_DIFFUSE] = ObjTexturePath(ObjLineRest(c, lineEnd), directory);
+            mat->properties.Set(aiTextureType_DIFFUSE, true);
+        }
+        else if (key == "map_Ks")
+        {
+            mat->textures[CTS_SPECULAR] = ObjTexturePath(ObjLineRest(c, lineEnd), directory);
+            mat->properties.Set(aiTextureType_EMISSIVE, true);
+        }
+        else if (key == "map_Ke")
+        {
+            mat->textures[CTS_EMISSIVE] = ObjTexturePath(ObjLineRest(c, lineEnd), directory);
+            mat->properties.Set(aiTextureType_EMISSIVE, true);
+        }
+        else if (key == "norm" || key == "map_Kn")
+        {
+            mat->textures[CTS_NORMALS] = ObjTexturePath(ObjLineRest(c, lineEnd), directory);
+            mat->properties.Set(aiTextureType_NORMALS, true);
+        }
+        else if (key == "bump" || key == "map_bump" || key == "map_Bump")
+        {
+            mat->textures[CTS_BUMP] = ObjTexturePath(ObjLineRest(c, lineEnd), directory);
+            mat->properties.Set(aiTextureType_HEIGHT, true);
+        }
+    }
+
+    UnmapFile(file);
+}
+
+// Deduplicated vertices of the triangles using one material
+struct ObjMeshBuild
+{
+    u32 material = 0;
+    std::vector<ObjCorner> corners; // One per vertex
+    std::vector<u32> indices;
+    std::vector<u32> table;         // Open addressing, vertex index or UINT32_MAX
+    bool hasTexCoords = false;
+
+    u32 AddCorner(const ObjCorner& corner)
+    {
+        if (corners.size() * 2 >= table.size()) Grow();
+
+        const u32 mask = table.size() - 1;
+        for (u32 slot = Hash(corner) & mask;; slot = (slot + 1) & mask)
+        {
+            const u32 index = table[slot];
+            if (index == UINT32_MAX)
+            {
+                table[slot] = corners.size();
+                corners.push_back(corner);
+                hasTexCoords |= corner.vt >= 0;
+                return table[slot];
+            }
+
+            const ObjCorner& other = corners[index];
+            if (other.v == corner.v && other.vt == corner.vt && other.vn == corner.vn) return index;
+        }
+    }
+
+    static u32 Hash(const ObjCorner& corner)
+    {
+        u32 h = (u32)corner.v * 0x9E3779B1u;
+        h ^= (u32)corner.vt * 0x85EBCA77u + (h << 6) + (h >> 2);
+        h ^= (u32)corner.vn * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+        return h ^ (h >> 15);
+    }
+
+    void Grow()
+    {
+        table.assign(table.empty() ? 1024 : table.size() * 2, UINT32_MAX);
+        const u32 mask = table.size() - 1;
+        for (u32 i = 0; i < corners.size(); ++i)
+        {
+            u32 slot = Hash(corners[i]) & mask;
+            while (table[slot] != UINT32_MAX) slot = (slot + 1) & mask;
+            table[slot] = i;
+        }
+    }
+};
+
+// Per vertex attributes of a built mesh, with generated normals and tangent space
+struct ObjMeshAttributes
+{
+    std::vector<vec3> positions;
+    std::vector<vec3> normals;
+    std::vector<vec3> texCoords;
+    std::vector<vec3> tangents;
+    std::vector<vec3> bitangents;
+};
+
+void BuildObjMeshAttributes(const ObjMeshBuild& build, const std::vector<vec3>& positions, const std::vector<vec3>& texCoords,
+    const std::vector<vec3>& normals, std::vector<vec3>& smoothNormals, ObjMeshAttributes& out)
+{
+    const u32 vertexCount = build.corners.size();
+    out.positions.resize(vertexCount);
+    out.normals.resize(vertexCount);
+    if (build.hasTexCoords) out.texCoords.resize(vertexCount);
+
+    bool missingNormals = false;
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        const ObjCorner& corner = build.corners[i];
+        out.positions[i] = corner.v >= 0 && corner.v < (i32)positions.size() ? positions[corner.v] : vec3(0.f);
+        if (build.hasTexCoords) out.texCoords[i] = corner.vt >= 0 && corner.vt < (i32)texCoords.size() ? texCoords[corner.vt] : vec3(0.f);
+        if (corner.vn >= 0 && corner.vn < (i32)normals.size()) out.normals[i] = normals[corner.vn];
+        else missingNormals = true;
+    }
+
+    // Smooth normals for the corners without one, shared by every corner at the same position index
+    if (missingNormals)
+    {
+        for (u32 i = 0; i + 2 < build.indices.size(); i += 3)
+        {
+            const u32 a = build.indices[i], b = build.indices[i + 1], c = build.indices[i + 2];
+            const vec3 n = glm::cross(out.positions[b] - out.positions[a], out.positions[c] - out.positions[a]);
+            for (u32 k = 0; k < 3; ++k)
+            {
+                const i32 v = build.corners[build.indices[i + k]].v;
+                if (v >= 0 && v < (i32)smoothNormals.size()) smoothNormals[v] += n;
+            }
+        }
+
+        for (u32 i = 0; i < vertexCount; ++i)
+        {
+            const ObjCorner& corner = build.corners[i];
+            if (corner.vn >= 0 && corner.vn < (i32)normals.size()) continue;
+
+            const vec3 n = corner.v >= 0 && corner.v < (i32)smoothNormals.size() ? smoothNormals[corner.v] : vec3(0.f);
+            const float length = glm::length(n);
+            out.normals[i] = length > 0.f ? n / length : vec3(0.f, 1.f, 0.f);
+        }
+
+        // Leave the shared accumulator clean for the next mesh
+        for (u32 i = 0; i < vertexCount; ++i)
+            if (build.corners[i].v >= 0 && build.corners[i].v < (i32)smoothNormals.size()) smoothNormals[build.corners[i].v] = vec3(0.f);
+    }
+
+    if (!build.hasTexCoords) return;
+
+    // Tangent space with the formulas of Assimp's CalcTangentSpace, averaged per vertex
+    out.tangents.assign(vertexCount, vec3(0.f));
+    out.bitangents.assign(vertexCount, vec3(0.f));
+    for (u32 i = 0; i + 2 < build.indices.size(); i += 3)
+    {
+        const u32 a = build.indices[i], b = build.indices[i + 1], c = build.indices[i + 2];
+        const vec3 v = out.positions[b] - out.positions[a];
+        const vec3 w = out.positions[c] - out.positions[a];
+        const vec2 s = vec2(out.texCoords[b] - out.texCoords[a]);
+        const vec2 t = vec2(out.texCoords[c] - out.texCoords[a]);
+
+        const float direction = (t.x * s.y - t.y * s.x) < 0.f ? -1.f : 1.f;
+        vec3 tangent = (w * s.y - v * t.y) * direction;
+        vec3 bitangent = (w * s.x - v * t.x) * direction;
+        if (s == vec2(0.f) && t == vec2(0.f))
+        {
+            tangent = vec3(1.f, 0.f, 0.f);
+            bitangent = vec3(0.f, 1.f, 0.f);
+        }
+
+        for (u32 k = 0; k < 3; ++k)
+        {
+            out.tangents[build.indices[i + k]] += tangent;
+            out.bitangents[build.indices[i + k]] += bitangent;
+        }
+    }
+
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        const vec3 n = out.normals[i];
+        vec3 tangent = out.tangents[i] - n * glm::dot(n, out.tangents[i]);
+        vec3 bitangent = out.bitangents[i] - n * glm::dot(n, out.bitangents[i]);
+        const float tangentLength = glm::length(tangent);
+        const float bitangentLength = glm::length(bitangent);
+        out.tangents[i] = tangentLength > 0.f ? tangent / tangentLength : glm::normalize(glm::cross(n, glm::abs(n.x) < 0.9f ? vec3(1.f, 0.f, 0.f) : vec3(0.f, 1.f, 0.f)));
+        out.bitangents[i] = bitangentLength > 0.f ? bitangent / bitangentLength : glm::cross(n, out.tangents[i]);
+    }
+}
+
+// Reads an OBJ file into cpu streams, without touching OpenGL.
+// parseSeconds receives the time spent before the shared mesh processing (parse, dedup, tangents).
+// The chunks of big files are spread over `jobs`, which can be the pool the import itself runs on.
+bool ImportObjModel(const char* filename, ModelImport& import, VertexFormat format = VF_QUANTIZED, f64* parseSeconds = nullptr, JobSystem* jobs = nullptr)
+{
+    const f64 start = GetPerformanceTime();
+    MappedFile file = MapFile(filename);
+    if (!file.data)
+    {
+        ELOG("Error loading mesh %s: could not open the file", filename);
+        return false;
+    }
+
+    import.path = filename;
+    import.vertexFormat = format;
+
+    std::string directory = filename;
+    size_t slash = directory.find_last_of("/\\");
+    directory = slash == std::string::npos ? "." : directory.substr(0, slash);
+
+    // Line aligned chunks, one per worker (and the calling thread) for big files
+    const char* data = (const char*)file.data;
+    const char* dataEnd = data + file.size;
+    const u32 threads = jobs ? jobs->ThreadCount() + 1 : 1;
+    u32 chunkCount = (u32)std::min<u64>(threads, file.size / OBJ_MIN_CHUNK_SIZE + 1);
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char* cursor = data;
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        const char* end = i + 1 == chunkCount ? dataEnd : std::max(cursor, data + file.size * (i + 1) / chunkCount);
+        if (end < dataEnd) end = ObjLineEnd(end, dataEnd);
+        if (end < dataEnd) end++;
+        chunks[i].begin = cursor;
+        chunks[i].end = end;
+        cursor = end;
+    }
+
+    ForEachObjChunk(chunks, jobs, CountObjChunk);
+
+    u32 positionCount = 0, texCoordCount = 0, normalCount = 0;
+    for (std::vector<ObjChunk>::iterator it = chunks.begin(); it != chunks.end(); ++it)
+    {
+        it->positionBase = positionCount;
+        it->texCoordBase = texCoordCount;
+        it->normalBase = normalCount;
+        positionCount += it->positionCount;
+        texCoordCount += it->texCoordCount;
+        normalCount += it->normalCount;
+    }
+
+    ForEachObjChunk(chunks, jobs, ParseObjChunk);
+
+    std::vector<vec3> positions, texCoords, normals;
+    positions.reserve(positionCount);
+    texCoords.reserve(texCoordCount);
+    normals.reserve(normalCount);
+    for (std::vector<ObjChunk>::iterator it = chunks.begin(); it != chunks.end(); ++it)
+    {
+        positions.insert(positions.end(), it->positions.begin(), it->positions.end());
+        texCoords.insert(texCoords.end(), it->texCoords.begin(), it->texCoords.end());
+        normals.insert(normals.end(), it->normals.begin(), it->normals.end());
+        std::vector<vec3>().swap(it->positions);
+        std::vector<vec3>().swap(it->texCoords);
+        std::vector<vec3>().swap(it->normals);
+    }
+
+    // Materials of every library, in declaration order
+    std::unordered_map<std::string, u32> materialNames;
+    for (std::vector<ObjChunk>::iterator it = chunks.begin(); it != chunks.end(); ++it)
+    {
+        for (std::vector<std::string>::iterator lt = it->libraries.begin(); lt != it->libraries.end(); ++lt)
+        {
+            ReadObjMaterialLibrary(directory + "/" + *lt, directory, import.materials, materialNames);
+            import.dependencies.push_back(directory + "/" + *lt);
+        }
+    }
+
+    // One mesh per material, in order of first use
+    std::vector<ObjMeshBuild> builds;
+    std::unordered_map<u32, u32> materialBuilds;
+    u32 defaultMaterial = UINT32_MAX;
+    ObjMeshBuild* build = nullptr;
+
+    auto UseMaterial = [&](const std::string& name)
+    {
+        std::unordered_map<std::string, u32>::iterator found = materialNames.find(name);
+        u32 material = 0;
+        if (found != materialNames.end())
+        {
+            material = found->second;
+        }
+        else
+        {
+            if (defaultMaterial == UINT32_MAX)
+            {
+                ImportedMaterial fallback;
+                fallback.name = "DefaultMaterial";
+                fallback.diffuse = vec3(0.6f);
+                fallback.emissive = vec3(0.f);
+                fallback.shininess = 0.f;
+                defaultMaterial = import.materials.size();
+                import.materials.push_back(fallback);
+            }
+            material = defaultMaterial;
+        }
+
+        std::unordered_map<u32, u32>::iterator existing = materialBuilds.find(material);
+        if (existing == materialBuilds.end())
+        {
+            existing = materialBuilds.insert(std::make_pair(material, (u32)builds.size())).first;
+            builds.emplace_back();
+            builds.back().material = material;
+        }
+        build = &builds[existing->second];
+    };
+
+    for (std::vector<ObjChunk>::iterator it = chunks.begin(); it != chunks.end(); ++it)
+    {
+        const u32 triangleCount = it->corners.size() / 3;
+        std::vector<ObjMaterialSwitch>::const_iterator next = it->materials.begin();
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            while (next != it->materials.end() && next->triangle == t)
+            {
+                UseMaterial(next->name);
+                ++next;
+            }
+            if (!build) UseMaterial("");
+
+            for (u32 k = 0; k < 3; ++k)
+                build->indices.push_back(build->AddCorner(it->corners[t * 3 + k]));
+        }
+        // Switches after the last face of the chunk still apply to the next one
+        for (; next != it->materials.end(); ++next)
+            UseMaterial(next->name);
+        std::vector<ObjCorner>().swap(it->corners);
+    }
+
+    UnmapFile(file);
+
+    // Attributes first, so the streams can be sized exactly
+    std::vector<ObjMeshAttributes> attributes(builds.size());
+    std::vector<vec3> smoothNormals(positions.size(), vec3(0.f));
+    u32 vertexBytes = 0;
+    u32 indexBytes = 0;
+    for (u32 i = 0; i < builds.size(); ++i)
+    {
+        BuildObjMeshAttributes(builds[i], positions, texCoords, normals, smoothNormals, attributes[i]);
+        vertexBytes += builds[i].corners.size() * MeshVertexStride(builds[i].hasTexCoords, builds[i].hasTexCoords, format);
+        indexBytes += MeshIndexBytes(builds[i].indices.size(), builds[i].corners.size());
+    }
+    import.vertexStream.resize(vertexBytes);
+    import.indexStream.resize(indexBytes);
+
+    if (parseSeconds) *parseSeconds = GetPerformanceTime() - start;
+
+    for (u32 i = 0; i < builds.size(); ++i)
+    {
+        MeshSource source;
+        source.vertexCount = builds[i].corners.size();
+        source.positions = attributes[i].positions.data();
+        source.normals = attributes[i].normals.data();
+        if (builds[i].hasTexCoords)
+        {
+            source.texCoords = attributes[i].texCoords.data();
+            source.tangents = attributes[i].tangents.data();
+            source.bitangents = attributes[i].bitangents.data();
+        }
+        source.indices.swap(builds[i].indices);
+        source.materialIndex = builds[i].material;
+
+        ProcessMeshSource(source, import, format);
+        attributes[i] = ObjMeshAttributes();
+    }
+
+    FinishModelImportStreams(import);
+
+    return true;
+}
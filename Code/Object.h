@@ -25,6 +25,8 @@ public:
 		scale = glm::vec3(1);
 	}
 
+	virtual ~Object() {}
+
 	ObjectType Type() const
 	{
 		return type;
@@ -1,9 +1,41 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <algorithm>
+#include "Hash.h"
 #include "VertexShaderAttribute.h"
 
 typedef std::vector<VertexShaderAttribute*> VertexShaderLayout;
 
+// Compile and link issued to the driver and not waited for yet, see BeginProgramBuild()
+struct ProgramBuild
+{
+    unsigned int handle = 0;
+    unsigned int vertexShader = 0;
+    unsigned int fragmentShader = 0;
+    unsigned long long binaryKey = 0; // 0 when it isn't saved to the binary cache
+    bool fromBinary = false;
+};
+
+enum ProgramResourceKind
+{
+    PRK_UNIFORM,       // Samplers included
+    PRK_UNIFORM_BLOCK,
+    PRK_STORAGE_BLOCK,
+};
+
+// Active resource of a linked program, found by the hash of its name (see NAME_HASH)
+struct ProgramResource
+{
+    unsigned int nameHash;
+    int          location; // Uniform location, binding point of blocks
+    unsigned int type;     // GL type of uniforms, 0 for blocks
+    unsigned int size;     // Array size of uniforms, data size in bytes of blocks
+    ProgramResourceKind kind;
+
+    bool operator<(const ProgramResource& other) const { return nameHash < other.nameHash; }
+};
+
 class Program
 {
 public:
@@ -17,7 +49,29 @@ public:
     unsigned int handle;
     std::string  filepath;
     std::string  programName;
-    unsigned long long int lastWriteTimestamp;
+    std::string  permutation; // #define lines of this variant, on top of the ones every program gets
     VertexShaderLayout attributes;
 
+    // Every active uniform and block, reflected each time the program links (reloads included), sorted by nameHash
+    std::vector<ProgramResource> resources;
+
+    const ProgramResource* Find(unsigned int nameHash, ProgramResourceKind kind) const
+    {
+        ProgramResource key = {};
+        key.nameHash = nameHash;
+        for (std::vector<ProgramResource>::const_iterator it = std::lower_bound(resources.begin(), resources.end(), key); it != resources.end() && it->nameHash == nameHash; ++it)
+            if (it->kind == kind) return &*it;
+        return nullptr;
+    }
+
+    // -1 when the program doesn't use it, which glUniform*() ignores
+    int Uniform(unsigned int nameHash) const
+    {
+        const ProgramResource* resource = Find(nameHash, PRK_UNIFORM);
+        return resource ? resource->location : -1;
+    }
+
+    // Hot reload being built, it replaces handle once the driver is done (handle keeps being used until then)
+    ProgramBuild pending;
+
 };
\ No newline at end of file
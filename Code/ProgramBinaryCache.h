@@ -0,0 +1,100 @@
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include "platform.h"
+#include "Hash.h"
+
+// Linked programs are saved with glGetProgramBinary the first time they are built, and later runs load them
+// with glProgramBinary instead of compiling and linking the source again.
+// A binary only works with the source it was built from and the driver that built it. So it is looked up by
+// a hash of everything given to the compiler (version, defines, source), seeded with GL_RENDERER and
+// GL_VERSION. Editing a shader or updating the driver simply misses.
+// A driver can still reject a binary it wrote (GL_LINK_STATUS stays false). Then the program is built from
+// the source and its file rewritten.
+
+#define PROGRAM_CACHE_DIRECTORY "ShaderCache"
+#define PROGRAM_BINARY_MAGIC    0x4E4E5042 // "BPNN"
+#define PROGRAM_BINARY_VERSION  1
+
+struct ProgramBinaryHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 format; // Driver specific, as given by glGetProgramBinary
+    u32 size;
+};
+
+// Seed of the program keys for the current driver
+u64 ProgramBinarySeed(const char* renderer, const char* version)
+{
+    return HashString(version, HashString(renderer));
+}
+
+std::string ProgramBinaryPath(u64 key)
+{
+    char path[64];
+    sprintf(path, PROGRAM_CACHE_DIRECTORY "/%016llx.bin", (unsigned long long)key);
+    return path;
+}
+
+// Links the program from its cached binary, returns false if there is none or the driver rejected it
+bool LoadProgramBinary(GLuint program, u64 key)
+{
+    const std::string path = ProgramBinaryPath(key);
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    ProgramBinaryHeader header = {};
+    std::vector<u8> binary;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == PROGRAM_BINARY_MAGIC &&
+        header.version == PROGRAM_BINARY_VERSION && header.key == key && header.size > 0;
+    if (valid)
+    {
+        binary.resize(header.size);
+        valid = fread(binary.data(), 1, header.size, file) == header.size;
+    }
+    fclose(file);
+    if (!valid) return false;
+
+    glProgramBinary(program, header.format, binary.data(), header.size);
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success != 0;
+}
+
+// Writes the binary of a linked program, which needs GL_PROGRAM_BINARY_RETRIEVABLE_HINT set before linking
+void SaveProgramBinary(GLuint program, u64 key)
+{
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) return;
+
+    std::vector<u8> binary(size);
+    GLsizei length = 0;
+    GLenum format = GL_NONE;
+    glGetProgramBinary(program, size, &length, &format, binary.data());
+    if (length <= 0) return;
+
+    ProgramBinaryHeader header = {};
+    header.magic = PROGRAM_BINARY_MAGIC;
+    header.version = PROGRAM_BINARY_VERSION;
+    header.key = key;
+    header.format = format;
+    header.size = length;
+
+    CreateDirectoryPath(PROGRAM_CACHE_DIRECTORY);
+    const std::string path = ProgramBinaryPath(key);
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        ELOG("Could not write the program binary %s", path.c_str());
+        return;
+    }
+
+    const bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, length, file) == (size_t)length;
+    fclose(file);
+    if (!written) remove(path.c_str());
+}
@@ -1,5 +1,38 @@
 #pragma once
 #include <string>
+#include <vector>
+#include "platform.h"
+#include "TextureCompression.h"
+
+// What a texture is sampled as, it decides how it gets compressed (see CookedTexture.h)
+enum TextureUsage
+{
+    TU_COLOR,   // BC1, or BC3 if it has alpha
+    TU_NORMALS, // BC5, red and green only
+};
+
+#define COOKED_TEXTURE_MAX_LEVELS 16
+
+// Mip chain in its upload format, either cooked in memory or pointing into a mapped cooked file (see CookedTexture.h)
+struct CookedTexture
+{
+    BlockFormat format;
+    TextureUsage usage;
+    u32 width;
+    u32 height;
+    u32 levelCount;
+    u64 contentHash;
+    const u8* levels[COOKED_TEXTURE_MAX_LEVELS];
+    u32 levelBytes[COOKED_TEXTURE_MAX_LEVELS];
+    std::vector<u8> blocks;
+    MappedFile mapping;
+};
+
+inline void FreeCookedTexture(CookedTexture& cooked)
+{
+    if (cooked.mapping.data) UnmapFile(cooked.mapping);
+    cooked = {};
+}
 
 class Texture
 {
@@ -8,8 +41,32 @@ public:
     ~Texture()
     {
         filepath.clear();
+        if (chain)
+        {
+            FreeCookedTexture(*chain);
+            delete chain;
+        }
     }
 
     unsigned int handle;
     std::string filepath;
+
+    // Owned by the TextureCache
+    u64 contentHash = 0;
+    u64 bytes = 0;
+    u32 refCount = 0;
+    u64 lastUse = 0;
+    std::vector<u64> pathHashes;
+    u32 source = UINT32_MAX; // Slot whose texture has the same pixels, used instead of an own one
+    bool pending = false;    // Decoding or uploading
+    bool resident = false;
+    bool failed = false;
+
+    // Mip streaming (see UpdateTextureStreaming()): the storage only holds levels [residentLevel, levelCount)
+    // of the chain, and sampling is clamped with GL_TEXTURE_BASE_LEVEL to the ones uploaded so far
+    CookedTexture* chain = nullptr; // Where the finer levels are streamed from, kept once the texture is resident
+    u32 residentLevel = 0;
+    u32 uploadedLevel = 0;
+    u32 wantedLevel = 0;    // Finest level asked for by what was drawn last frame
+    bool streaming = false; // Finer levels being uploaded, the storage can't change meanwhile
 };
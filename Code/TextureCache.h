@@ -0,0 +1,270 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <glad/glad.h>
+#include "platform.h"
+#include "Hash.h"
+#include "AssetPack.h"
+#include "Texture.h"
+#include "TextureStorage.h"
+
+#define INVALID_TEXTURE UINT32_MAX
+
+struct TextureCacheStats
+{
+	u32 textures = 0;
+	u32 referenced = 0;
+	u32 loading = 0;
+	u32 paths = 0;
+	u64 residentBytes = 0;
+	u64 budget = 0;
+	u64 pathHits = 0;     // Lookups answered by the path, nothing decoded
+	u64 contentHits = 0;  // Decoded, but the same pixels were already cached under another path
+	u64 misses = 0;       // Uploaded
+	u64 evictions = 0;
+	u64 evictedBytes = 0;
+
+	float HitRate() const
+	{
+		const u64 lookups = pathHits + contentHits + misses;
+		return lookups ? (float)(pathHits + contentHits) / lookups : 0.f;
+	}
+};
+
+// Every texture used by materials and quads, identified by a slot index that stays valid while it is referenced.
+// Lookups go through the hash of the normalized path and the usage first (a file sampled as color and as
+// normals is uploaded in two formats). On a miss the slot is created right away and stays
+// pending while the image is decoded and uploaded (Handle() returns a fallback meanwhile); once its pixels are
+// known, a slot whose content is already cached under another path shares that texture instead of uploading it.
+// Unreferenced textures stay resident as a cache until the budget needs their memory, least recently used first.
+class TextureCache
+{
+public:
+
+	Texture* operator[](u32 slot) const { return slots[slot]; }
+
+	// Slots are indices below this, free ones are null
+	u32 SlotCount() const { return slots.size(); }
+
+	// Where the handles given to Resolve() and Resize() come from, they are freed back to it
+	void SetStorage(TextureStorage* storage)
+	{
+		this->storage = storage;
+	}
+
+	void SetFallbacks(GLuint loading, GLuint failed)
+	{
+		loadingHandle = loading;
+		failedHandle = failed;
+	}
+
+	// Texture to bind for the slot: the loading fallback until it is resident (or for no texture at all)
+	GLuint Handle(u32 slot) const
+	{
+		if (slot == INVALID_TEXTURE) return loadingHandle;
+
+		const Texture* texture = slots[slot];
+		if (texture->source != INVALID_TEXTURE) texture = slots[texture->source];
+		if (texture->failed) return failedHandle;
+		return texture->resident ? texture->handle : loadingHandle;
+	}
+
+	u32 FindPath(const char* path, TextureUsage usage)
+	{
+		std::unordered_map<u64, u32>::const_iterator it = pathSlots.find(PathHash(path, usage));
+		if (it == pathSlots.end()) return INVALID_TEXTURE;
+
+		stats.pathHits++;
+		return it->second;
+	}
+
+	// New slot for a path that missed, pending until Share(), Resolve() or Fail()
+	u32 InsertPending(const char* path, TextureUsage usage)
+	{
+		Texture* texture = new Texture();
+		texture->handle = 0;
+		texture->filepath = path;
+		texture->pending = true;
+		texture->lastUse = ++clock;
+
+		u32 slot = 0;
+		if (!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+			slots[slot] = texture;
+		}
+		else
+		{
+			slot = slots.size();
+			slots.push_back(texture);
+		}
+
+		AddPath(slot, path, usage);
+		return slot;
+	}
+
+	// Points a pending slot to the texture that has the same pixels, returns false if there is none
+	bool Share(u32 slot, u64 contentHash)
+	{
+		std::unordered_map<u64, u32>::const_iterator it = contentSlots.find(contentHash);
+		if (it == contentSlots.end()) return false;
+
+		Texture* texture = slots[slot];
+		texture->source = it->second;
+		texture->pending = false;
+		slots[it->second]->refCount++;
+		stats.contentHits++;
+		return true;
+	}
+
+	// Gives a pending slot its own texture, which is still being uploaded (see MarkResident())
+	void Resolve(u32 slot, u64 contentHash, GLuint handle, u64 bytes)
+	{
+		Trim(budget > bytes ? budget - bytes : 0);
+
+		Texture* texture = slots[slot];
+		texture->handle = handle;
+		texture->contentHash = contentHash;
+		texture->bytes = bytes;
+		contentSlots[contentHash] = slot;
+		residentBytes += bytes;
+		stats.misses++;
+	}
+
+	// Swaps the storage of a resident texture for one with more or fewer mip levels (see UpdateTextureStreaming()).
+	// Growing makes room by evicting unreferenced textures, so the texture has to be marked as streaming first.
+	void Resize(u32 slot, GLuint handle, u64 bytes)
+	{
+		Texture* texture = slots[slot];
+		const bool grows = bytes > texture->bytes;
+		storage->Free(texture->handle);
+		residentBytes = residentBytes - texture->bytes + bytes;
+		texture->handle = handle;
+		texture->bytes = bytes;
+		if (grows && residentBytes > budget) Trim(budget);
+	}
+
+	void MarkResident(u32 slot)
+	{
+		slots[slot]->pending = false;
+		slots[slot]->resident = true;
+	}
+
+	void Fail(u32 slot)
+	{
+		slots[slot]->pending = false;
+		slots[slot]->failed = true;
+	}
+
+	void Acquire(u32 slot)
+	{
+		slots[slot]->refCount++;
+	}
+
+	void Release(u32 slot)
+	{
+		Texture* texture = slots[slot];
+		if (--texture->refCount > 0) return;
+
+		texture->lastUse = ++clock;
+		if (residentBytes > budget) Trim(budget);
+	}
+
+	// Deletes unreferenced textures (but not the ones streaming in levels), least recently used first, until at most `bytes` are resident
+	void Trim(u64 bytes)
+	{
+		while (residentBytes > bytes)
+		{
+			u32 victim = INVALID_TEXTURE;
+			for (u32 i = 0; i < slots.size(); ++i)
+			{
+				const Texture* texture = slots[i];
+				if (texture && texture->refCount == 0 && !texture->pending && !texture->streaming && (victim == INVALID_TEXTURE || texture->lastUse < slots[victim]->lastUse))
+					victim = i;
+			}
+			if (victim == INVALID_TEXTURE) return; // Everything left is referenced
+
+			Evict(victim);
+		}
+	}
+
+	void SetBudget(u64 bytes)
+	{
+		budget = bytes;
+		Trim(budget);
+	}
+
+	u64 Budget() const { return budget; }
+	u64 ResidentBytes() const { return residentBytes; }
+
+	TextureCacheStats Stats() const
+	{
+		TextureCacheStats result = stats;
+		result.textures = slots.size() - freeSlots.size();
+		result.paths = pathSlots.size();
+		result.residentBytes = residentBytes;
+		result.budget = budget;
+		for (std::vector<Texture*>::const_iterator it = slots.begin(); it != slots.end(); ++it)
+		{
+			if (*it && (*it)->refCount > 0) result.referenced++;
+			if (*it && (*it)->pending) result.loading++;
+		}
+		return result;
+	}
+
+private:
+
+	static u64 PathHash(const char* path, TextureUsage usage)
+	{
+		const u32 key = usage;
+		return HashBytes(&key, sizeof(key), HashString(NormalizePackPath(path).c_str()));
+	}
+
+	void AddPath(u32 slot, const char* path, TextureUsage usage)
+	{
+		const u64 hash = PathHash(path, usage);
+		if (pathSlots.insert(std::make_pair(hash, slot)).second)
+			slots[slot]->pathHashes.push_back(hash);
+	}
+
+	void Evict(u32 slot)
+	{
+		Texture* texture = slots[slot];
+		for (std::vector<u64>::const_iterator it = texture->pathHashes.begin(); it != texture->pathHashes.end(); ++it)
+			pathSlots.erase(*it);
+
+		if (texture->source != INVALID_TEXTURE)
+		{
+			// Only the reference goes, the shared texture is evicted on its own
+			Texture* source = slots[texture->source];
+			if (--source->refCount == 0) source->lastUse = ++clock;
+		}
+		else if (texture->handle)
+		{
+			std::unordered_map<u64, u32>::iterator it = contentSlots.find(texture->contentHash);
+			if (it != contentSlots.end() && it->second == slot) contentSlots.erase(it);
+
+			storage->Free(texture->handle);
+			residentBytes -= texture->bytes;
+			stats.evictedBytes += texture->bytes;
+		}
+		stats.evictions++;
+
+		delete texture;
+		slots[slot] = nullptr;
+		freeSlots.push_back(slot);
+	}
+
+	std::vector<Texture*> slots;
+	std::vector<u32> freeSlots;
+	std::unordered_map<u64, u32> pathSlots;    // Normalized path hash -> slot, several paths can share a slot
+	std::unordered_map<u64, u32> contentSlots; // Pixel hash -> slot
+	u64 residentBytes = 0;
+	u64 budget = MB(256);
+	u64 clock = 0;
+	TextureStorage* storage = nullptr;
+	GLuint loadingHandle = 0;
+	GLuint failedHandle = 0;
+	TextureCacheStats stats;
+};
@@ -0,0 +1,411 @@
+#pragma once
+#include <string.h>
+#include <math.h>
+#include "platform.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCK_COMPRESSION_SSE2 1
+#endif
+
+// CPU block compression (BCn, a.k.a. S3TC/RGTC) of 4x4 texel blocks from RGBA8 texels:
+// BC1   8 bytes: two RGB565 endpoints and 2 bit indices into the 4 colors they define (opaque)
+// BC3  16 bytes: a BC4 block for alpha followed by a BC1 color block
+// BC4   8 bytes: two 8 bit endpoints and 3 bit indices into the 8 values they define
+// BC5  16 bytes: two BC4 blocks, red and green (normal maps, z is reconstructed from them)
+// RGBA8 stores the texels as they are (1x1 "blocks"), for what can't or shouldn't be compressed.
+// Color endpoints are the extremes of the block along its principal axis, refined once with a least
+// squares fit. Indices pick the nearest palette entry, four texels at a time with SSE2.
+// Blocks that cross the right or bottom edge of a level replicate its last texels.
+
+enum BlockFormat
+{
+    BF_BC1,
+    BF_BC3,
+    BF_BC5,
+    BF_RGBA8,
+    BF_COUNT
+};
+
+inline u32 BlockBytes(BlockFormat format)
+{
+    return format == BF_RGBA8 ? 4 : format == BF_BC1 ? 8 : 16;
+}
+
+// Texels on each side of a block
+inline u32 BlockSide(BlockFormat format)
+{
+    return format == BF_RGBA8 ? 1 : 4;
+}
+
+inline u32 LevelBytes(BlockFormat format, u32 width, u32 height)
+{
+    const u32 side = BlockSide(format);
+    return ((width + side - 1) / side) * ((height + side - 1) / side) * BlockBytes(format);
+}
+
+inline u16 PackRgb565(const float color[3])
+{
+    const u32 r = (u32)(color[0] * (31.f / 255.f) + 0.5f);
+    const u32 g = (u32)(color[1] * (63.f / 255.f) + 0.5f);
+    const u32 b = (u32)(color[2] * (31.f / 255.f) + 0.5f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+inline void UnpackRgb565(u16 packed, u8 color[3])
+{
+    const u32 r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (u8)((r << 3) | (r >> 2));
+    color[1] = (u8)((g << 2) | (g >> 4));
+    color[2] = (u8)((b << 3) | (b >> 2));
+}
+
+// The 4 colors of a BC1 block, 3 and black when c0 <= c1
+inline void Bc1Palette(u16 c0, u16 c1, u8 palette[4][4], bool forceFourColors)
+{
+    UnpackRgb565(c0, palette[0]);
+    UnpackRgb565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+    for (u32 c = 0; c < 3; ++c)
+    {
+        if (c0 > c1 || forceFourColors)
+        {
+            palette[2][c] = (u8)((2 * palette[0][c] + palette[1][c]) / 3);
+            palette[3][c] = (u8)((palette[0][c] + 2 * palette[1][c]) / 3);
+        }
+        else
+        {
+            palette[2][c] = (u8)((palette[0][c] + palette[1][c]) / 2);
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = (c0 > c1 || forceFourColors) ? 255 : 0;
+}
+
+// Index of the nearest palette color of every texel, returns the summed squared error
+inline u32 SelectBc1Indices(const float r[16], const float g[16], const float b[16], const u8 palette[4][4], u32 indices[16])
+{
+#ifdef BLOCK_COMPRESSION_SSE2
+    __m128 total = _mm_setzero_ps();
+    for (u32 i = 0; i < 16; i += 4)
+    {
+        const __m128 tr = _mm_loadu_ps(r + i), tg = _mm_loadu_ps(g + i), tb = _mm_loadu_ps(b + i);
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128i bestIndex = _mm_setzero_si128();
+        for (u32 k = 0; k < 4; ++k)
+        {
+            const __m128 dr = _mm_sub_ps(tr, _mm_set1_ps(palette[k][0]));
+            const __m128 dg = _mm_sub_ps(tg, _mm_set1_ps(palette[k][1]));
+            const __m128 db = _mm_sub_ps(tb, _mm_set1_ps(palette[k][2]));
+            const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+            bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, bestIndex));
+            best = _mm_min_ps(distance, best);
+        }
+        _mm_storeu_si128((__m128i*)(indices + i), bestIndex);
+        total = _mm_add_ps(total, best);
+    }
+    float sums[4];
+    _mm_storeu_ps(sums, total);
+    return (u32)(sums[0] + sums[1] + sums[2] + sums[3]);
+#else
+    float total = 0.f;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        float best = 1e30f;
+        for (u32 k = 0; k < 4; ++k)
+        {
+            const float dr = r[i] - palette[k][0], dg = g[i] - palette[k][1], db = b[i] - palette[k][2];
+            const float distance = dr * dr + dg * dg + db * db;
+            if (distance < best)
+            {
+                best = distance;
+                indices[i] = k;
+            }
+        }
+        total += best;
+    }
+    return (u32)total;
+#endif
+}
+
+inline void WriteBc1Block(u16 c0, u16 c1, const u32 indices[16], u8* block)
+{
+    u32 bits = 0;
+    for (u32 i = 0; i < 16; ++i)
+        bits |= indices[i] << (2 * i);
+
+    block[0] = (u8)c0; block[1] = (u8)(c0 >> 8);
+    block[2] = (u8)c1; block[3] = (u8)(c1 >> 8);
+    memcpy(block + 4, &bits, 4);
+}
+
+// Endpoints from the principal axis (power iteration on the covariance) of the texel colors
+inline void Bc1AxisEndpoints(const float r[16], const float g[16], const float b[16], float e0[3], float e1[3])
+{
+    float mean[3] = {};
+    for (u32 i = 0; i < 16; ++i)
+    {
+        mean[0] += r[i]; mean[1] += g[i]; mean[2] += b[i];
+    }
+    for (u32 c = 0; c < 3; ++c) mean[c] /= 16.f;
+
+    float cov[6] = {};
+    for (u32 i = 0; i < 16; ++i)
+    {
+        const float dr = r[i] - mean[0], dg = g[i] - mean[1], db = b[i] - mean[2];
+        cov[0] += dr * dr; cov[1] += dr * dg; cov[2] += dr * db;
+        cov[3] += dg * dg; cov[4] += dg * db; cov[5] += db * db;
+    }
+
+    float axis[3] = { 0.9f, 1.f, 0.7f };
+    for (u32 iteration = 0; iteration < 4; ++iteration)
+    {
+        const float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+        const float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+        const float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+        const float length = sqrtf(x * x + y * y + z * z);
+        if (length < 1e-6f) break;
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+
+    float minT = 1e30f, maxT = -1e30f;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        const float t = (r[i] - mean[0]) * axis[0] + (g[i] - mean[1]) * axis[1] + (b[i] - mean[2]) * axis[2];
+        minT = t < minT ? t : minT;
+        maxT = t > maxT ? t : maxT;
+    }
+
+    for (u32 c = 0; c < 3; ++c)
+    {
+        e0[c] = fminf(fmaxf(mean[c] + axis[c] * maxT, 0.f), 255.f);
+        e1[c] = fminf(fmaxf(mean[c] + axis[c] * minT, 0.f), 255.f);
+    }
+}
+
+// Least squares endpoints for the given indices (weights 1, 2/3, 1/3, 0 of the first endpoint)
+inline bool Bc1RefineEndpoints(const float r[16], const float g[16], const float b[16], const u32 indices[16], float e0[3], float e1[3])
+{
+    const float weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+    float aa = 0.f, ab = 0.f, bb = 0.f;
+    float ax[3] = {}, bx[3] = {};
+    for (u32 i = 0; i < 16; ++i)
+    {
+        const float a = weights[indices[i]], c = 1.f - a;
+        aa += a * a; ab += a * c; bb += c * c;
+        ax[0] += a * r[i]; ax[1] += a * g[i]; ax[2] += a * b[i];
+        bx[0] += c * r[i]; bx[1] += c * g[i]; bx[2] += c * b[i];
+    }
+
+    const float determinant = aa * bb - ab * ab;
+    if (fabsf(determinant) < 1e-6f) return false;
+
+    for (u32 c = 0; c < 3; ++c)
+    {
+        e0[c] = fminf(fmaxf((ax[c] * bb - bx[c] * ab) / determinant, 0.f), 255.f);
+        e1[c] = fminf(fmaxf((bx[c] * aa - ax[c] * ab) / determinant, 0.f), 255.f);
+    }
+    return true;
+}
+
+// Always a four color block (c0 > c1), as required by the color half of BC3
+inline void CompressBc1Block(const u8 rgba[64], u8* block)
+{
+    float r[16], g[16], b[16];
+    for (u32 i = 0; i < 16; ++i)
+    {
+        r[i] = rgba[i * 4 + 0]; g[i] = rgba[i * 4 + 1]; b[i] = rgba[i * 4 + 2];
+    }
+
+    float e0[3], e1[3];
+    Bc1AxisEndpoints(r, g, b, e0, e1);
+
+    u16 c0 = PackRgb565(e0), c1 = PackRgb565(e1);
+    u32 indices[16];
+    u8 palette[4][4];
+    Bc1Palette(c0, c1, palette, true);
+    u32 error = SelectBc1Indices(r, g, b, palette, indices);
+
+    u32 refinedIndices[16];
+    if (error > 0 && Bc1RefineEndpoints(r, g, b, indices, e0, e1))
+    {
+        const u16 r0 = PackRgb565(e0), r1 = PackRgb565(e1);
+        Bc1Palette(r0, r1, palette, true);
+        const u32 refinedError = SelectBc1Indices(r, g, b, palette, refinedIndices);
+        if (refinedError < error)
+        {
+            c0 = r0;
+            c1 = r1;
+            memcpy(indices, refinedIndices, sizeof(indices));
+        }
+    }
+
+    // Four color mode needs c0 > c1: swapping the endpoints swaps indices 0/1 and 2/3
+    if (c0 < c1)
+    {
+        const u16 swap = c0; c0 = c1; c1 = swap;
+        for (u32 i = 0; i < 16; ++i) indices[i] ^= 1;
+    }
+    else if (c0 == c1)
+    {
+        memset(indices, 0, sizeof(indices));
+    }
+
+    WriteBc1Block(c0, c1, indices, block);
+}
+
+// One channel (stride 4 bytes apart) into 8 bytes, eight value mode
+inline void CompressBc4Block(const u8* values, u8* block)
+{
+    u8 lo = 255, hi = 0;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        lo = values[i * 4] < lo ? values[i * 4] : lo;
+        hi = values[i * 4] > hi ? values[i * 4] : hi;
+    }
+
+    u64 bits = 0;
+    if (hi > lo)
+    {
+        // Position between hi (0) and lo (7) maps to the palette order: hi, lo, then the 6 values in between
+        const float scale = 7.f / (hi - lo);
+        for (u32 i = 0; i < 16; ++i)
+        {
+            const u32 t = (u32)((hi - values[i * 4]) * scale + 0.5f);
+            const u64 index = t == 0 ? 0 : t == 7 ? 1 : t + 1;
+            bits |= index << (3 * i);
+        }
+    }
+
+    block[0] = hi;
+    block[1] = lo;
+    for (u32 i = 0; i < 6; ++i) block[2 + i] = (u8)(bits >> (8 * i));
+}
+
+inline void DecompressBc1Block(const u8* block, u8 rgba[64], bool forceFourColors)
+{
+    const u16 c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+    u8 palette[4][4];
+    Bc1Palette(c0, c1, palette, forceFourColors);
+
+    u32 bits;
+    memcpy(&bits, block + 4, 4);
+    for (u32 i = 0; i < 16; ++i)
+        memcpy(rgba + i * 4, palette[(bits >> (2 * i)) & 3], 4);
+}
+
+inline void DecompressBc4Block(const u8* block, u8* values)
+{
+    u8 palette[8];
+    palette[0] = block[0];
+    palette[1] = block[1];
+    for (u32 k = 1; k < 7; ++k)
+    {
+        if (block[0] > block[1]) palette[k + 1] = (u8)(((7 - k) * block[0] + k * block[1]) / 7);
+        else palette[k + 1] = k < 5 ? (u8)(((5 - k) * block[0] + k * block[1]) / 5) : (k == 5 ? 0 : 255);
+    }
+
+    u64 bits = 0;
+    for (u32 i = 0; i < 6; ++i) bits |= (u64)block[2 + i] << (8 * i);
+    for (u32 i = 0; i < 16; ++i)
+        values[i * 4] = palette[(bits >> (3 * i)) & 7];
+}
+
+inline void CompressBlock(const u8 rgba[64], BlockFormat format, u8* block)
+{
+    switch (format)
+    {
+    case BF_BC1: CompressBc1Block(rgba, block); break;
+    case BF_BC3: CompressBc4Block(rgba + 3, block); CompressBc1Block(rgba, block + 8); break;
+    case BF_BC5: CompressBc4Block(rgba + 0, block); CompressBc4Block(rgba + 1, block + 8); break;
+    default: break;
+    }
+}
+
+inline void DecompressBlock(const u8* block, BlockFormat format, u8 rgba[64])
+{
+    switch (format)
+    {
+    case BF_BC1: DecompressBc1Block(block, rgba, false); break;
+    case BF_BC3: DecompressBc1Block(block + 8, rgba, true); DecompressBc4Block(block, rgba + 3); break;
+    case BF_BC5:
+        memset(rgba, 0, 64);
+        DecompressBc4Block(block, rgba + 0);
+        DecompressBc4Block(block + 8, rgba + 1);
+        break;
+    default: break;
+    }
+}
+
+// Compresses one level of RGBA8 texels (tightly packed) into LevelBytes() bytes
+inline void CompressLevel(const u8* rgba, u32 width, u32 height, BlockFormat format, u8* blocks)
+{
+    if (format == BF_RGBA8)
+    {
+        memcpy(blocks, rgba, (u64)width * height * 4);
+        return;
+    }
+
+    const u32 blockBytes = BlockBytes(format);
+    u8 texels[64];
+    for (u32 by = 0; by < height; by += 4)
+    {
+        for (u32 bx = 0; bx < width; bx += 4)
+        {
+            for (u32 y = 0; y < 4; ++y)
+            {
+                const u32 sy = by + y < height ? by + y : height - 1;
+                for (u32 x = 0; x < 4; ++x)
+                {
+                    const u32 sx = bx + x < width ? bx + x : width - 1;
+                    memcpy(texels + (y * 4 + x) * 4, rgba + ((u64)sy * width + sx) * 4, 4);
+                }
+            }
+            CompressBlock(texels, format, blocks);
+            blocks += blockBytes;
+        }
+    }
+}
+
+inline void DecompressLevel(const u8* blocks, u32 width, u32 height, BlockFormat format, u8* rgba)
+{
+    if (format == BF_RGBA8)
+    {
+        memcpy(rgba, blocks, (u64)width * height * 4);
+        return;
+    }
+
+    const u32 blockBytes = BlockBytes(format);
+    u8 texels[64];
+    for (u32 by = 0; by < height; by += 4)
+    {
+        for (u32 bx = 0; bx < width; bx += 4)
+        {
+            DecompressBlock(blocks, format, texels);
+            blocks += blockBytes;
+            for (u32 y = 0; y < 4 && by + y < height; ++y)
+                for (u32 x = 0; x < 4 && bx + x < width; ++x)
+                    memcpy(rgba + ((u64)(by + y) * width + bx + x) * 4, texels + (y * 4 + x) * 4, 4);
+        }
+    }
+}
+
+// Peak signal to noise ratio in dB over the channels the format keeps (RGB, RGBA or RG)
+inline f64 ComputeCompressionPsnr(const u8* original, const u8* decoded, u64 texels, BlockFormat format)
+{
+    const u32 channels = format == BF_BC1 ? 3 : format == BF_BC5 ? 2 : 4;
+    f64 squaredError = 0.0;
+    for (u64 i = 0; i < texels; ++i)
+    {
+        for (u32 c = 0; c < channels; ++c)
+        {
+            const f64 difference = (f64)original[i * 4 + c] - decoded[i * 4 + c];
+            squaredError += difference * difference;
+        }
+    }
+
+    const f64 mse = squaredError / (texels * channels);
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
@@ -0,0 +1,323 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <glad/glad.h>
+#include "platform.h"
+
+// ARB_bindless_texture, not in the core profile the loader was generated for
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+
+struct BindlessTextureProcs
+{
+	PFNGLGETTEXTUREHANDLEARBPROC getTextureHandle = nullptr;
+	PFNGLMAKETEXTUREHANDLERESIDENTARBPROC makeResident = nullptr;
+	PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC makeNonResident = nullptr;
+};
+
+#define TEXTURE_ARRAY_MIN_LAYERS 4
+#define TEXTURE_ARRAY_MAX_LAYERS 64
+
+// How a shader reaches a texture, an entry of the material table (std430, see the model shaders)
+struct TextureReference
+{
+	u32 reference[2]; // Bindless handle, or texture array unit and layer
+	f32 minLod;       // Finest level sampled, relative to the storage
+	u32 pad;
+};
+
+struct TextureStorageStats
+{
+	bool bindless = false;
+	u32 textures = 0;
+	u32 buckets = 0;
+	u32 pages = 0;
+	u32 boundPages = 0;
+	u32 layers = 0;
+	u32 usedLayers = 0;
+	u64 bytes = 0;     // Allocated by the pages
+	u64 usedBytes = 0; // Of the layers in use
+};
+
+// Storage of every texture, so shaders can sample any of them without a bind per draw.
+// With ARB_bindless_texture each texture is a plain immutable texture made resident through a view of it
+// (a handle freezes the state of its texture, and the streaming still changes the base level of the texture).
+// Otherwise textures are layers of texture arrays shared by every texture of the same format, size and level
+// count, allocated in pages of growing capacity. Each layer is handed out as a 2D view of it, so uploads,
+// copies and the code binding single textures don't know the difference. The pages are bound to units once
+// per frame, the last unit is kept for the pages that didn't get one, which are bound per draw.
+class TextureStorage
+{
+public:
+
+	// Bindless when the procs are given, texture arrays on `units` texture units otherwise
+	void Init(u32 units, const BindlessTextureProcs* bindless)
+	{
+		this->units = units;
+		if (bindless) procs = *bindless;
+	}
+
+	bool Bindless() const { return procs.getTextureHandle != nullptr; }
+	u32 Units() const { return units; }
+
+	// Immutable 2D storage of `levels` levels, `bytes` in total, bound to GL_TEXTURE_2D when it returns
+	GLuint Allocate(GLenum format, u32 levels, u32 width, u32 height, u64 bytes)
+	{
+		Allocation allocation;
+		allocation.format = format;
+		allocation.levels = levels;
+
+		GLuint handle;
+		glGenTextures(1, &handle);
+		if (Bindless())
+		{
+			glBindTexture(GL_TEXTURE_2D, handle);
+			glTexStorage2D(GL_TEXTURE_2D, levels, format, width, height);
+			allocations[handle] = allocation;
+			return handle;
+		}
+
+		const u32 bucketIndex = FindBucket(format, levels, width, height, bytes);
+		allocation.page = FindPage(bucketIndex);
+		Page& page = pages[allocation.page];
+		allocation.layer = page.freeLayers.back();
+		page.freeLayers.pop_back();
+		page.used++;
+
+		glTextureView(handle, GL_TEXTURE_2D, page.handle, format, 0, levels, allocation.layer, 1);
+		glBindTexture(GL_TEXTURE_2D, handle);
+		allocations[handle] = allocation;
+		return handle;
+	}
+
+	void Free(GLuint handle)
+	{
+		std::unordered_map<GLuint, Allocation>::iterator it = allocations.find(handle);
+		glDeleteTextures(1, &handle);
+		if (it == allocations.end()) return;
+
+		const Allocation allocation = it->second;
+		allocations.erase(it);
+		if (allocation.bindless)
+		{
+			procs.makeNonResident(allocation.bindless);
+			glDeleteTextures(1, &allocation.view);
+		}
+		if (allocation.page == UINT32_MAX) return;
+
+		Page& page = pages[allocation.page];
+		page.freeLayers.push_back(allocation.layer);
+		if (--page.used > 0) return;
+
+		// Empty pages go, the next texture of the bucket gets a new one
+		Bucket& bucket = buckets[page.bucket];
+		bucket.pages.erase(std::find(bucket.pages.begin(), bucket.pages.end(), allocation.page));
+		bucket.capacity -= page.capacity;
+		glDeleteTextures(1, &page.handle);
+		page = Page();
+		freePages.push_back(allocation.page);
+	}
+
+	// Gives the pages their units for this frame and binds them, the overflow unit is left to the draws
+	void BindPages()
+	{
+		if (Bindless()) return;
+
+		u32 unit = 0;
+		for (std::vector<Page>::iterator it = pages.begin(); it != pages.end(); ++it)
+		{
+			if (!it->handle) continue;
+
+			it->unit = unit + 1 < units ? unit++ : units - 1;
+			if (it->unit == units - 1) continue;
+
+			glActiveTexture(GL_TEXTURE0 + it->unit);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, it->handle);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// Entry of the material table for a texture of this storage. `overflowPage` is set to the array to bind
+	// on the last unit before drawing with it, or 0 when the page has a unit of its own.
+	TextureReference Reference(GLuint handle, f32 minLod, GLuint* overflowPage)
+	{
+		TextureReference result = {};
+		result.minLod = minLod;
+		*overflowPage = 0;
+
+		std::unordered_map<GLuint, Allocation>::iterator it = allocations.find(handle);
+		if (it == allocations.end()) return result;
+
+		Allocation& allocation = it->second;
+		if (Bindless())
+		{
+			if (!allocation.bindless) MakeResident(handle, allocation);
+			result.reference[0] = (u32)allocation.bindless;
+			result.reference[1] = (u32)(allocation.bindless >> 32);
+			return result;
+		}
+
+		const Page& page = pages[allocation.page];
+		result.reference[0] = page.unit;
+		result.reference[1] = allocation.layer;
+		if (page.unit == units - 1) *overflowPage = page.handle;
+		return result;
+	}
+
+	TextureStorageStats Stats() const
+	{
+		TextureStorageStats result;
+		result.bindless = Bindless();
+		result.textures = allocations.size();
+		result.buckets = buckets.size();
+		for (std::vector<Page>::const_iterator it = pages.begin(); it != pages.end(); ++it)
+		{
+			if (!it->handle) continue;
+
+			const u64 layerBytes = buckets[it->bucket].layerBytes;
+			result.pages++;
+			if (it->unit != units - 1) result.boundPages++;
+			result.layers += it->capacity;
+			result.usedLayers += it->used;
+			result.bytes += layerBytes * it->capacity;
+			result.usedBytes += layerBytes * it->used;
+		}
+		return result;
+	}
+
+	void Release()
+	{
+		for (std::unordered_map<GLuint, Allocation>::iterator it = allocations.begin(); it != allocations.end(); ++it)
+		{
+			if (it->second.bindless)
+			{
+				procs.makeNonResident(it->second.bindless);
+				glDeleteTextures(1, &it->second.view);
+			}
+			glDeleteTextures(1, &it->first);
+		}
+		for (std::vector<Page>::iterator it = pages.begin(); it != pages.end(); ++it)
+			if (it->handle) glDeleteTextures(1, &it->handle);
+
+		allocations.clear();
+		pages.clear();
+		freePages.clear();
+		buckets.clear();
+		bucketSlots.clear();
+	}
+
+private:
+
+	struct Bucket
+	{
+		GLenum format = GL_NONE;
+		u32 levels = 0;
+		u32 width = 0;
+		u32 height = 0;
+		u64 layerBytes = 0;
+		u32 capacity = 0;       // Of all its pages, the next one doubles it
+		std::vector<u32> pages;
+	};
+
+	struct Page
+	{
+		GLuint handle = 0;
+		u32 bucket = 0;
+		u32 capacity = 0;
+		u32 used = 0;
+		u32 unit = 0;
+		std::vector<u32> freeLayers;
+	};
+
+	struct Allocation
+	{
+		GLenum format = GL_NONE;
+		u32 levels = 0;
+		u32 page = UINT32_MAX;
+		u32 layer = 0;
+		GLuint view = 0;       // Bindless only, the texture the handle was made from
+		GLuint64 bindless = 0;
+	};
+
+	u32 FindBucket(GLenum format, u32 levels, u32 width, u32 height, u64 bytes)
+	{
+		const u64 key = ((u64)format << 48) | ((u64)levels << 40) | ((u64)width << 20) | height;
+		std::unordered_map<u64, u32>::const_iterator it = bucketSlots.find(key);
+		if (it != bucketSlots.end()) return it->second;
+
+		Bucket bucket;
+		bucket.format = format;
+		bucket.levels = levels;
+		bucket.width = width;
+		bucket.height = height;
+		bucket.layerBytes = bytes;
+		buckets.push_back(bucket);
+		bucketSlots[key] = buckets.size() - 1;
+		return buckets.size() - 1;
+	}
+
+	u32 FindPage(u32 bucketIndex)
+	{
+		Bucket& bucket = buckets[bucketIndex];
+		for (std::vector<u32>::const_iterator it = bucket.pages.begin(); it != bucket.pages.end(); ++it)
+			if (!pages[*it].freeLayers.empty()) return *it;
+
+		Page page;
+		page.bucket = bucketIndex;
+		page.capacity = std::min(std::max(bucket.capacity, (u32)TEXTURE_ARRAY_MIN_LAYERS), (u32)TEXTURE_ARRAY_MAX_LAYERS);
+		page.unit = units - 1;
+		for (u32 i = page.capacity; i > 0; --i)
+			page.freeLayers.push_back(i - 1);
+
+		glGenTextures(1, &page.handle);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, page.handle);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, bucket.levels, bucket.format, bucket.width, bucket.height, page.capacity);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, bucket.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		bucket.capacity += page.capacity;
+
+		u32 index = 0;
+		if (!freePages.empty())
+		{
+			index = freePages.back();
+			freePages.pop_back();
+			pages[index] = page;
+		}
+		else
+		{
+			index = pages.size();
+			pages.push_back(page);
+		}
+		bucket.pages.push_back(index);
+		return index;
+	}
+
+	// The view gets the sampling state of the texture, which can't change once it has a handle
+	void MakeResident(GLuint handle, Allocation& allocation)
+	{
+		glGenTextures(1, &allocation.view);
+		glTextureView(allocation.view, GL_TEXTURE_2D, handle, allocation.format, 0, allocation.levels, 0, 1);
+		glBindTexture(GL_TEXTURE_2D, allocation.view);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, allocation.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		allocation.bindless = procs.getTextureHandle(allocation.view);
+		procs.makeResident(allocation.bindless);
+	}
+
+	std::vector<Bucket> buckets;
+	std::unordered_map<u64, u32> bucketSlots; // Format, levels and size -> bucket
+	std::vector<Page> pages;
+	std::vector<u32> freePages;
+	std::unordered_map<GLuint, Allocation> allocations; // By the handle given out
+	BindlessTextureProcs procs;
+	u32 units = 16;
+};
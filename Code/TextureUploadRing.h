@@ -0,0 +1,106 @@
+#pragma once
+#include <string.h>
+#include <vector>
+#include <glad/glad.h>
+#include "platform.h"
+
+// ARB_buffer_storage is core in 4.4, the loader only goes up to 4.3
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT   0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// Pixel unpack buffer split in segments used round robin to stage texture uploads. Each segment is
+// fenced after the upload that reads it, and only written again once the GPU is done with it, so the
+// CPU never waits: Map() returns null while the next segment is still in flight.
+// With glBufferStorage the buffer is mapped once (persistent and coherent), otherwise every segment
+// is mapped unsynchronized (the fence already protects it) and unmapped before the upload.
+class TextureUploadRing
+{
+public:
+
+	void Init(u32 segmentCount, u32 segmentSize, PFNGLBUFFERSTORAGEPROC bufferStorage)
+	{
+		this->segmentSize = segmentSize;
+		fences.assign(segmentCount, (GLsync)0);
+
+		const GLsizeiptr size = (GLsizeiptr)segmentCount * segmentSize;
+		glGenBuffers(1, &handle);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, handle);
+		if (bufferStorage)
+		{
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			bufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+			persistent = (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+		}
+		else
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	void Release()
+	{
+		for (std::vector<GLsync>::iterator it = fences.begin(); it != fences.end(); ++it)
+			if (*it) glDeleteSync(*it);
+		fences.clear();
+
+		if (persistent)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, handle);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			persistent = nullptr;
+		}
+		if (handle) glDeleteBuffers(1, &handle);
+		handle = 0;
+	}
+
+	// Write pointer to `size` bytes (at most SegmentSize()) of the next segment, with the buffer bound.
+	// Null if the GPU is still reading the segment.
+	u8* Map(u32 size)
+	{
+		GLsync& fence = fences[current];
+		if (fence)
+		{
+			if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) return nullptr;
+			glDeleteSync(fence);
+			fence = 0;
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, handle);
+		if (persistent) return persistent + Offset();
+
+		return (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, Offset(), size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	}
+
+	// Offset of the mapped segment, to be used as the pixels pointer of the upload
+	u32 Unmap()
+	{
+		if (!persistent) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		return Offset();
+	}
+
+	// Call after the upload that reads the segment, moves to the next one
+	void Fence()
+	{
+		fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		current = (current + 1) % fences.size();
+	}
+
+	u32 SegmentSize() const { return segmentSize; }
+	bool Persistent() const { return persistent != nullptr; }
+
+private:
+
+	u32 Offset() const { return current * segmentSize; }
+
+	GLuint handle = 0;
+	u8* persistent = nullptr;
+	u32 segmentSize = 0;
+	u32 current = 0;
+	std::vector<GLsync> fences;
+};
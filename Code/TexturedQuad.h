@@ -44,12 +44,10 @@ public:
 public:
 
 	Vao vao;
-	GLuint texture;
+	GLuint texture = UINT32_MAX; // Slot of app->textures, only quads drawn with a texture have one
 
 	GLuint lightingPassProgram;
 	GLuint textureProgram;
 	GLuint bloomProgram;
 
-	GLuint textureProgramUniform;
-
 };
@@ -1,15 +1,26 @@
 #pragma once
+#include <glad/glad.h>
 
 struct VertexBufferAttribute
 {
-	VertexBufferAttribute(unsigned char location, unsigned char componentCount)
+	VertexBufferAttribute(unsigned char location, unsigned char componentCount, GLenum type = GL_FLOAT, bool normalized = false)
 	{
 		this->location = location;
 		this->componentCount = componentCount;
 		this->offset = 0;
+		this->stride = 0;
+		this->type = type;
+		this->normalized = normalized;
 	}
 
 	unsigned char location;
 	unsigned char componentCount;
-	unsigned char offset;
+	unsigned int offset;
+
+	// Own stride for attributes in separate (non interleaved) arrays, 0 uses the layout stride
+	unsigned char stride;
+
+	// Component type as read by glVertexAttribPointer, integer types can be normalized
+	GLenum type;
+	bool normalized;
 };
@@ -0,0 +1,88 @@
+#pragma once
+#include <string.h>
+#include <glad/glad.h>
+#include <glm/gtc/packing.hpp>
+#include "platform.h"
+#include "Typedef.h"
+#include "Mesh.h"
+#include "Program.h"
+
+// Vertex formats the import path can emit:
+// VF_FLOAT      pos f32x3 | normal f32x3 | uv f32x2 | tangent f32x3 | bitangent f32x3      (56 / 32 bytes)
+// VF_QUANTIZED  pos unorm16x3 | bitangent sign snorm16 | normal oct snorm16x2 | uv f16x2
+//               | tangent oct snorm16x2                                                  (20 / 16 bytes)
+// Quantized positions are relative to the mesh AABB and decoded in the vertex shader with
+// uPositionOffset/uPositionScale, octahedral normals are decoded when uOctahedralNormals is set.
+// The bitangent is rebuilt as cross(normal, tangent) * sign.
+enum VertexFormat
+{
+    VF_FLOAT,
+    VF_QUANTIZED
+};
+
+// Vertices are written in place into an exactly sized stream, the cursor is advanced
+template <typename T>
+inline void WriteVertexValue(u8*& cursor, T value)
+{
+    memcpy(cursor, &value, sizeof(T));
+    cursor += sizeof(T);
+}
+
+inline u16 QuantizeUnorm16(float value)
+{
+    return (u16)(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+inline i16 QuantizeSnorm16(float value)
+{
+    return (i16)glm::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+// Maps a unit vector to the [-1, 1] square of an octahedron unfolded over the xy plane
+inline vec2 OctahedralEncode(vec3 n)
+{
+    n /= glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    vec2 e = vec2(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        vec2 signs = vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+        e = (vec2(1.0f) - glm::abs(vec2(e.y, e.x))) * signs;
+    }
+    return e;
+}
+
+inline void WriteOctahedralSnorm16(u8*& cursor, vec3 n)
+{
+    vec2 e = OctahedralEncode(n);
+    WriteVertexValue<i16>(cursor, QuantizeSnorm16(e.x));
+    WriteVertexValue<i16>(cursor, QuantizeSnorm16(e.y));
+}
+
+inline void WriteHalf2(u8*& cursor, float x, float y)
+{
+    WriteVertexValue<u32>(cursor, glm::packHalf2x16(vec2(x, y)));
+}
+
+// Uniform locations of the vertex decode parameters, per program
+struct VertexDecodeUniforms
+{
+    GLint positionOffset = -1;
+    GLint positionScale = -1;
+    GLint octahedralNormals = -1;
+};
+
+inline VertexDecodeUniforms GetVertexDecodeUniforms(const Program& program)
+{
+    VertexDecodeUniforms uniforms;
+    uniforms.positionOffset = program.Uniform(NAME_HASH("uPositionOffset"));
+    uniforms.positionScale = program.Uniform(NAME_HASH("uPositionScale"));
+    uniforms.octahedralNormals = program.Uniform(NAME_HASH("uOctahedralNormals"));
+    return uniforms;
+}
+
+inline void SetVertexDecodeUniforms(const VertexDecodeUniforms& uniforms, const Mesh* mesh)
+{
+    glUniform3fv(uniforms.positionOffset, 1, &mesh->positionOffset.x);
+    glUniform3fv(uniforms.positionScale, 1, &mesh->positionScale.x);
+    glUniform1i(uniforms.octahedralNormals, mesh->octahedralNormals ? 1 : 0);
+}
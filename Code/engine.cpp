@@ -3,6 +3,9 @@
 #include <stb_image.h>
 #include <stb_image_write.h>
 #include "AssimpLoading.h"
+#include "AssetPack.h"
+#include "CookedTexture.h"
+#include "ProgramBinaryCache.h"
 #include <glm/gtc/type_ptr.hpp>
 #include "BufferManagement.h"
 #include "Light.h"
@@ -12,109 +15,299 @@
 #define BINDING(b) b
 #define ALIGN(value, alignment) (value + alignment - 1) & ~(alignment - 1)
 
-GLuint CreateProgramFromSource(String programSource, const char* shaderName)
+// Issues the compile and link of a program without waiting for either, FinishProgramBuild() reads the result.
+// With a binarySeed (see ProgramBinaryCache.h) the program is read from the binary cache when it has it, and
+// saved there once built from the source otherwise. 0 always builds from the source.
+ProgramBuild BeginProgramBuild(String programSource, const char* shaderName, const char* defines, u64 binarySeed = 0)
 {
-    GLchar  infoLogBuffer[1024] = {};
-    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
-    GLsizei infoLogSize;
-    GLint   success;
-
     char versionString[] = "#version 430\n";
     char shaderNameDefine[128];
     sprintf(shaderNameDefine, "#define %s\n", shaderName);
     char vertexShaderDefine[] = "#define VERTEX\n";
     char fragmentShaderDefine[] = "#define FRAGMENT\n";
 
+    ProgramBuild build;
+    if (binarySeed)
+    {
+        build.binaryKey = HashBytes(programSource.str, programSource.len, HashString(shaderNameDefine, HashString(defines, HashString(versionString, binarySeed))));
+
+        build.handle = glCreateProgram();
+        if (LoadProgramBinary(build.handle, build.binaryKey))
+        {
+            build.fromBinary = true;
+            return build;
+        }
+        // Missing or rejected by the driver, built from the source below
+        glDeleteProgram(build.handle);
+    }
+
     const GLchar* vertexShaderSource[] = {
         versionString,
+        defines,
         shaderNameDefine,
         vertexShaderDefine,
         programSource.str
     };
     const GLint vertexShaderLengths[] = {
         (GLint) strlen(versionString),
+        (GLint) strlen(defines),
         (GLint) strlen(shaderNameDefine),
         (GLint) strlen(vertexShaderDefine),
         (GLint) programSource.len
     };
     const GLchar* fragmentShaderSource[] = {
         versionString,
+        defines,
         shaderNameDefine,
         fragmentShaderDefine,
         programSource.str
     };
     const GLint fragmentShaderLengths[] = {
         (GLint) strlen(versionString),
+        (GLint) strlen(defines),
         (GLint) strlen(shaderNameDefine),
         (GLint) strlen(fragmentShaderDefine),
         (GLint) programSource.len
     };
 
-    GLuint vshader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vshader, ARRAY_COUNT(vertexShaderSource), vertexShaderSource, vertexShaderLengths);
-    glCompileShader(vshader);
-    glGetShaderiv(vshader, GL_COMPILE_STATUS, &success);
+    // No status is asked for here, that would make the driver finish each stage before the next one is issued
+    build.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(build.vertexShader, ARRAY_COUNT(vertexShaderSource), vertexShaderSource, vertexShaderLengths);
+    glCompileShader(build.vertexShader);
+
+    build.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(build.fragmentShader, ARRAY_COUNT(fragmentShaderSource), fragmentShaderSource, fragmentShaderLengths);
+    glCompileShader(build.fragmentShader);
+
+    build.handle = glCreateProgram();
+    if (binarySeed) glProgramParameteri(build.handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(build.handle, build.vertexShader);
+    glAttachShader(build.handle, build.fragmentShader);
+    glLinkProgram(build.handle);
+
+    return build;
+}
+
+// True once the driver is done with the build, so FinishProgramBuild() won't wait for it. Without
+// GL_KHR_parallel_shader_compile there is no way to ask and it is always reported as done.
+bool ProgramBuildReady(const ProgramBuild& build, bool parallelCompile)
+{
+    if (!parallelCompile || build.fromBinary) return true;
+
+    GLint complete = GL_FALSE;
+    glGetProgramiv(build.handle, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete != GL_FALSE;
+}
+
+// Reads the compile and link status (waiting for the driver if it isn't done), logs the errors, saves the binary
+// and releases the shaders. The program is left to the caller even when it failed to link.
+bool FinishProgramBuild(ProgramBuild& build, const char* shaderName)
+{
+    if (build.fromBinary) return true;
+
+    GLchar  infoLogBuffer[1024] = {};
+    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
+    GLsizei infoLogSize;
+    GLint   success;
+
+    glGetShaderiv(build.vertexShader, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(vshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        glGetShaderInfoLog(build.vertexShader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
         ELOG("glCompileShader() failed with vertex shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
     }
 
-    GLuint fshader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fshader, ARRAY_COUNT(fragmentShaderSource), fragmentShaderSource, fragmentShaderLengths);
-    glCompileShader(fshader);
-    glGetShaderiv(fshader, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(build.fragmentShader, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(fshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        glGetShaderInfoLog(build.fragmentShader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
         ELOG("glCompileShader() failed with fragment shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
     }
 
-    GLuint programHandle = glCreateProgram();
-    glAttachShader(programHandle, vshader);
-    glAttachShader(programHandle, fshader);
-    glLinkProgram(programHandle);
-    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
-    if (!success)
+    GLint linked;
+    glGetProgramiv(build.handle, GL_LINK_STATUS, &linked);
+    if (!linked)
     {
-        glGetProgramInfoLog(programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        glGetProgramInfoLog(build.handle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
         ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
     }
+    else if (build.binaryKey)
+    {
+        SaveProgramBinary(build.handle, build.binaryKey);
+    }
 
-    glUseProgram(0);
+    glDetachShader(build.handle, build.vertexShader);
+    glDetachShader(build.handle, build.fragmentShader);
+    glDeleteShader(build.vertexShader);
+    glDeleteShader(build.fragmentShader);
+    build.vertexShader = build.fragmentShader = 0;
+
+    return linked != 0;
+}
 
-    glDetachShader(programHandle, vshader);
-    glDetachShader(programHandle, fshader);
-    glDeleteShader(vshader);
-    glDeleteShader(fshader);
+// Deletes a build without waiting for the driver or reading its status, nothing of it reaches the binary cache
+void AbandonProgramBuild(ProgramBuild& build)
+{
+    // Deleting the program detaches its shaders, they go away with it
+    if (build.vertexShader) glDeleteShader(build.vertexShader);
+    if (build.fragmentShader) glDeleteShader(build.fragmentShader);
+    glDeleteProgram(build.handle);
+    build = ProgramBuild();
+}
 
-    return programHandle;
+// Builds a program and waits for it
+GLuint CreateProgramFromSource(String programSource, const char* shaderName, const char* defines, u64 binarySeed = 0, bool* fromBinary = nullptr)
+{
+    ProgramBuild build = BeginProgramBuild(programSource, shaderName, defines, binarySeed);
+    FinishProgramBuild(build, shaderName);
+    if (fromBinary) *fromBinary = build.fromBinary;
+    return build.handle;
 }
 
-u32 LoadProgram(App* app, const char* filepath, const char* programName)
+// Fills the resource table of a linked program, names are hashed once here instead of looked up every frame
+void ReflectProgram(Program& program)
 {
-    String programSource = ReadTextFile(filepath);
+    program.resources.clear();
+
+    const GLenum interfaces[] = { GL_UNIFORM, GL_UNIFORM_BLOCK, GL_SHADER_STORAGE_BLOCK };
+    const ProgramResourceKind kinds[] = { PRK_UNIFORM, PRK_UNIFORM_BLOCK, PRK_STORAGE_BLOCK };
+    for (u32 i = 0; i < ARRAY_COUNT(interfaces); ++i)
+    {
+        GLint count = 0, maxNameLength = 0;
+        glGetProgramInterfaceiv(program.handle, interfaces[i], GL_ACTIVE_RESOURCES, &count);
+        glGetProgramInterfaceiv(program.handle, interfaces[i], GL_MAX_NAME_LENGTH, &maxNameLength);
+
+        std::vector<char> name(maxNameLength + 1);
+        for (GLint r = 0; r < count; ++r)
+        {
+            ProgramResource resource = {};
+            resource.kind = kinds[i];
+            if (interfaces[i] == GL_UNIFORM)
+            {
+                // Members of blocks have no location, the block is reflected instead
+                const GLenum properties[] = { GL_BLOCK_INDEX, GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE };
+                GLint values[ARRAY_COUNT(properties)] = {};
+                glGetProgramResourceiv(program.handle, GL_UNIFORM, r, ARRAY_COUNT(properties), properties, ARRAY_COUNT(values), nullptr, values);
+                if (values[0] != -1) continue;
+                resource.location = values[1];
+                resource.type = values[2];
+                resource.size = values[3];
+            }
+            else
+            {
+                const GLenum properties[] = { GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+                GLint values[ARRAY_COUNT(properties)] = {};
+                glGetProgramResourceiv(program.handle, interfaces[i], r, ARRAY_COUNT(properties), properties, ARRAY_COUNT(values), nullptr, values);
+                resource.location = values[0];
+                resource.size = values[1];
+            }
+
+            GLsizei length = 0;
+            glGetProgramResourceName(program.handle, interfaces[i], r, name.size(), &length, name.data());
+            // Arrays are named after their first element, looked up by the name of the array
+            if (length > 3 && strcmp(&name[length - 3], "[0]") == 0) name[length - 3] = '\0';
+            resource.nameHash = HashName(name.data());
+            program.resources.push_back(resource);
+        }
+    }
+
+    std::sort(program.resources.begin(), program.resources.end());
+    for (u32 i = 1; i < program.resources.size(); ++i)
+        if (program.resources[i].nameHash == program.resources[i - 1].nameHash && program.resources[i].kind == program.resources[i - 1].kind)
+            ELOG("Two resources of %s have the same name hash %08x, one of them can't be found", program.programName.c_str(), program.resources[i].nameHash);
+}
+
+struct ProgramRequest
+{
+    const char* filepath;
+    const char* programName;
+    const char* permutation;
+};
+
+// Loads a batch of program variants into slots: every compile is issued before any of them is waited for, so
+// the driver can build them side by side. Variants loaded before answer from their slot without compiling.
+// The permutation is a set of #define lines, programs differing only in it are different variants.
+void LoadPrograms(App* app, const ProgramRequest* requests, u32 count, u32* slots)
+{
+    const f64 start = GetPerformanceTime();
+    f64 binarySeconds = 0.0;
+    std::vector<u32> building;
+    for (u32 i = 0; i < count; ++i)
+    {
+        const ProgramRequest& request = requests[i];
+        const std::string key = std::string(request.filepath) + '\n' + request.programName + '\n' + request.permutation;
+        const u64 keyHash = HashString(key.c_str());
+        std::unordered_map<u64, u32>::const_iterator it = app->programSlots.find(keyHash);
+        if (it != app->programSlots.end())
+        {
+            app->programCacheHits++;
+            slots[i] = it->second;
+            continue;
+        }
+
+        const f64 issueStart = GetPerformanceTime();
+        String programSource = ReadTextFile(request.filepath);
+        const std::string defines = app->shaderDefines + request.permutation;
+
+        Program program = {};
+        ProgramBuild build = BeginProgramBuild(programSource, request.programName, defines.c_str(), app->programBinarySeed);
+        program.handle = build.handle;
+        program.filepath = request.filepath;
+        program.programName = request.programName;
+        program.permutation = request.permutation;
+        app->programs.emplace_back(new Program(program));
+        app->fileWatcher.Watch(request.filepath);
+
+        slots[i] = app->programs.size() - 1;
+        app->programSlots[keyHash] = slots[i];
+        if (build.fromBinary)
+        {
+            const f64 seconds = GetPerformanceTime() - issueStart;
+            binarySeconds += seconds;
+            app->programBinaryLoads++;
+            app->programBinarySeconds += seconds;
+            ReflectProgram(*app->programs.back());
+            ILOG("Loaded %s from the binary cache in %.2f ms", request.programName, seconds * 1000.0);
+        }
+        else
+        {
+            // Held by the program until it is finished below
+            app->programs.back()->pending = build;
+            building.push_back(slots[i]);
+        }
+    }
+    if (building.empty()) return;
+
+    for (u32 i = 0; i < building.size(); ++i)
+    {
+        Program& program = *app->programs[building[i]];
+        FinishProgramBuild(program.pending, program.programName.c_str());
+        program.pending = ProgramBuild();
+        ReflectProgram(program);
+        ILOG("Compiled %s from %s", program.programName.c_str(), program.filepath.c_str());
+    }
 
-    Program program = {};
-    program.handle = CreateProgramFromSource(programSource, programName);
-    program.filepath = filepath;
-    program.programName = programName;
-    program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
-    app->programs.emplace_back(new Program(program));
+    // Spent on the ones built from source, binary loads were already counted
+    const f64 seconds = GetPerformanceTime() - start - binarySeconds;
+    app->programCompiles += building.size();
+    app->programCompileSeconds += seconds;
+    ILOG("%u programs compiled in %.2f ms", (u32)building.size(), seconds * 1000.0);
+}
 
-    return app->programs.size() - 1;
+// Returns the slot of the program variant, compiled the first time it is asked for
+u32 LoadProgram(App* app, const char* filepath, const char* programName, const char* permutation = "")
+{
+    const ProgramRequest request = { filepath, programName, permutation };
+    u32 slot = 0;
+    LoadPrograms(app, &request, 1, &slot);
+    return slot;
 }
 
 Image LoadImage(const char* filename)
 {
     Image img = {};
     stbi_set_flip_vertically_on_load(true);
-    img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
-    if (img.pixels)
-    {
-        img.stride = img.size.x * img.nchannels;
-    }
-    else
+    if (!DecodeImageFile(filename, img))
     {
         ELOG("Could not open file %s", filename);
     }
@@ -126,62 +319,448 @@ void FreeImage(Image image)
     stbi_image_free(image.pixels);
 }
 
-GLuint CreateTexture2DFromImage(Image image)
-{
-    GLenum internalFormat = GL_RGB8;
-    GLenum dataFormat     = GL_RGB;
-    GLenum dataType       = GL_UNSIGNED_BYTE;
+// EXT_texture_compression_s3tc, not in the core profile the loader was generated for
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
 
-    switch (image.nchannels)
+GLenum TextureInternalFormat(BlockFormat format)
+{
+    switch (format)
     {
-        case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; break;
-        case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
-        default: ELOG("LoadTexture2D() - Unsupported number of channels");
+        case BF_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BF_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BF_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BF_RGBA8: return GL_RGBA8;
+        default: return GL_NONE;
     }
+}
 
-    GLuint texHandle;
-    glGenTextures(1, &texHandle);
-    glBindTexture(GL_TEXTURE_2D, texHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+// Allocates the mip chain of a cooked texture from firstLevel down, its levels are uploaded by UploadTextureLevel()
+GLuint CreateTexture2DStorage(TextureStorage& storage, const CookedTexture& cooked, u32 firstLevel = 0)
+{
+    const u32 levels = cooked.levelCount - firstLevel;
+    GLuint texHandle = storage.Allocate(TextureInternalFormat(cooked.format), levels, std::max(1u, cooked.width >> firstLevel),
+                                        std::max(1u, cooked.height >> firstLevel), CookedTextureBytes(cooked, firstLevel));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glGenerateMipmap(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, 0);
 
     return texHandle;
 }
 
-u32 LoadTexture2D(App* app, const char* filepath)
+// Uploads `rows` rows (of blocks when compressed) of a level into the bound texture, whose storage starts
+// at baseLevel of the chain, from a pixel unpack buffer offset or client memory
+void UploadTextureLevel(const CookedTexture& cooked, u32 level, u32 baseLevel, u32 firstRow, u32 rows, const void* data)
 {
-    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
-        if (app->textures[texIdx]->filepath == filepath)
-            return texIdx;
+    const u32 side = BlockSide(cooked.format);
+    const u32 width = std::max(1u, cooked.width >> level), height = std::max(1u, cooked.height >> level);
+    const u32 y = firstRow * side;
+    const u32 bandHeight = std::min(rows * side, height - y);
+    if (cooked.format == BF_RGBA8)
+        glTexSubImage2D(GL_TEXTURE_2D, level - baseLevel, 0, y, width, bandHeight, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    else
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level - baseLevel, 0, y, width, bandHeight, TextureInternalFormat(cooked.format), LevelBytes(cooked.format, width, bandHeight), data);
+}
 
+// Texture bound in place of the ones that are not resident, a constant pixel if the file is missing
+GLuint CreateFallbackTexture(App* app, const char* filepath, u32 rgba)
+{
     Image image = LoadImage(filepath);
+    const bool missing = !image.pixels;
+    if (missing) image = { &rgba, ivec2(1, 1), 4, 4 };
+
+    CookedTexture cooked;
+    BuildCookedTexture(image, TU_COLOR, false, 0, cooked, nullptr);
+    if (!missing) FreeImage(image);
 
-    if (image.pixels)
+    GLuint texHandle = CreateTexture2DStorage(app->textureStorage, cooked);
+    glBindTexture(GL_TEXTURE_2D, texHandle);
+    for (u32 i = 0; i < cooked.levelCount; ++i)
+        UploadTextureLevel(cooked, i, 0, 0, std::max(1u, cooked.height >> i), cooked.levels[i]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texHandle;
+}
+
+// Worker side of a texture load, it leaves the mip chain to upload in upload.cooked. The cooked file next
+// to the source is used if it is valid, otherwise the image (decoded here unless one is given) is filtered,
+// compressed if asked, and for files on disk cooked for the next time.
+void PrepareTextureUpload(TextureUpload& upload, const char* path, Image image, bool compress, bool cook)
+{
+    upload.success = true;
+    CookedTexture* cooked = new CookedTexture();
+    if (cook && ReadCookedTexture(path, upload.usage, compress, *cooked))
     {
-        Texture tex = {};
-        tex.handle = CreateTexture2DFromImage(image);
-        tex.filepath = filepath;
+        FreeImage(image);
+        upload.cooked = cooked;
+        upload.contentHash = HashBytes(&upload.usage, sizeof(upload.usage), cooked->contentHash);
+        return;
+    }
 
-        u32 texIdx = app->textures.size();
-        app->textures.emplace_back(new Texture(tex));
+    if (!image.pixels)
+    {
+        stbi_set_flip_vertically_on_load_thread(true);
+        upload.success = DecodeImageFile(path, image);
+        if (!upload.success)
+        {
+            delete cooked;
+            return;
+        }
+    }
+
+    // The same pixels sampled in another way are another texture
+    const u64 contentHash = HashImage(image);
+    upload.contentHash = HashBytes(&upload.usage, sizeof(upload.usage), contentHash);
+
+    TextureEncodeStats stats;
+    BuildCookedTexture(image, upload.usage, compress, contentHash, *cooked, &stats);
+    FreeImage(image);
+    upload.cooked = cooked;
 
+    if (cooked->format == BF_RGBA8)
+    {
+        ILOG("Cooked %s to RGBA8 (%ux%u, %u levels): filtered in %.2f ms", path, cooked->width, cooked->height, cooked->levelCount, stats.filterSeconds * 1000.0);
+    }
+    else
+    {
+        ILOG("Cooked %s to %s (%ux%u, %u levels): filtered in %.2f ms, encoded in %.2f ms (%.1f MPixels/s), PSNR %.2f dB", path,
+            BlockFormatName(cooked->format), cooked->width, cooked->height, cooked->levelCount, stats.filterSeconds * 1000.0,
+            stats.seconds * 1000.0, stats.MegaPixelsPerSecond(), stats.psnr);
+    }
+    if (cook) WriteCookedTexture(path, *cooked, compress);
+}
+
+void FreeTextureUpload(TextureUpload& upload)
+{
+    if (upload.cooked && !upload.streamed)
+    {
+        FreeCookedTexture(*upload.cooked);
+        delete upload.cooked;
+        upload.cooked = nullptr;
+    }
+}
+
+// Returns a referenced texture, the caller gives the reference back with ReleaseTexture2D().
+// A new one is prepared by a worker and uploaded by ProcessTextureUploads(), it is drawn with the
+// fallback texture until then.
+u32 LoadTexture2D(App* app, const char* filepath, TextureUsage usage)
+{
+    u32 texIdx = app->textures.FindPath(filepath, usage);
+    if (texIdx == INVALID_TEXTURE)
+    {
+        texIdx = app->textures.InsertPending(filepath, usage);
+
+        std::string path = filepath;
+        const bool compress = app->compressTextures;
+        app->jobs.Push([app, texIdx, path, usage, compress]()
+        {
+            TextureUpload upload;
+            upload.slot = texIdx;
+            upload.usage = usage;
+            PrepareTextureUpload(upload, path.c_str(), Image(), compress, true);
+
+            app->textureDecodeQueue.Push(upload);
+        });
+    }
+
+    app->textures.Acquire(texIdx);
+    return texIdx;
+}
+
+// Same as above, but with an image already decoded (e.g. embedded in a model file), which is freed by the worker.
+// The path isn't a file of its own, so the result isn't cooked.
+u32 LoadTexture2D(App* app, const char* filepath, Image image, TextureUsage usage)
+{
+    u32 texIdx = app->textures.FindPath(filepath, usage);
+    if (texIdx != INVALID_TEXTURE || !image.pixels)
+    {
         FreeImage(image);
+        if (texIdx != INVALID_TEXTURE) app->textures.Acquire(texIdx);
         return texIdx;
     }
-    else
+
+    texIdx = app->textures.InsertPending(filepath, usage);
+    app->textures.Acquire(texIdx);
+
+    std::string path = filepath;
+    const bool compress = app->compressTextures;
+    app->jobs.Push([app, texIdx, path, image, usage, compress]()
     {
-        return UINT32_MAX;
+        TextureUpload upload;
+        upload.slot = texIdx;
+        upload.usage = usage;
+        PrepareTextureUpload(upload, path.c_str(), image, compress, false);
+
+        app->textureDecodeQueue.Push(upload);
+    });
+
+    return texIdx;
+}
+
+void ReleaseTexture2D(App* app, u32 texIdx)
+{
+    if (texIdx != INVALID_TEXTURE) app->textures.Release(texIdx);
+}
+
+// Finest level a new texture is uploaded with when streaming: the first one that fits in tailSize texels
+u32 StreamingTailLevel(const CookedTexture& cooked, u32 tailSize)
+{
+    u32 level = 0;
+    while (level + 1 < cooked.levelCount && std::max(std::max(1u, cooked.width >> level), std::max(1u, cooked.height >> level)) > tailSize)
+        level++;
+    return level;
+}
+
+// Moves a resident texture into a storage that starts at `level` of its chain. The levels both storages
+// have are copied on the GPU, and sampling is clamped to them until the missing ones are streamed in.
+void ReallocateStreamedTexture(App* app, u32 slot, u32 level)
+{
+    Texture* texture = app->textures[slot];
+    const CookedTexture& chain = *texture->chain;
+    const u32 uploaded = std::max(level, texture->uploadedLevel);
+
+    GLuint texHandle = CreateTexture2DStorage(app->textureStorage, chain, level);
+    for (u32 i = uploaded; i < chain.levelCount; ++i)
+    {
+        const u32 width = std::max(1u, chain.width >> i), height = std::max(1u, chain.height >> i);
+        glCopyImageSubData(texture->handle, GL_TEXTURE_2D, i - texture->residentLevel, 0, 0, 0,
+                           texHandle, GL_TEXTURE_2D, i - level, 0, 0, 0, width, height, 1);
+    }
+    glBindTexture(GL_TEXTURE_2D, texHandle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, uploaded - level);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    app->textures.Resize(slot, texHandle, CookedTextureBytes(chain, level));
+    texture->residentLevel = level;
+    texture->uploadedLevel = uploaded;
+}
+
+// Grows a texture down to `level` and queues the missing levels for upload. A worker touches their pages
+// first, so a mapped cooked file is read from disk there instead of stalling the GL thread.
+void PromoteTexture(App* app, u32 slot, u32 level)
+{
+    Texture* texture = app->textures[slot];
+    const u32 endLevel = texture->residentLevel;
+    texture->streaming = true;
+    ReallocateStreamedTexture(app, slot, level);
+    app->streamingInFlight++;
+    app->streamingPromotions++;
+
+    CookedTexture* chain = texture->chain;
+    app->jobs.Push([app, slot, chain, level, endLevel]()
+    {
+        volatile u8 touched = 0;
+        for (u32 i = level; i < endLevel; ++i)
+            for (u32 offset = 0; offset < chain->levelBytes[i]; offset += KB(4))
+                touched = touched ^ chain->levels[i][offset];
+
+        TextureUpload upload;
+        upload.slot = slot;
+        upload.usage = chain->usage;
+        upload.cooked = chain;
+        upload.success = true;
+        upload.streamed = true;
+        upload.firstLevel = level;
+        upload.endLevel = endLevel;
+        app->textureDecodeQueue.Push(upload);
+    });
+}
+
+// Level a texture is streamed to: the one asked for, made coarser by the budget pressure, never past the tail
+u32 StreamingTargetLevel(const App* app, const Texture* texture, u32 pressure)
+{
+    const u32 tail = app->textureStreaming ? StreamingTailLevel(*texture->chain, app->streamingTailSize) : 0;
+    return std::min(texture->wantedLevel + pressure, tail);
+}
+
+// Streams mip levels in and out of the resident textures after App::RequestTextureLevels(). The pressure is the
+// smallest number of levels every request has to drop for all of them to fit in the texture budget. Finer levels
+// than the target are only dropped while the budget is short, so the textures in the budget work as a cache.
+void UpdateTextureStreaming(App* app)
+{
+    TextureCache& textures = app->textures;
+    const u64 budget = textures.Budget();
+
+    u32 pressure = 0;
+    for (; pressure < COOKED_TEXTURE_MAX_LEVELS; ++pressure)
+    {
+        u64 bytes = 0;
+        for (u32 slot = 0; slot < textures.SlotCount(); ++slot)
+        {
+            const Texture* texture = textures[slot];
+            if (texture && texture->chain) bytes += CookedTextureBytes(*texture->chain, StreamingTargetLevel(app, texture, pressure));
+        }
+        if (bytes <= budget) break;
+    }
+    app->streamingPressure = pressure;
+
+    u64 promotionBytes = 0;
+    for (u32 slot = 0; slot < textures.SlotCount(); ++slot)
+    {
+        const Texture* texture = textures[slot];
+        if (!texture || !texture->chain || texture->streaming) continue;
+
+        const u32 target = StreamingTargetLevel(app, texture, pressure);
+        if (target < texture->residentLevel)
+            promotionBytes += CookedTextureBytes(*texture->chain, target) - CookedTextureBytes(*texture->chain, texture->residentLevel);
+    }
+    const bool overBudget = textures.ResidentBytes() + promotionBytes > budget;
+
+    for (u32 slot = 0; slot < textures.SlotCount(); ++slot)
+    {
+        Texture* texture = textures[slot];
+        if (!texture || !texture->chain || texture->streaming) continue;
+
+        const u32 target = StreamingTargetLevel(app, texture, pressure);
+        if (target > texture->residentLevel && overBudget)
+        {
+            ReallocateStreamedTexture(app, slot, target);
+            app->streamingDemotions++;
+        }
+        else if (target < texture->residentLevel && app->streamingInFlight < app->streamingMaxInFlight)
+        {
+            PromoteTexture(app, slot, target);
+        }
+    }
+}
+
+// Uploads the mip chains prepared by the workers level by level, coarsest first, a band of rows at a time
+// through the upload ring, spending at most app->textureUploadBudget bytes per frame (but always at least one
+// band). Textures whose pixels are already cached under another path share that texture instead.
+void ProcessTextureUploads(App* app)
+{
+    app->textureDecodeQueue.PopAll(app->textureUploads);
+
+    TextureUploadRing& ring = app->textureRing;
+    u32 uploaded = 0;
+    bool ringBusy = false;
+    std::vector<TextureUpload>::iterator it = app->textureUploads.begin();
+    while (it != app->textureUploads.end() && !ringBusy && (uploaded == 0 || uploaded < app->textureUploadBudget))
+    {
+        TextureUpload& upload = *it;
+        const CookedTexture* cooked = upload.cooked;
+        Texture* texture = app->textures[upload.slot];
+        bool done = false;
+
+        if (!upload.success)
+        {
+            ELOG("Could not load texture %s", texture->filepath.c_str());
+            app->textures.Fail(upload.slot);
+            done = true;
+        }
+        else if (!texture->handle && app->textures.Share(upload.slot, upload.contentHash))
+        {
+            done = true;
+        }
+        else
+        {
+            // A new texture starts with the levels of the streaming tail only
+            if (!texture->handle)
+            {
+                upload.firstLevel = app->textureStreaming ? StreamingTailLevel(*cooked, app->streamingTailSize) : 0;
+                upload.endLevel = cooked->levelCount;
+                texture->residentLevel = texture->uploadedLevel = upload.firstLevel;
+                app->textures.Resolve(upload.slot, upload.contentHash, CreateTexture2DStorage(app->textureStorage, *cooked, upload.firstLevel), CookedTextureBytes(*cooked, upload.firstLevel));
+            }
+
+            glBindTexture(GL_TEXTURE_2D, texture->handle);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+            const u32 levelCount = upload.endLevel - upload.firstLevel;
+            while (upload.uploadedLevels < levelCount && !ringBusy)
+            {
+                const u32 level = upload.endLevel - 1 - upload.uploadedLevels;
+                const u32 side = BlockSide(cooked->format);
+                const u32 width = std::max(1u, cooked->width >> level), height = std::max(1u, cooked->height >> level);
+                const u32 rowCount = (height + side - 1) / side;
+                const u32 rowBytes = LevelBytes(cooked->format, width, side);
+                const u32 bandRows = std::max(1u, ring.SegmentSize() / rowBytes);
+
+                while (upload.uploadedRows < rowCount && (uploaded == 0 || uploaded < app->textureUploadBudget))
+                {
+                    const u32 rows = std::min(bandRows, rowCount - upload.uploadedRows);
+                    const u32 bytes = rows * rowBytes;
+                    const u8* band = cooked->levels[level] + (u64)upload.uploadedRows * rowBytes;
+
+                    // A single row larger than a segment goes straight from client memory
+                    if (bytes <= ring.SegmentSize())
+                    {
+                        u8* staging = ring.Map(bytes);
+                        if (!staging)
+                        {
+                            ringBusy = true;
+                            break;
+                        }
+                        memcpy(staging, band, bytes);
+                        UploadTextureLevel(*cooked, level, texture->residentLevel, upload.uploadedRows, rows, (const void*)(u64)ring.Unmap());
+                        ring.Fence();
+                    }
+                    else
+                    {
+                        UploadTextureLevel(*cooked, level, texture->residentLevel, upload.uploadedRows, rows, band);
+                    }
+
+                    upload.uploadedRows += rows;
+                    uploaded += bytes;
+                }
+
+                if (upload.uploadedRows < rowCount) break;
+                upload.uploadedLevels++;
+                upload.uploadedRows = 0;
+
+                // A streamed level is sampled as soon as it is whole
+                if (upload.streamed)
+                {
+                    texture->uploadedLevel = level;
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - texture->residentLevel);
+                }
+            }
+
+            if (upload.uploadedLevels == levelCount)
+            {
+                if (upload.streamed)
+                {
+                    texture->streaming = false;
+                    app->streamingInFlight--;
+                }
+                else
+                {
+                    // The texture keeps its chain to stream the finer levels from
+                    app->textures.MarkResident(upload.slot);
+                    texture->chain = upload.cooked;
+                    upload.cooked = nullptr;
+                }
+                done = true;
+            }
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        if (done)
+        {
+            FreeTextureUpload(upload);
+            it = app->textureUploads.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
     }
 }
 
 void Init(App* app)
 {
+    // Everything below reads its files from the pack when there is one
+    app->assetPackMounted = MountAssetPack(PACK_FILE_NAME);
+    if (app->assetPackMounted) ILOG("Mounted %s", PACK_FILE_NAME);
+
     // Create Camera
     app->cam = new Camera(glm::vec3(0, 3, 26), app->displaySize.x/app->displaySize.y, 0.1, 1000);
 
@@ -195,6 +774,50 @@ void Init(App* app)
     glEnable(GL_CULL_FACE);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    // Textures: bindless when the driver has it, texture arrays bound once per frame otherwise. Decided before
+    // any program is compiled, the shaders are built for one or the other.
+    BindlessTextureProcs bindless;
+    for (std::vector<const char*>::iterator it = app->openGLInformation.extensions.begin(); it != app->openGLInformation.extensions.end(); ++it)
+    {
+        if (strcmp(*it, "GL_ARB_bindless_texture") == 0)
+        {
+            bindless.getTextureHandle = (PFNGLGETTEXTUREHANDLEARBPROC)GetGlProcAddress("glGetTextureHandleARB");
+            bindless.makeResident = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)GetGlProcAddress("glMakeTextureHandleResidentARB");
+            bindless.makeNonResident = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)GetGlProcAddress("glMakeTextureHandleNonResidentARB");
+        }
+    }
+    const bool bindlessSupported = bindless.getTextureHandle && bindless.makeResident && bindless.makeNonResident;
+
+    GLint textureUnits = 16;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &textureUnits);
+    app->textureStorage.Init(std::min(textureUnits, 32), bindlessSupported ? &bindless : nullptr);
+    app->textures.SetStorage(&app->textureStorage);
+    glGenBuffers(1, &app->materialTable);
+
+    char textureDefines[128];
+    if (bindlessSupported) sprintf(textureDefines, "#extension GL_ARB_bindless_texture : require\n#define BINDLESS_TEXTURES\n");
+    else sprintf(textureDefines, "#define TEXTURE_ARRAY_UNITS %u\n", app->textureStorage.Units());
+    app->shaderDefines = textureDefines;
+    ILOG("Material textures are %s", bindlessSupported ? "bindless" : "texture arrays");
+
+    // Linked programs are cached on disk when the driver can give their binaries back
+    GLint programBinaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &programBinaryFormats);
+    if (programBinaryFormats > 0) app->programBinarySeed = ProgramBinarySeed(app->openGLInformation.renderer, app->openGLInformation.version);
+    else ILOG("No program binary formats, programs are always compiled from source");
+
+    // Lets the driver compile on its own threads and tell when a program is done
+    for (std::vector<const char*>::iterator it = app->openGLInformation.extensions.begin(); it != app->openGLInformation.extensions.end(); ++it)
+    {
+        if (strcmp(*it, "GL_KHR_parallel_shader_compile") == 0 || strcmp(*it, "GL_ARB_parallel_shader_compile") == 0)
+        {
+            PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)GetGlProcAddress(strcmp(*it, "GL_KHR_parallel_shader_compile") == 0 ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB");
+            if (maxShaderCompilerThreads) maxShaderCompilerThreads(0xFFFFFFFF); // As many as the driver likes
+            app->parallelShaderCompile = true;
+        }
+    }
+    ILOG("Shader compilation is %s", app->parallelShaderCompile ? "parallel" : "serial");
+
     // Create Constant Buffers for Uniforms
     app->forwardConstBuffer   = CreateConstantBuffer(app->GetMaxUniformBlockSize());
     app->deferredGConstBuffer = CreateConstantBuffer(app->GetMaxUniformBlockSize());
@@ -205,15 +828,53 @@ void Init(App* app)
     app->frameBuffer = CreateFrameBuffer(app->displaySize);
     app->blurBuffer  = CreateBlurBuffer (app->displaySize);
 
+    // Watches the files programs are loaded from, before the first of them is
+    app->fileWatcher.Start();
+    ILOG("File changes are %s", app->fileWatcher.Inotify() ? "reported by inotify" : "polled");
+
+    // Every program of the scene is issued at once, the loads below find them built
+    const ProgramRequest startupPrograms[] = {
+        { "TextureShader.glsl",      "TEXTURED_GEOMETRY", "" },
+        { "LightingPassShader.glsl", "LIGHTING_PASS",     "" },
+        { "GausianBlurShader.glsl",  "GAUSIAN_BLUR",      "" },
+        { "ForwardShader.glsl",      "FORWARD_SHADER",    "" },
+        { "GeometryPassShader.glsl", "GEOMETRY_PASS",     "" }
+    };
+    u32 startupSlots[ARRAY_COUNT(startupPrograms)];
+    LoadPrograms(app, startupPrograms, ARRAY_COUNT(startupPrograms), startupSlots);
+
     // Create TexturedQuads to draw Frame Buffers
     app->frameQuad   = app->InitTexturedQuad(nullptr);
 
+    // Worker threads for asynchronous asset imports
+    app->jobs.Start();
+
+    // Texture uploads are staged through a ring of pixel buffers, persistently mapped when glBufferStorage exists
+    PFNGLBUFFERSTORAGEPROC bufferStorage = nullptr;
+    bool bufferStorageSupported = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4);
+    for (std::vector<const char*>::iterator it = app->openGLInformation.extensions.begin(); it != app->openGLInformation.extensions.end(); ++it)
+        if (strcmp(*it, "GL_ARB_buffer_storage") == 0) bufferStorageSupported = true;
+    if (bufferStorageSupported) bufferStorage = (PFNGLBUFFERSTORAGEPROC)GetGlProcAddress("glBufferStorage");
+    app->textureRing.Init(4, MB(4), bufferStorage);
+
+    // BC1/BC3 come from S3TC, which every desktop driver has but isn't core (BC5 is)
+    app->compressTextures = false;
+    for (std::vector<const char*>::iterator it = app->openGLInformation.extensions.begin(); it != app->openGLInformation.extensions.end(); ++it)
+        if (strcmp(*it, "GL_EXT_texture_compression_s3tc") == 0) app->compressTextures = true;
+    if (!app->compressTextures) ILOG("No S3TC support, textures are uploaded uncompressed");
+
+    // Bound while a texture is loading (or for materials without one) and when it failed to load
+    app->textures.SetFallbacks(CreateFallbackTexture(app, "color_white.png", 0xffffffff), CreateFallbackTexture(app, "color_magenta.png", 0xffff00ff));
+
+    // Shared geometry buffers
+    app->geometry.Init(MB(32), MB(16));
+
     // Generate Initial Screen
     //return; //<- Uncomment this for empty initial scene
-    app->InitModel("Patrick/Patrick.obj", vec3( 0, 1.5, 20), 0.4);
-    app->InitModel("Patrick/Patrick.obj", vec3(-7,   0,  5));
-    app->InitModel("Patrick/Patrick.obj", vec3( 6,   3, -2));
-    app->InitModel("Primitives/Plane/Plane.obj", glm::vec3(0, -4, 0), 3);
+    app->InitModelAsync("Patrick/Patrick.obj", vec3( 0, 1.5, 20), 0.4);
+    app->InitModelAsync("Patrick/Patrick.obj", vec3(-7,   0,  5));
+    app->InitModelAsync("Patrick/Patrick.obj", vec3( 6,   3, -2));
+    app->InitModelAsync("Primitives/Plane/Plane.obj", glm::vec3(0, -4, 0), 3);
 
     app->AddDirectLight(glm::vec3(  1,   1, 0.75), glm::vec3( 0.35, 0.75,   0))->intensity = 0.3;
     app->AddDirectLight(glm::vec3(  1, 0.5,  0.5), glm::vec3(   -1,   -1, 0.2))->intensity = 0.6;
@@ -295,9 +956,6 @@ TexturedQuad* App::InitTexturedQuad(const char* texture, glm::vec3 position)
     else
     {
         quad->textureProgram = LoadProgram(this, "TextureShader.glsl", "TEXTURED_GEOMETRY");
-        Program& texturedGeometryProgram = *programs[quad->textureProgram];
-        quad->textureProgramUniform = glGetUniformLocation(texturedGeometryProgram.handle, "uTexture");
-        //TODO: Generatre lighting pass & Gausian Blur uniforms here, and not directly every frame (in render)
         quad->lightingPassProgram = LoadProgram(this, "LightingPassShader.glsl", "LIGHTING_PASS");
 
         quad->bloomProgram = LoadProgram(this, "GausianBlurShader.glsl", "GAUSIAN_BLUR");
@@ -308,49 +966,58 @@ TexturedQuad* App::InitTexturedQuad(const char* texture, glm::vec3 position)
 
 void App::InitModel(const char* path, glm::vec3 position, float scale)
 {
-    u32 programFW = LoadProgram(this, "ForwardShader.glsl", "FORWARD_SHADER");
-    u32 programGD = LoadProgram(this, "GeometryPassShader.glsl", "GEOMETRY_PASS");
+    ModelAsset* asset = AcquireModelAsset(this, path);
+    if (!asset) return;
 
-    Program* pFW = programs[programFW];
-    GLuint texUniformFW = glGetUniformLocation(pFW->handle, "uTexture");
+    PlaceModel(asset, position, scale);
+}
 
-    Program* pGD = programs[programGD];
-    GLuint texUniformGD = glGetUniformLocation(pGD->handle, "uTexture");
+// The model is placed right away and drawn once its asset becomes resident
+void App::InitModelAsync(const char* path, glm::vec3 position, float scale)
+{
+    PlaceModel(AcquireModelAssetAsync(this, path), position, scale);
+}
+
+// Reflected once per program, every model drawn with it shares the layout (and the VAOs built from it)
+void LoadProgramAttributes(Program* program)
+{
+    if (!program->attributes.empty()) return;
 
     GLsizei size = 0;
-    glGetProgramiv(pFW->handle, GL_ACTIVE_ATTRIBUTES, &size);
+    glGetProgramiv(program->handle, GL_ACTIVE_ATTRIBUTES, &size);
     for (unsigned int i = 0; i < size; ++i)
     {
         char attribName[200] = {};
         GLsizei attribLength = 0;
         GLint attribSize = 0;
         GLenum attribType = 0;
-        glGetActiveAttrib(pFW->handle, i, ARRAY_COUNT(attribName), &attribLength, &attribSize, &attribType, attribName);
+        glGetActiveAttrib(program->handle, i, ARRAY_COUNT(attribName), &attribLength, &attribSize, &attribType, attribName);
 
-        pFW->attributes.emplace_back(new VertexShaderAttribute(glGetAttribLocation(pFW->handle, attribName), attribSize));
+        program->attributes.emplace_back(new VertexShaderAttribute(glGetAttribLocation(program->handle, attribName), attribSize));
     }
+}
 
-    size = 0;
-    glGetProgramiv(pGD->handle, GL_ACTIVE_ATTRIBUTES, &size);
-    for (unsigned int i = 0; i < size; ++i)
-    {
-        char attribName[200] = {};
-        GLsizei attribLength = 0;
-        GLint attribSize = 0;
-        GLenum attribType = 0;
-        glGetActiveAttrib(pGD->handle, i, ARRAY_COUNT(attribName), &attribLength, &attribSize, &attribType, attribName);
+Model* App::PlaceModel(ModelAsset* asset, glm::vec3 position, float scale)
+{
+    u32 programFW = LoadProgram(this, "ForwardShader.glsl", "FORWARD_SHADER");
+    u32 programGD = LoadProgram(this, "GeometryPassShader.glsl", "GEOMETRY_PASS");
 
-        pGD->attributes.emplace_back(new VertexShaderAttribute(glGetAttribLocation(pGD->handle, attribName), attribSize));
-    }
+    Program* pFW = programs[programFW];
+    Program* pGD = programs[programGD];
+    LoadProgramAttributes(pFW);
+    LoadProgramAttributes(pGD);
+
+    Model* m = new Model(asset);
+    GetFileName(&m->name, asset->path.c_str());
+    objects.emplace_back(m);
 
-    Model* m = LoadModel(this, path);
     m->forwardProgram  = programFW;
     m->deferredProgram = programGD;
     m->position = position;
     m->scale = vec3(scale);
     m->UpdateTransform();
-    m->texUniformForward  = texUniformFW;
-    m->texUniformDeferred = texUniformGD;
+
+    return m;
 }
 
 Light* App::AddPointLight(glm::vec3 color, glm::vec3 position)
@@ -408,6 +1075,14 @@ void App::DeleteObject(intptr_t selected)
 
         if (lIndex != -1) lights.erase(lights.begin() + lIndex);
     }
+    else if (o->Type() == ObjectType::O_MODEL)
+    {
+        ReleaseModelAsset(this, ((Model*)o)->asset->path.c_str());
+    }
+    else if (o->Type() == ObjectType::O_TEXTURED_QUAD)
+    {
+        ReleaseTexture2D(this, ((TexturedQuad*)o)->texture);
+    }
 
     objects.erase(objects.begin() + index);
     delete o;
@@ -428,8 +1103,73 @@ glm::mat4 App::GlobalMatrix(glm::mat4 world)
     return global;
 }
 
+// Replaces the programs whose reload the driver finished, until then (or when the new version fails to build)
+// the previous one keeps drawing. Runs before ProcessFileChanges(), so a reload is first looked at the frame after.
+void ProcessProgramReloads(App* app)
+{
+    for (std::vector<Program*>::iterator it = app->programs.begin(); it != app->programs.end(); ++it)
+    {
+        Program& p = *(*it);
+        if (!p.pending.handle || !ProgramBuildReady(p.pending, app->parallelShaderCompile)) continue;
+
+        ProgramBuild build = p.pending;
+        p.pending = ProgramBuild();
+        if (FinishProgramBuild(build, p.programName.c_str()))
+        {
+            // VAOs are looked up by handle, and the new one may come back with other attribute locations
+            DeleteProgramVaos(app, p.handle);
+            glDeleteProgram(p.handle);
+            p.handle = build.handle;
+            ReflectProgram(p);
+            if (!p.attributes.empty())
+            {
+                for (VertexShaderLayout::iterator at = p.attributes.begin(); at != p.attributes.end(); ++at)
+                    delete *at;
+                p.attributes.clear();
+                LoadProgramAttributes(&p);
+            }
+            app->programReloads++;
+            ILOG("Reloaded %s%s", p.programName.c_str(), build.fromBinary ? " from the binary cache" : "");
+        }
+        else
+        {
+            glDeleteProgram(build.handle);
+            app->programReloadFailures++;
+            ELOG("%s failed to build, the previous version is kept", p.programName.c_str());
+        }
+    }
+}
+
+// Reloads what was loaded from the files the watcher saw change. Nothing touches the disk while none did.
+void ProcessFileChanges(App* app)
+{
+    app->fileChanges.clear();
+    app->fileWatcher.PopChanges(app->fileChanges);
+    if (app->fileChanges.empty() || !app->autoReload) return;
+
+    // A path can come twice when it was written again after settling
+    std::sort(app->fileChanges.begin(), app->fileChanges.end());
+    app->fileChanges.erase(std::unique(app->fileChanges.begin(), app->fileChanges.end()), app->fileChanges.end());
+    for (std::vector<std::string>::iterator it = app->fileChanges.begin(); it != app->fileChanges.end(); ++it)
+    {
+        ILOG("%s changed on disk", it->c_str());
+        app->HotReload(*it);
+    }
+}
+
 void Update(App* app)
 {
+    ProcessModelUploads(app);
+    ProcessProgramReloads(app);
+    ProcessFileChanges(app);
+    app->RequestTextureLevels();
+    UpdateTextureStreaming(app);
+    ProcessTextureUploads(app);
+
+    if (app->geometry.vertices.Stats().Fragmentation() > app->compactThreshold ||
+        app->geometry.indices.Stats().Fragmentation() > app->compactThreshold)
+        CompactGeometryArena(app, app->compactBudget);
+
     app->GUI();
 
     ImGui::Render();
@@ -488,6 +1228,14 @@ void App::GUI()
             ImGui::Text("Show FPS:"); ImGui::SameLine();
             ImGui::Checkbox("##sfps", &showFps);
 
+            ImGui::Text("Meshlet culling:"); ImGui::SameLine();
+            ImGui::Checkbox("##mcull", &meshletCulling);
+
+            ImGui::PushItemWidth(65);
+            ImGui::Text("LOD bias:"); ImGui::SameLine();
+            ImGui::DragFloat("##lodb", &lodBias, 0.05, -4, 4, "%.2f");
+            ImGui::PopItemWidth();
+
             ImGui::PushItemWidth(65);
             ImGui::Text(" Ambient:"); ImGui::SameLine();
             ImGui::DragFloat("##amb", &ambient, 0.01, 0, 1, "%.2f");
@@ -525,10 +1273,10 @@ void App::GUI()
             if (ImGui::BeginMenu("Models"))
             {
                 if (ImGui::MenuItem("Patrick"))
-                    InitModel("Patrick/Patrick.obj");
+                    InitModelAsync("Patrick/Patrick.obj");
 
                 if (ImGui::MenuItem("Plane"))
-                    InitModel("Primitives/Plane/Plane.obj", glm::vec3(0, -4, 0));
+                    InitModelAsync("Primitives/Plane/Plane.obj", glm::vec3(0, -4, 0));
 
                 ImGui::EndMenu();
             }
@@ -549,6 +1297,170 @@ void App::GUI()
 
             ImGui::EndMenu();
         }
+        if (ImGui::BeginMenu("Tools"))
+        {
+            if (ImGui::BeginMenu("Benchmarks"))
+            {
+                if (ImGui::MenuItem("Model Load (cold vs warm)"))
+                    BenchmarkModelLoad(this, "Patrick/Patrick.obj", 10);
+
+                if (ImGui::MenuItem("Vertex Formats (float vs quantized)"))
+                    BenchmarkVertexFormats(this, "Patrick/Patrick.obj", 100);
+
+                if (ImGui::MenuItem("Resident Memory (released vs cpu readable)"))
+                    BenchmarkResidentMemory(this, "Patrick/Patrick.obj", 32);
+
+                if (ImGui::MenuItem("OBJ Import (native vs assimp)"))
+                    BenchmarkObjImport(this, 512);
+                if (ImGui::MenuItem("GLB Load (zero-copy vs assimp)"))
+                    BenchmarkGlbImport(this, 1024);
+                if (ImGui::MenuItem("Texture Compression (BC1 vs BC3 vs BC5)"))
+                    BenchmarkTextureCompression("Patrick/Skin_Patrick.png", 8);
+                if (ImGui::MenuItem("Mip Filter (SSE2 vs scalar)"))
+                    BenchmarkMipFilter("Patrick/Skin_Patrick.png", 16);
+                if (ImGui::MenuItem("Program Startup (source vs binary cache)"))
+                    BenchmarkProgramCache(this, 4);
+
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Asset Pack"))
+            {
+                ImGui::Text("%s: %s", PACK_FILE_NAME, assetPackMounted ? "mounted" : "not mounted");
+                ImGui::Separator();
+
+                if (ImGui::MenuItem("Build from working directory"))
+                {
+                    // Unmounted while it is rewritten, so the files are read from disk. Imports still reading
+                    // the old pack keep its mapping alive until they unmap their views.
+                    UnmountAssetPack();
+                    AssetPackStats stats;
+                    f64 start = GetPerformanceTime();
+                    if (BuildAssetPack(".", PACK_FILE_NAME, true, stats))
+                    {
+                        ILOG("Built %s in %.2f ms: %u files (%u compressed), %.2f MB -> %.2f MB stored, %.2f MB archive", PACK_FILE_NAME,
+                            (GetPerformanceTime() - start) * 1000.0, stats.files, stats.compressed, stats.originalBytes / (1024.0 * 1024.0),
+                            stats.storedBytes / (1024.0 * 1024.0), stats.packBytes / (1024.0 * 1024.0));
+                    }
+                    else
+                    {
+                        ELOG("Could not build %s", PACK_FILE_NAME);
+                    }
+                    assetPackMounted = MountAssetPack(PACK_FILE_NAME);
+                }
+                if (ImGui::MenuItem(assetPackMounted ? "Unmount" : "Mount"))
+                {
+                    if (assetPackMounted) UnmountAssetPack();
+                    assetPackMounted = !assetPackMounted && MountAssetPack(PACK_FILE_NAME);
+                }
+
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Geometry Arena"))
+            {
+                const char* poolNames[2] = { "Vertices", "Indices" };
+                GeometryPoolStats stats[2] = { geometry.vertices.Stats(), geometry.indices.Stats() };
+                for (u32 i = 0; i < 2; ++i)
+                {
+                    ImGui::Text("%s: %u pages, %u allocations", poolNames[i], stats[i].pages, stats[i].allocations);
+                    ImGui::Text("  used %.2f / %.2f MB (%.0f%% occupancy)", stats[i].used / (1024.f * 1024.f), stats[i].capacity / (1024.f * 1024.f), stats[i].Occupancy() * 100.f);
+                    ImGui::Text("  %u free ranges, largest %.2f MB (%.0f%% fragmentation)", stats[i].freeRanges, stats[i].largestFreeRange / (1024.f * 1024.f), stats[i].Fragmentation() * 100.f);
+                }
+
+                ImGui::Separator();
+                if (ImGui::MenuItem("Compact"))
+                    CompactGeometryArena(this, UINT32_MAX);
+
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Textures"))
+            {
+                TextureCacheStats stats = textures.Stats();
+                ImGui::Text("%u textures (%u referenced, %u loading), %u paths", stats.textures, stats.referenced, stats.loading, stats.paths);
+                ImGui::Text("Resident %.2f / %.2f MB", stats.residentBytes / (1024.f * 1024.f), stats.budget / (1024.f * 1024.f));
+                ImGui::Text("Hit rate %.0f%% (%llu path, %llu content, %llu misses)", stats.HitRate() * 100.f,
+                    (unsigned long long)stats.pathHits, (unsigned long long)stats.contentHits, (unsigned long long)stats.misses);
+                ImGui::Text("%llu evictions, %.2f MB", (unsigned long long)stats.evictions, stats.evictedBytes / (1024.f * 1024.f));
+                ImGui::Text("Upload ring %s, %u queued", textureRing.Persistent() ? "persistently mapped" : "mapped per upload", (u32)textureUploads.size());
+                ImGui::Checkbox("Compress new textures (BCn)", &compressTextures);
+
+                TextureStorageStats storageStats = textureStorage.Stats();
+                if (storageStats.bindless)
+                {
+                    ImGui::Text("Bindless storage, %u textures", storageStats.textures);
+                }
+                else
+                {
+                    ImGui::Text("Texture arrays: %u pages (%u bound once per frame) in %u buckets", storageStats.pages, storageStats.boundPages, storageStats.buckets);
+                    ImGui::Text("  %u / %u layers, %.2f / %.2f MB", storageStats.usedLayers, storageStats.layers, storageStats.usedBytes / (1024.f * 1024.f), storageStats.bytes / (1024.f * 1024.f));
+                }
+
+                ImGui::Separator();
+                int budget = (int)(textures.Budget() / MB(1));
+                ImGui::PushItemWidth(65);
+                ImGui::Text("Budget (MB):"); ImGui::SameLine();
+                if (ImGui::DragInt("##texbudget", &budget, 1, 0, 4096))
+                    textures.SetBudget((u64)budget * MB(1));
+                ImGui::PopItemWidth();
+                if (ImGui::MenuItem("Evict unused"))
+                    textures.Trim(0);
+
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Texture Streaming"))
+            {
+                ImGui::Checkbox("Enabled", &textureStreaming);
+                ImGui::Text("Resident %.2f / %.2f MB, requests %u levels coarser to fit", textures.ResidentBytes() / (1024.f * 1024.f), textures.Budget() / (1024.f * 1024.f), streamingPressure);
+                ImGui::Text("%u uploads in flight, %u promotions, %u demotions", streamingInFlight, streamingPromotions, streamingDemotions);
+                ImGui::PushItemWidth(65);
+                ImGui::Text("Bias (levels):"); ImGui::SameLine();
+                ImGui::DragFloat("##streamingbias", &streamingBias, 0.1f, -4.f, 4.f, "%.1f");
+                ImGui::PopItemWidth();
+
+                ImGui::Separator();
+                for (u32 slot = 0; slot < textures.SlotCount(); ++slot)
+                {
+                    const Texture* texture = textures[slot];
+                    if (!texture || !texture->chain) continue;
+
+                    const CookedTexture& chain = *texture->chain;
+                    ImGui::Text("%s %s %ux%u: sampled %ux%u, levels %u-%u of %u, wants %u%s, %.0f KB", texture->filepath.c_str(), BlockFormatName(chain.format),
+                        chain.width, chain.height, std::max(1u, chain.width >> texture->uploadedLevel), std::max(1u, chain.height >> texture->uploadedLevel),
+                        texture->residentLevel, chain.levelCount - 1, chain.levelCount, texture->wantedLevel, texture->streaming ? " (streaming)" : "", texture->bytes / 1024.f);
+                }
+
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Programs"))
+            {
+                ImGui::Text("%u programs, %u compiled in %.2f ms, %u loads answered by the cache", (u32)programs.size(), programCompiles, programCompileSeconds * 1000.0, programCacheHits);
+                if (programBinarySeed) ImGui::Text("%u loaded from the binary cache (%s) in %.2f ms", programBinaryLoads, PROGRAM_CACHE_DIRECTORY, programBinarySeconds * 1000.0);
+                else ImGui::Text("No binary cache, the driver has no program binary formats");
+                ImGui::Text("%s compilation, %u reloads (%u failed)", parallelShaderCompile ? "Parallel" : "Serial", programReloads, programReloadFailures);
+                ImGui::Checkbox("Reload changed files", &autoReload);
+                ImGui::Text("%u files watched (%s), %u events, %u changes", fileWatcher.WatchedCount(), fileWatcher.Inotify() ? "inotify" : "polling", fileWatcher.EventCount(), fileWatcher.ChangeCount());
+
+                ImGui::Separator();
+                for (std::vector<Program*>::iterator it = programs.begin(); it != programs.end(); ++it)
+                    ImGui::Text("%u: %s (%s)%s, %u resources%s", (*it)->handle, (*it)->programName.c_str(), (*it)->filepath.c_str(), (*it)->permutation.empty() ? "" : " + permutation", (u32)(*it)->resources.size(), (*it)->pending.handle ? ", reloading" : "");
+
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Memory"))
+            {
+                u32 readableMeshes = 0;
+                u64 cpuBytes = ModelAssetsCpuBytes(this, &readableMeshes);
+                GeometryPoolStats vertexStats = geometry.vertices.Stats();
+                GeometryPoolStats indexStats = geometry.indices.Stats();
+
+                ImGui::Text("Process resident: %.2f MB", GetResidentMemory() / (1024.f * 1024.f));
+                ImGui::Text("Mesh cpu copies: %.2f MB (%u cpu readable meshes)", cpuBytes / (1024.f * 1024.f), readableMeshes);
+                ImGui::Text("Mesh gpu data: %.2f MB", (vertexStats.used + indexStats.used) / (1024.f * 1024.f));
+
+                ImGui::EndMenu();
+            }
+
+            ImGui::EndMenu();
+        }
         if (ImGui::BeginMenu("About"))
         {
             if (ImGui::BeginMenu("OpenGL"))
@@ -585,6 +1497,12 @@ void App::GUI()
                 else selected = o->id;
             }
 
+            if (o->Type() == ObjectType::O_MODEL && !((Model*)o)->asset->resident)
+            {
+                ImGui::SameLine();
+                ImGui::TextDisabled(((Model*)o)->asset->failed ? "(failed)" : "(loading)");
+            }
+
             if (selected != o->id)
             {
                 ImGui::PopID();
@@ -608,8 +1526,9 @@ void App::GUI()
 
     if (ImGui::Begin("##Info", nullptr, ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoBringToFrontOnFocus | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoResize))
     {
-        if (ImGui::Button("Reload")) HotReload();
         if (showFps) ImGui::Text("FPS: %f", float(1.0f / deltaTime));
+        if (showFps) ImGui::Text("Triangles: %u submitted, %u visible", trianglesSubmitted, trianglesVisible);
+        if (showFps) ImGui::Text("Models per LOD: %u / %u / %u / %u", lodObjects[0], lodObjects[1], lodObjects[2], lodObjects[3]);
     }
     ImGui::End();
 
@@ -638,11 +1557,266 @@ void App::Input()
 
 }
 
+void Shutdown(App* app)
+{
+    // Workers may still be importing, wait for them before the queues go away
+    app->jobs.Stop();
+    app->fileWatcher.Stop();
+
+    std::vector<ModelUpload> uploads;
+    app->modelUploadQueue.PopAll(uploads);
+    uploads.insert(uploads.end(), app->modelUploads.begin(), app->modelUploads.end());
+    for (std::vector<ModelUpload>::iterator it = uploads.begin(); it != uploads.end(); ++it)
+    {
+        FreeModelImport(*it->import);
+        delete it->import;
+    }
+    app->modelUploads.clear();
+
+    std::vector<TextureUpload> textureUploads;
+    app->textureDecodeQueue.PopAll(textureUploads);
+    textureUploads.insert(textureUploads.end(), app->textureUploads.begin(), app->textureUploads.end());
+    for (std::vector<TextureUpload>::iterator it = textureUploads.begin(); it != textureUploads.end(); ++it)
+        FreeTextureUpload(*it);
+    app->textureUploads.clear();
+    app->textureRing.Release();
+    app->textureStorage.Release();
+    glDeleteBuffers(1, &app->materialTable);
+
+    app->geometry.Release();
+}
+
+// Encodes the top level of a texture in every block format and reports the encode throughput
+// and the error against the source, measured on what the GPU will decode
+void BenchmarkTextureCompression(const char* filename, u32 iterations)
+{
+    Image image = LoadImage(filename);
+    if (!CanCompressImage(image))
+    {
+        ELOG("Texture compression benchmark needs an RGB(A) image with sides multiple of 4, %s isn't", filename);
+        FreeImage(image);
+        return;
+    }
+
+    std::vector<u8> rgba, decoded;
+    ExpandToRgba(image, rgba);
+    decoded.resize(rgba.size());
+
+    const u32 width = image.size.x, height = image.size.y;
+    const f64 megaPixels = (f64)width * height / 1e6;
+    ILOG("Texture compression benchmark: %s (%ux%u), %u iterations", filename, width, height, iterations);
+
+    for (u32 f = 0; f < BF_RGBA8; ++f)
+    {
+        const BlockFormat format = (BlockFormat)f;
+        std::vector<u8> blocks(LevelBytes(format, width, height));
+
+        f64 best = 1e30;
+        for (u32 i = 0; i < iterations; ++i)
+        {
+            const f64 start = GetPerformanceTime();
+            CompressLevel(rgba.data(), width, height, format, blocks.data());
+            best = std::min(best, GetPerformanceTime() - start);
+        }
+
+        DecompressLevel(blocks.data(), width, height, format, decoded.data());
+        const f64 psnr = ComputeCompressionPsnr(rgba.data(), decoded.data(), (u64)width * height, format);
+        ILOG("  %s: %.2f ms, %.1f MPixels/s, %.2f MB -> %.2f MB, PSNR %.2f dB", BlockFormatName(format), best * 1000.0, megaPixels / best,
+            rgba.size() / (1024.0 * 1024.0), blocks.size() / (1024.0 * 1024.0), psnr);
+    }
+
+    FreeImage(image);
+}
+
+// Filters the whole linear mip chain of a texture with the SIMD and the scalar kernel, and the full
+// gamma-correct chain (linearize, filter, encode every level). Rates are in source pixels read.
+void BenchmarkMipFilter(const char* filename, u32 iterations)
+{
+    Image image = LoadImage(filename);
+    if (!image.pixels) return;
+
+    std::vector<u8> rgba, encoded;
+    ExpandToRgba(image, rgba);
+    const u32 width = image.size.x, height = image.size.y;
+    FreeImage(image);
+
+    std::vector<f32> linear(rgba.size()), chain(rgba.size());
+    LinearizeRgba(rgba.data(), (u64)width * height, true, linear.data());
+    encoded.resize(rgba.size());
+
+    // Every level reads the one before it, the top level included
+    u64 texels = 0;
+    for (u32 w = width, h = height; w > 1 || h > 1; w = MipSize(w), h = MipSize(h))
+        texels += (u64)w * h;
+
+    ILOG("Mip filter benchmark: %s (%ux%u, %u levels), %u iterations", filename, width, height, MipLevelCount(width, height), iterations);
+
+    const char* kernelNames[] = { "SSE2", "scalar" };
+    for (u32 k = 0; k < 2; ++k)
+    {
+        f64 best = 1e30;
+        for (u32 i = 0; i < iterations; ++i)
+        {
+            const f64 start = GetPerformanceTime();
+            const f32* src = linear.data();
+            f32* dst = chain.data();
+            for (u32 w = width, h = height; w > 1 || h > 1; w = MipSize(w), h = MipSize(h))
+            {
+                if (k == 0) DownsampleLinear(src, w, h, dst);
+                else DownsampleLinearScalar(src, w, h, dst);
+                src = dst;
+                dst += (u64)MipSize(w) * MipSize(h) * 4;
+            }
+            best = std::min(best, GetPerformanceTime() - start);
+        }
+        ILOG("  %-6s box 2x2: %.2f ms, %.1f MPixels/s", kernelNames[k], best * 1000.0, texels / best / 1e6);
+    }
+
+    f64 best = 1e30;
+    for (u32 i = 0; i < iterations; ++i)
+    {
+        const f64 start = GetPerformanceTime();
+        CookedTexture cooked;
+        Image source = { rgba.data(), ivec2(width, height), 4, (i32)width * 4 };
+        BuildCookedTexture(source, TU_COLOR, false, 0, cooked, nullptr);
+        best = std::min(best, GetPerformanceTime() - start);
+    }
+    ILOG("  gamma-correct RGBA8 chain: %.2f ms, %.1f MPixels/s", best * 1000.0, texels / best / 1e6);
+}
+
+// Builds every loaded program again from its source (a cold cache) and from the binary cache (a warm one),
+// the time it takes to have all of them linked is what startup pays
+void BenchmarkProgramCache(App* app, u32 iterations)
+{
+    if (!app->programBinarySeed)
+    {
+        ELOG("Program cache benchmark: the driver has no program binary formats");
+        return;
+    }
+
+    std::vector<String> sources;
+    for (std::vector<Program*>::iterator it = app->programs.begin(); it != app->programs.end(); ++it)
+        sources.push_back(ReadTextFile((*it)->filepath.c_str()));
+
+    ILOG("Program cache benchmark: %u programs, %u iterations", (u32)app->programs.size(), iterations);
+
+    // Writes the binaries the warm runs read, in case a program was compiled before the cache existed
+    for (u32 p = 0; p < app->programs.size(); ++p)
+    {
+        const Program& program = *app->programs[p];
+        glDeleteProgram(CreateProgramFromSource(sources[p], program.programName.c_str(), (app->shaderDefines + program.permutation).c_str(), app->programBinarySeed));
+    }
+
+    const char* cacheNames[] = { "source", "binary" };
+    for (u32 c = 0; c < 2; ++c)
+    {
+        f64 best = 1e30;
+        u32 fromBinaryCount = 0;
+        for (u32 i = 0; i < iterations; ++i)
+        {
+            std::vector<GLuint> handles;
+            fromBinaryCount = 0;
+            const f64 start = GetPerformanceTime();
+            for (u32 p = 0; p < app->programs.size(); ++p)
+            {
+                const Program& program = *app->programs[p];
+                bool fromBinary = false;
+                handles.push_back(CreateProgramFromSource(sources[p], program.programName.c_str(), (app->shaderDefines + program.permutation).c_str(), c == 0 ? 0 : app->programBinarySeed, &fromBinary));
+                if (fromBinary) fromBinaryCount++;
+            }
+            best = std::min(best, GetPerformanceTime() - start);
+            for (u32 p = 0; p < handles.size(); ++p)
+                glDeleteProgram(handles[p]);
+        }
+        ILOG("  %s: %.2f ms (%u from the binary cache)", cacheNames[c], best * 1000.0, fromBinaryCount);
+    }
+}
+
+// Draws the same model imported in each vertex format into the G-Buffer and
+// compares the vertex bytes and the geometry pass time per frame
+void BenchmarkVertexFormats(App* app, const char* filename, u32 frames)
+{
+    const VertexFormat formats[] = { VF_FLOAT, VF_QUANTIZED };
+    const u32 drawsPerFrame = 64;
+
+    u32 programIdx = LoadProgram(app, "GeometryPassShader.glsl", "GEOMETRY_PASS");
+    Program* program = app->programs[programIdx];
+    LoadProgramAttributes(program);
+    VertexDecodeUniforms decode = GetVertexDecodeUniforms(*program);
+
+    // Local params of a single instance, seen from the current camera
+    glm::mat4 localParams[2] = { glm::mat4(1.0f), app->GlobalMatrix(glm::mat4(1.0f)) };
+    GLuint localParamsHandle = 0;
+    glGenBuffers(1, &localParamsHandle);
+    glBindBuffer(GL_UNIFORM_BUFFER, localParamsHandle);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(localParams), localParams, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    u32 vertexBytes[2] = {};
+    f64 frameTime[2] = {};
+
+    for (u32 f = 0; f < 2; ++f)
+    {
+        ModelImport import;
+        if (!ImportModelSource(filename, import, formats[f], &app->jobs))
+        {
+            FreeModelImport(import);
+            break;
+        }
+
+        ModelAsset asset;
+        BuildModelAsset(app, import, &asset, true);
+        vertexBytes[f] = import.vertexBytes;
+        FreeModelImport(import);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, app->gBuffer.handle);
+        glUseProgram(program->handle);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING(1), localParamsHandle);
+        glFinish();
+
+        f64 start = GetPerformanceTime();
+        for (u32 frame = 0; frame < frames; ++frame)
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            for (u32 d = 0; d < drawsPerFrame; ++d)
+            {
+                for (u32 i = 0; i < asset.meshes.size(); ++i)
+                {
+                    Mesh* mesh = asset.meshes[i];
+                    glBindVertexArray(asset.FindVAO(i, program));
+                    SetVertexDecodeUniforms(decode, mesh);
+                    glDrawElements(GL_TRIANGLES, mesh->indexCount, mesh->indexType, (void*)(u64)(asset.indexBase + mesh->indexsOffset));
+                }
+            }
+            glFinish();
+        }
+        frameTime[f] = (GetPerformanceTime() - start) * 1000.0 / frames;
+
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        FreeModelAsset(app, &asset);
+    }
+
+    glDeleteBuffers(1, &localParamsHandle);
+
+    ILOG("Vertex format benchmark %s (%u frames, %u draws each): float %u bytes %.3f ms, quantized %u bytes %.3f ms (%.0f%% of the memory)",
+        filename, frames, drawsPerFrame, vertexBytes[0], frameTime[0], vertexBytes[1], frameTime[1],
+        vertexBytes[0] > 0 ? 100.0 * vertexBytes[1] / vertexBytes[0] : 0.0);
+}
+
 void Render(App* app)
 {
+    app->trianglesSubmitted = 0;
+    app->trianglesVisible = 0;
+    memset(app->lodObjects, 0, sizeof(app->lodObjects));
+
     glClearColor(0, 0, 0, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
+    app->UpdateMaterialTable();
+
     if (!app->deferred) app->RenderForward();
     else app->RenderDeferred();
 
@@ -651,6 +1825,181 @@ void Render(App* app)
     app->RenderFrame();
 }
 
+// Points every material to its diffuse texture for this frame (or the fallback while it isn't resident), with
+// the levels still streaming in clamped away, and binds the table along with the texture array pages
+void App::UpdateMaterialTable()
+{
+    textureStorage.BindPages();
+
+    // Never empty, and deleted materials point to the fallback too: every index a shader can get is valid
+    materialReferences.resize(std::max<size_t>(materials.size(), 1));
+    materialOverflow.resize(materialReferences.size());
+    for (u32 i = 0; i < materialReferences.size(); ++i)
+    {
+        const u32 slot = i < materials.size() && materials[i] ? materials[i]->diffuseTex : INVALID_TEXTURE;
+        f32 minLod = 0.f;
+        if (slot != INVALID_TEXTURE)
+        {
+            const Texture* texture = textures[slot];
+            if (texture->source != INVALID_TEXTURE) texture = textures[texture->source];
+            if (texture->resident) minLod = (f32)(texture->uploadedLevel - texture->residentLevel);
+        }
+        materialReferences[i] = textureStorage.Reference(textures.Handle(slot), minLod, &materialOverflow[i]);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialTable);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, materialReferences.size() * sizeof(TextureReference), materialReferences.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, materialTable);
+}
+
+// All a draw sets for its material: the table index, and the texture array page when it has no unit of its own
+void App::BindMaterial(GLint uniform, u32 material)
+{
+    glUniform1ui(uniform, material);
+    if (materialOverflow[material])
+    {
+        glActiveTexture(GL_TEXTURE0 + textureStorage.Units() - 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, materialOverflow[material]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
+
+// Level of detail of a model from the projected size of its bounding sphere
+u32 App::SelectLod(const ModelAsset* asset, const glm::mat4& world)
+{
+    const vec3 center = vec3(world * vec4(asset->boundsCenter, 1.f));
+    const float scale = glm::max(glm::length(vec3(world[0])), glm::max(glm::length(vec3(world[1])), glm::length(vec3(world[2]))));
+    const float radius = asset->boundsRadius * scale;
+    const float distance = glm::length(center - cam->Position());
+
+    u32 lod = 0;
+    if (distance > radius)
+    {
+        const float screenSize = radius * cam->projection[1][1] / distance;
+        const float level = glm::log2(lodReferenceSize / screenSize) + lodBias;
+        if (level > 0.f) lod = glm::min((u32)level, (u32)MESH_MAX_LODS);
+    }
+
+    lodObjects[lod]++;
+    return lod;
+}
+
+// Sets the finest mip level every streamed texture needs this frame: the one where a texel of the meshes in the
+// frustum that sample it covers about a pixel. A mesh covers its uvDensity texture units per object unit, so
+// at distance d one pixel spans 2 d / (screen height * projection[1][1]) world units. Textures not seen only
+// need the tail, quads are drawn in screen space and get every level.
+void App::RequestTextureLevels()
+{
+    for (u32 slot = 0; slot < textures.SlotCount(); ++slot)
+    {
+        Texture* texture = textures[slot];
+        if (texture && texture->chain) texture->wantedLevel = textureStreaming ? texture->chain->levelCount - 1 : 0;
+    }
+    if (!textureStreaming) return;
+
+    // Texture units per pixel, 0 for every level
+    auto Request = [this](u32 slot, float unitsPerPixel)
+    {
+        if (slot == INVALID_TEXTURE) return;
+        Texture* texture = textures[slot];
+        if (texture->source != INVALID_TEXTURE) texture = textures[texture->source];
+        if (!texture->chain) return;
+
+        const CookedTexture& chain = *texture->chain;
+        const float level = unitsPerPixel > 0.f ? glm::log2(std::max(chain.width, chain.height) * unitsPerPixel) + streamingBias : 0.f;
+        const u32 wanted = level > 0.f ? std::min((u32)level, chain.levelCount - 1) : 0;
+        texture->wantedLevel = std::min(texture->wantedLevel, wanted);
+    };
+
+    const float pixelScale = displaySize.y * cam->projection[1][1] * 0.5f;
+    for (std::vector<Object*>::iterator it = objects.begin(); it != objects.end(); ++it)
+    {
+        Object* o = *it;
+        if (!o->active) continue;
+
+        if (o->Type() == ObjectType::O_TEXTURED_QUAD)
+        {
+            Request(((TexturedQuad*)o)->texture, 0.f);
+            continue;
+        }
+        if (o->Type() != ObjectType::O_MODEL || !((Model*)o)->asset->resident) continue;
+
+        const ModelAsset* asset = ((Model*)o)->asset;
+        const float scale = glm::max(glm::length(vec3(o->world[0])), glm::max(glm::length(vec3(o->world[1])), glm::length(vec3(o->world[2]))));
+        MeshletCuller culler;
+        culler.Setup(cam->projection * cam->view * o->world, o->world, cam->Position());
+        for (u32 i = 0; i < asset->meshes.size(); ++i)
+        {
+            const Mesh* mesh = asset->meshes[i];
+            if (!culler.SphereVisible(mesh->boundsCenter, mesh->boundsRadius)) continue;
+
+            // Without texture coordinates known, the texture is assumed to span the mesh once
+            const float distance = glm::length(vec3(o->world * vec4(mesh->boundsCenter, 1.f)) - cam->Position()) - mesh->boundsRadius * scale;
+            const float density = mesh->uvDensity > 0.f ? mesh->uvDensity : 0.5f / glm::max(mesh->boundsRadius, 1e-6f);
+            const float unitsPerPixel = distance > 0.f ? density * distance / (scale * pixelScale) : 0.f;
+
+            const Material* mat = materials[asset->materials[i]];
+            Request(mat->diffuseTex, unitsPerPixel);
+            Request(mat->emissiveTex, unitsPerPixel);
+            Request(mat->specularTex, unitsPerPixel);
+            Request(mat->normalsTex, unitsPerPixel);
+            Request(mat->bumpTex, unitsPerPixel);
+        }
+    }
+}
+
+// Draws a submesh of a bound VAO. Simplified levels are drawn whole, at level 0 with a culler the meshlets
+// outside the frustum or facing away from the camera are skipped and the visible runs are merged into one glMultiDrawElements.
+void App::DrawMesh(const ModelAsset* asset, const Mesh* mesh, const MeshletCuller* culler, u32 lod)
+{
+    if (lod > 0 && !mesh->lods.empty())
+    {
+        const MeshLod& level = mesh->lods[glm::min(lod, (u32)mesh->lods.size()) - 1];
+        trianglesSubmitted += level.indexCount / 3;
+        trianglesVisible += level.indexCount / 3;
+        glDrawElements(GL_TRIANGLES, level.indexCount, mesh->indexType, (void*)(u64)(asset->indexBase + level.indexsOffset));
+        return;
+    }
+
+    const u32 triangles = mesh->indexCount / 3;
+    trianglesSubmitted += triangles;
+
+    if (!culler || mesh->meshlets.size() < 2)
+    {
+        trianglesVisible += triangles;
+        glDrawElements(GL_TRIANGLES, mesh->indexCount, mesh->indexType, (void*)(u64)(asset->indexBase + mesh->indexsOffset));
+        return;
+    }
+
+    drawCounts.clear();
+    drawOffsets.clear();
+
+    const u32 indexSize = mesh->IndexSize();
+    u32 runEnd = UINT32_MAX;
+    for (std::vector<Meshlet>::const_iterator it = mesh->meshlets.begin(); it != mesh->meshlets.end(); ++it)
+    {
+        if (!culler->Visible(*it)) continue;
+
+        trianglesVisible += it->triangleCount;
+
+        // Extend the previous run when the meshlets are adjacent in the index range
+        if (it->firstIndex == runEnd)
+        {
+            drawCounts.back() += it->triangleCount * 3;
+        }
+        else
+        {
+            drawCounts.push_back(it->triangleCount * 3);
+            drawOffsets.push_back((const void*)(u64)(asset->indexBase + mesh->indexsOffset + it->firstIndex * indexSize));
+        }
+        runEnd = it->firstIndex + it->triangleCount * 3;
+    }
+
+    if (!drawCounts.empty())
+        glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), mesh->indexType, drawOffsets.data(), drawCounts.size());
+}
+
 void App::RenderFrame()
 {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -660,9 +2009,9 @@ void App::RenderFrame()
 
     // Draw Frame Buffer
     {
-        GLuint program = programs[frameQuad->textureProgram]->handle;
+        const Program& program = *programs[frameQuad->textureProgram];
         // Get & Set the program to be used
-        glUseProgram(program);
+        glUseProgram(program.handle);
 
         // Bind the vao vertex array
         glBindVertexArray(frameQuad->vao.handle);
@@ -673,11 +2022,11 @@ void App::RenderFrame()
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, blurBuffer.attachment[0]);
         
-        glUniform1i(frameQuad->textureProgramUniform, 0);
+        glUniform1i(program.Uniform(NAME_HASH("uTexture")), 0);
         
-        glUniform1i(glGetUniformLocation(program, "uBloom"), 1);
+        glUniform1i(program.Uniform(NAME_HASH("uBloom")), 1);
 
-        glUniform1i(glGetUniformLocation(program, "uApplyBloom"), currentRenderTarget == 0);
+        glUniform1i(program.Uniform(NAME_HASH("uApplyBloom")), currentRenderTarget == 0);
 
         // Draw the elements to the screen
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
@@ -771,18 +2120,19 @@ void App::RenderForward()
             case ObjectType::O_TEXTURED_QUAD:
             {
                 TexturedQuad* tQ = (TexturedQuad*)o;
+                const Program& program = *programs[tQ->textureProgram];
                 // Get & Set the program to be used
-                glUseProgram(programs[tQ->textureProgram]->handle);
+                glUseProgram(program.handle);
                 // Bind the vao vertex array
                 glBindVertexArray(tQ->vao.handle);
 
                 // Send the texture as uniform variable to glsl script
-                glUniform1i(tQ->textureProgramUniform, 0);
+                glUniform1i(program.Uniform(NAME_HASH("uTexture")), 0);
                 // Activate slot for a texture
                 glActiveTexture(GL_TEXTURE0);
 
                 // Bind the texture of the dice
-                glBindTexture(GL_TEXTURE_2D, textures[tQ->texture]->handle);
+                glBindTexture(GL_TEXTURE_2D, textures.Handle(tQ->texture));
 
                 // Draw the elements to the screen
                 glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
@@ -798,25 +2148,31 @@ void App::RenderForward()
             case ObjectType::O_MODEL:
             {
                 Model* m = (Model*)o;
+                if (!m->asset->resident) break;
 
                 BindBufferRange(forwardConstBuffer, BINDING(1), o->localParamsOffset, o->localParamsSize); // Binding Local Params
 
-                glUseProgram(programs[m->forwardProgram]->handle);
+                const Program& program = *programs[m->forwardProgram];
+                glUseProgram(program.handle);
+                const GLint materialUniform = program.Uniform(NAME_HASH("uMaterialIndex"));
+                const VertexDecodeUniforms decode = GetVertexDecodeUniforms(program);
+
+                ModelAsset* asset = m->asset;
+                unsigned int size = asset->meshes.size();
 
-                unsigned int size = m->meshes.size();
+                MeshletCuller culler;
+                culler.Setup(cam->projection * cam->view * o->world, o->world, cam->Position());
+                const u32 lod = SelectLod(asset, o->world);
                 for (u32 i = 0; i < size; ++i)
                 {
-                    GLuint vao = m->FindVAO(i, programs[m->forwardProgram]);
+                    GLuint vao = asset->FindVAO(i, programs[m->forwardProgram]);
                     glBindVertexArray(vao);
 
-                    Material* mat = materials[m->materials[i]];
+                    BindMaterial(materialUniform, asset->materials[i]);
 
-                    glActiveTexture(GL_TEXTURE0);
-                    glBindTexture(GL_TEXTURE_2D, textures[mat->diffuseTex]->handle);
-                    glUniform1i(m->texUniformForward, 0);
-
-                    Mesh* mesh = m->meshes[i];
-                    glDrawElements(GL_TRIANGLES, mesh->indexs.size(), GL_UNSIGNED_INT, (void*)(u64)mesh->indexsOffset);
+                    Mesh* mesh = asset->meshes[i];
+                    SetVertexDecodeUniforms(decode, mesh);
+                    DrawMesh(asset, mesh, meshletCulling ? &culler : nullptr, lod);
 
                     glBindVertexArray(0);
                 }
@@ -887,18 +2243,19 @@ void App::RenderDeferred()
             {
                 break;
                 TexturedQuad* tQ = (TexturedQuad*)o;
+                const Program& program = *programs[tQ->textureProgram];
                 // Get & Set the program to be used
-                glUseProgram(programs[tQ->textureProgram]->handle);
+                glUseProgram(program.handle);
                 // Bind the vao vertex array
                 glBindVertexArray(tQ->vao.handle);
 
                 // Send the texture as uniform variable to glsl script
-                glUniform1i(tQ->textureProgramUniform, 0);
+                glUniform1i(program.Uniform(NAME_HASH("uTexture")), 0);
                 // Activate slot for a texture
                 glActiveTexture(GL_TEXTURE0);
 
                 // Bind the texture of the dice
-                glBindTexture(GL_TEXTURE_2D, textures[tQ->texture]->handle);
+                glBindTexture(GL_TEXTURE_2D, textures.Handle(tQ->texture));
 
                 // Draw the elements to the screen
                 glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
@@ -914,25 +2271,31 @@ void App::RenderDeferred()
             case ObjectType::O_MODEL:
             {
                 Model* m = (Model*)o;
+                if (!m->asset->resident) break;
 
                 BindBufferRange(deferredGConstBuffer, BINDING(1), o->localParamsOffset, o->localParamsSize); // Binding Local Params
 
-                glUseProgram(programs[m->deferredProgram]->handle);
+                const Program& program = *programs[m->deferredProgram];
+                glUseProgram(program.handle);
+                const GLint materialUniform = program.Uniform(NAME_HASH("uMaterialIndex"));
+                const VertexDecodeUniforms decode = GetVertexDecodeUniforms(program);
+
+                ModelAsset* asset = m->asset;
+                unsigned int size = asset->meshes.size();
 
-                unsigned int size = m->meshes.size();
+                MeshletCuller culler;
+                culler.Setup(cam->projection * cam->view * o->world, o->world, cam->Position());
+                const u32 lod = SelectLod(asset, o->world);
                 for (u32 i = 0; i < size; ++i)
                 {
-                    GLuint vao = m->FindVAO(i, programs[m->deferredProgram]);
+                    GLuint vao = asset->FindVAO(i, programs[m->deferredProgram]);
                     glBindVertexArray(vao);
 
-                    Material* mat = materials[m->materials[i]];
-
-                    glActiveTexture(GL_TEXTURE0);
-                    glBindTexture(GL_TEXTURE_2D, textures[mat->diffuseTex]->handle);
-                    glUniform1i(m->texUniformDeferred, 0);
+                    BindMaterial(materialUniform, asset->materials[i]);
 
-                    Mesh* mesh = m->meshes[i];
-                    glDrawElements(GL_TRIANGLES, mesh->indexs.size(), GL_UNSIGNED_INT, (void*)(u64)mesh->indexsOffset);
+                    Mesh* mesh = asset->meshes[i];
+                    SetVertexDecodeUniforms(decode, mesh);
+                    DrawMesh(asset, mesh, meshletCulling ? &culler : nullptr, lod);
 
                     glBindVertexArray(0);
                 }
@@ -1002,17 +2365,17 @@ void App::RenderDeferred()
             ///////////////////
         }
 
-        GLuint pHandle = programs[frameQuad->lightingPassProgram]->handle;
-        glUseProgram(pHandle);
+        const Program& lightingProgram = *programs[frameQuad->lightingPassProgram];
+        glUseProgram(lightingProgram.handle);
 
         // Bind the vao vertex array
         glBindVertexArray(frameQuad->vao.handle);
 
-        glUniform1i(glGetUniformLocation(pHandle, "gSpecular"), 0);
-        glUniform1i(glGetUniformLocation(pHandle, "gNormals"),  1);
-        glUniform1i(glGetUniformLocation(pHandle, "gPosition"), 2);
-        glUniform1i(glGetUniformLocation(pHandle, "gAlbedo"),   3);
-        glUniform1i(glGetUniformLocation(pHandle, "gDepth"),    4);
+        glUniform1i(lightingProgram.Uniform(NAME_HASH("gSpecular")), 0);
+        glUniform1i(lightingProgram.Uniform(NAME_HASH("gNormals")),  1);
+        glUniform1i(lightingProgram.Uniform(NAME_HASH("gPosition")), 2);
+        glUniform1i(lightingProgram.Uniform(NAME_HASH("gAlbedo")),   3);
+        glUniform1i(lightingProgram.Uniform(NAME_HASH("gDepth")),    4);
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, gBuffer.specularAttachHandle);
@@ -1054,8 +2417,9 @@ void App::RenderBloom()
 
     bool horizontal = true;
 
-    GLuint blurProgram = programs[frameQuad->bloomProgram]->handle;
-    glUseProgram(blurProgram);
+    const Program& blurProgram = *programs[frameQuad->bloomProgram];
+    glUseProgram(blurProgram.handle);
+    const GLint horizontalUniform = blurProgram.Uniform(NAME_HASH("horizontal"));
 
     glBindVertexArray(frameQuad->vao.handle);
 
@@ -1069,7 +2433,7 @@ void App::RenderBloom()
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         }
 
-        glUniform1i(glGetUniformLocation(blurProgram, "horizontal"), horizontal);
+        glUniform1i(horizontalUniform, horizontal);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, i == 0 ? frameBuffer.bloomAttachHandle : blurBuffer.attachment[!horizontal]);
 
@@ -1089,17 +2453,18 @@ void App::RenderBloom()
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void App::HotReload()
+// Issues the programs built from the file, ProcessProgramReloads() swaps them in once they are built
+void App::HotReload(const std::string& filepath)
 {
     for (std::vector<Program*>::iterator it = programs.begin(); it != programs.end(); ++it)
     {
         Program& p = *(*it);
-        u64 currTimestamp = GetFileLastWriteTimestamp(p.filepath.c_str());
-        if (currTimestamp <= p.lastWriteTimestamp) continue;
+        if (p.filepath != filepath) continue;
 
-        glDeleteProgram(p.handle);
-        p.handle = CreateProgramFromSource(ReadTextFile(p.filepath.c_str()), p.programName.c_str());
-        p.lastWriteTimestamp = currTimestamp;
+        // A reload still being built is stale now
+        if (p.pending.handle) AbandonProgramBuild(p.pending);
+        // The file changed on disk, a packed copy would be stale
+        p.pending = BeginProgramBuild(ReadTextFile(p.filepath.c_str(), false), p.programName.c_str(), (shaderDefines + p.permutation).c_str(), programBinarySeed);
     }
 }
 
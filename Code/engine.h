@@ -9,14 +9,66 @@
 #include "OpenGlInfo.h"
 #include "FrameBuffer.h"
 #include "BlurBuffer.h"
+#include "JobSystem.h"
+#include "AtomicQueue.h"
+#include "VertexFormat.h"
+#include "GeometryArena.h"
+#include "TextureCache.h"
+#include "TextureUploadRing.h"
+#include "FileWatcher.h"
+#include <unordered_map>
 
-class Texture;
 class Program;
 class Object;
 class Material;
 class TexturedQuad;
 class Light;
 class Camera;
+class ModelAsset;
+class Model;
+class Mesh;
+struct MeshletCuller;
+struct ModelImport;
+struct CookedTexture;
+
+// GL_KHR_parallel_shader_compile (and the ARB one, same tokens), not in the core 4.3 loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+// Import finished by a worker, waiting for the GL thread to create and upload its asset
+struct ModelUpload
+{
+    ModelAsset*  asset = nullptr;
+    ModelImport* import = nullptr;
+    bool success = false;
+    bool built = false;
+    u32  uploadedMeshes = 0;
+};
+
+// Run of unused slots in App::materials, left by a released asset
+struct MaterialRange
+{
+    u32 first = 0;
+    u32 count = 0;
+};
+
+// Mip chain cooked (or read from the cooked file) by a worker, uploaded by the GL thread a band of rows at a time.
+// Levels [firstLevel, endLevel) are uploaded, coarsest first.
+struct TextureUpload
+{
+    u32   slot = INVALID_TEXTURE;
+    TextureUsage usage = TU_COLOR;
+    CookedTexture* cooked = nullptr;
+    u64   contentHash = 0;
+    bool  success = false;
+    bool  streamed = false;          // Finer levels of a resident texture, the chain belongs to the texture
+    u32   firstLevel = 0;
+    u32   endLevel = 0;
+    u32   uploadedLevels = 0;
+    u32   uploadedRows = 0;          // Of the level being uploaded, rows of blocks when compressed
+};
 
 class App
 {
@@ -38,22 +90,107 @@ public:
     void RenderForward();
     void RenderDeferred();
     void RenderBloom();
-    void HotReload();
+    u32 SelectLod(const ModelAsset* asset, const glm::mat4& world);
+    void UpdateMaterialTable();
+    void BindMaterial(GLint uniform, u32 material);
+    void RequestTextureLevels();
+    void DrawMesh(const ModelAsset* asset, const Mesh* mesh, const MeshletCuller* culler, u32 lod);
+    void HotReload(const std::string& filepath);
 
     // Graphics
     OpenGLInfo openGLInformation;
     ivec2 displaySize = {0, 0};
 
     // Vectors
-    std::vector<Texture*> textures;
     std::vector<Program*> programs;
     std::vector<Object*>  objects;
     std::vector<Material*> materials;
+    std::vector<MaterialRange> freeMaterials; // Sorted and merged, the ones at the end are trimmed from materials
     std::vector<Light*> lights;
 
+    // Textures shared by path and by content, resident within a memory budget (see TextureCache.h)
+    TextureCache textures;
+
+    // Memory of every texture, bindless or in texture arrays (see TextureStorage.h). Model shaders read their
+    // textures from materialTable, one TextureReference per entry of `materials`, indexed per draw; the pages
+    // without a unit of their own are bound per draw from materialOverflow.
+    TextureStorage textureStorage;
+    GLuint materialTable = 0;
+    std::vector<TextureReference> materialReferences;
+    std::vector<GLuint> materialOverflow;
+    std::string shaderDefines; // Added to every program, they tell the shaders how materials reach their textures
+
+    // Textures decoded by the workers, staged through the ring at most textureUploadBudget bytes per frame
+    AtomicQueue<TextureUpload> textureDecodeQueue;
+    std::vector<TextureUpload> textureUploads;
+    TextureUploadRing textureRing;
+    u32 textureUploadBudget = MB(4);
+
+    // Textures are block compressed (BC1/BC3/BC5) when the driver has S3TC, see CookedTexture.h
+    bool compressTextures = true;
+
+    // Mip streaming: textures start with the levels up to streamingTailSize texels and get finer ones as the
+    // texel density on screen asks for them, at most streamingMaxInFlight at a time. When the levels asked for
+    // don't fit in the texture budget, every request is made coarser by streamingPressure levels.
+    bool textureStreaming = true;
+    float streamingBias = 0.f;
+    u32 streamingTailSize = 64;
+    u32 streamingMaxInFlight = 4;
+    u32 streamingInFlight = 0;
+    u32 streamingPressure = 0;
+    u32 streamingPromotions = 0;
+    u32 streamingDemotions = 0;
+
+    // Every variant (file, entry define, permutation) is compiled once, LoadProgram() returns the existing slot after that
+    std::unordered_map<u64, u32> programSlots;
+    u32 programCompiles = 0;
+    u32 programCacheHits = 0;
+    f64 programCompileSeconds = 0.0;
+
+    // Programs are read from the binary cache on disk when the driver can (see ProgramBinaryCache.h),
+    // the seed identifies the driver and is 0 when there is no cache
+    u64 programBinarySeed = 0;
+    u32 programBinaryLoads = 0;
+    f64 programBinarySeconds = 0.0;
+
+    // Hot reloads are built in the background and swapped in once linked. The driver says when that is with
+    // GL_KHR_parallel_shader_compile, without it a reload is waited for the frame after it was issued.
+    bool parallelShaderCompile = false;
+    u32 programReloads = 0;
+    u32 programReloadFailures = 0;
+
+    // Files assets were loaded from, the ones that change on disk are reloaded (see FileWatcher.h)
+    FileWatcher fileWatcher;
+    bool autoReload = true;
+    std::vector<std::string> fileChanges;
+
+    // Model files loaded once and shared by every Model placed from them, keyed by path
+    std::unordered_map<std::string, ModelAsset*> modelAssets;
+
+    // Asynchronous imports: workers push finished imports, the GL thread uploads
+    // at most uploadBudget bytes of geometry per frame
+    JobSystem jobs;
+    AtomicQueue<ModelUpload> modelUploadQueue;
+    std::vector<ModelUpload> modelUploads;
+    u32 uploadBudget = MB(4);
+
+    // Vertex format emitted by model imports
+    VertexFormat vertexFormat = VF_QUANTIZED;
+
+    // Assets.pack in the working directory, mounted at startup when it exists (see AssetPack.h)
+    bool assetPackMounted = false;
+
+    // Shared vertex/index buffers of every model asset, compacted a bit every frame
+    // while its free space is more fragmented than compactThreshold
+    GeometryArena geometry;
+    u32 compactBudget = MB(1);
+    float compactThreshold = 0.5f;
+
     intptr_t selected = 0;
     TexturedQuad* InitTexturedQuad(const char* texture, glm::vec3 position = glm::vec3(0.f));
     void InitModel(const char* path, glm::vec3 position = glm::vec3(0.f), float scale = 1);
+    void InitModelAsync(const char* path, glm::vec3 position = glm::vec3(0.f), float scale = 1);
+    Model* PlaceModel(ModelAsset* asset, glm::vec3 position, float scale);
     Light* AddPointLight(glm::vec3 color, glm::vec3 position);
     Light* AddDirectLight(glm::vec3 color, glm::vec3 direction);
     Light* AddSpotLight(glm::vec3 color, glm::vec3 position, glm::vec3 direction, float cutoff);
@@ -89,6 +226,19 @@ public:
     Camera* cam = nullptr;
     glm::mat4 global = glm::mat4(1.0f);
 
+    // Meshlet culling, triangle counts of the last frame before and after it
+    bool meshletCulling = true;
+    u32 trianglesSubmitted = 0;
+    u32 trianglesVisible = 0;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+
+    // LOD selection: an object drops one level each time its projected bounding sphere halves
+    // below lodReferenceSize (radius in NDC units), the bias shifts every selection by whole levels
+    float lodBias = 0.f;
+    float lodReferenceSize = 0.5f;
+    u32 lodObjects[MESH_MAX_LODS + 1] = {};
+
     // Configuration
     bool deferred = true;
     float ambient = 0.1;
@@ -128,6 +278,20 @@ void Update(App* app);
 
 void Render(App* app);
 
-u32 LoadTexture2D(App* app, const char* filepath);
+void Shutdown(App* app);
+
+void BenchmarkVertexFormats(App* app, const char* filename, u32 frames);
+
+void BenchmarkTextureCompression(const char* filename, u32 iterations);
+
+void BenchmarkMipFilter(const char* filename, u32 iterations);
+
+void BenchmarkProgramCache(App* app, u32 iterations);
+
+u32 LoadTexture2D(App* app, const char* filepath, TextureUsage usage = TU_COLOR);
+
+u32 LoadTexture2D(App* app, const char* filepath, Image image, TextureUsage usage = TU_COLOR);
+
+void ReleaseTexture2D(App* app, u32 texIdx);
 
 void OnGlError(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
\ No newline at end of file
@@ -9,16 +9,27 @@
 #define WIN32_LEAN_AND_MEAN
 #define _CRT_SECURE_NO_WARNINGS
 #include <Windows.h>
+#include <psapi.h>
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
 #endif
 
+#include "AssetPack.h"
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+
+// The asset cooker (see AssetCooker.cpp) links the same platform layer, without the window and the engine
+#ifndef ASSET_COOKER
 #include "engine.h"
 
 #include <GLFW/glfw3.h>
-#include <stdio.h>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
@@ -26,11 +37,14 @@
 #define WINDOW_TITLE  "Advanced Graphics Programming"
 #define WINDOW_WIDTH  800
 #define WINDOW_HEIGHT 600
+#endif
 
 #define GLOBAL_FRAME_ARENA_SIZE MB(16)
 u8* GlobalFrameArenaMemory = NULL;
 u32 GlobalFrameArenaHead = 0;
 
+#ifndef ASSET_COOKER
+
 void OnGlfwError(int errorCode, const char *errorMessage)
 {
 	fprintf(stderr, "glfw failed with error %d: %s\n", errorCode, errorMessage);
@@ -256,6 +270,8 @@ int main()
         GlobalFrameArenaHead = 0;
     }
 
+    Shutdown(&app);
+
     free(GlobalFrameArenaMemory);
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -268,6 +284,12 @@ int main()
     return 0;
 }
 
+void* GetGlProcAddress(const char* name)
+{
+    return (void*)glfwGetProcAddress(name);
+}
+#endif
+
 u32 Strlen(const char* string)
 {
     u32 len = 0;
@@ -351,10 +373,55 @@ void GetFileName(std::string* string, const char* name)
     
 }
 
-String ReadTextFile(const char* filepath)
+// Mapping of an asset pack, shared by the mount and every raw view MapFile() gave out of it.
+// Unmounting only drops the reference of the mount, so the views of in-flight imports stay valid
+// until they are unmapped.
+struct PackMapping
+{
+    MappedFile file;
+    u32        references;
+};
+
+// Mounted pack, null when there is none. Worker threads map files while the GL thread mounts.
+std::mutex  mountedPackMutex;
+PackMapping* mountedPack = nullptr;
+
+PackMapping* AcquireMountedPack()
+{
+    std::lock_guard<std::mutex> lock(mountedPackMutex);
+    if (mountedPack) mountedPack->references++;
+    return mountedPack;
+}
+
+void ReleasePackMapping(PackMapping* pack)
+{
+    {
+        std::lock_guard<std::mutex> lock(mountedPackMutex);
+        if (--pack->references > 0) return;
+    }
+    UnmapFile(pack->file);
+    delete pack;
+}
+
+String ReadTextFile(const char* filepath, bool allowPack)
 {
     String fileText = {};
 
+    PackMapping* pack = allowPack ? AcquireMountedPack() : nullptr;
+    const PackEntry* entry = pack ? FindPackEntry(pack->file.data, filepath) : nullptr;
+    if (entry)
+    {
+        fileText.len = (u32)entry->originalSize;
+        fileText.str = (char*)PushSize(fileText.len + 1);
+        const u8* stored = pack->file.data + entry->offset;
+        if (!(entry->flags & PACK_ENTRY_LZ4)) memcpy(fileText.str, stored, fileText.len);
+        else if (!Lz4Decompress(stored, (u32)entry->size, (u8*)fileText.str, fileText.len)) ELOG("Corrupt pack entry %s", filepath);
+        fileText.str[fileText.len] = '\0';
+        ReleasePackMapping(pack);
+        return fileText;
+    }
+    if (pack) ReleasePackMapping(pack);
+
     FILE* file = fopen(filepath, "rb");
 
     if (file)
@@ -401,9 +468,294 @@ u64 GetFileLastWriteTimestamp(const char* filepath)
     return 0;
 }
 
-void LogString(const char* str)
+MappedFile MapFile(const char* filepath)
 {
+    MappedFile file = {};
+
+    // Raw entries are views into the pack mapping (holding a reference to it), compressed ones are
+    // decompressed to the heap
+    PackMapping* pack = AcquireMountedPack();
+    const PackEntry* entry = pack ? FindPackEntry(pack->file.data, filepath) : nullptr;
+    if (entry)
+    {
+        const u8* stored = pack->file.data + entry->offset;
+        if (entry->originalSize == 0)
+        {
+            ReleasePackMapping(pack);
+        }
+        else if (!(entry->flags & PACK_ENTRY_LZ4))
+        {
+            file.data = stored;
+            file.size = entry->originalSize;
+            file.mapping = pack;
+            file.origin = MFO_PACK;
+        }
+        else
+        {
+            u8* data = (u8*)malloc(entry->originalSize);
+            const bool decompressed = data && Lz4Decompress(stored, (u32)entry->size, data, (u32)entry->originalSize);
+            ReleasePackMapping(pack);
+            if (!decompressed)
+            {
+                ELOG("Corrupt pack entry %s", filepath);
+                free(data);
+                return file;
+            }
+            file.data = data;
+            file.size = entry->originalSize;
+            file.origin = MFO_DECOMPRESSED;
+        }
+        return file;
+    }
+    if (pack) ReleasePackMapping(pack);
+
 #ifdef _WIN32
+    HANDLE handle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        return file;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+    {
+        CloseHandle(handle);
+        return file;
+    }
+
+    file.data = (const u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!file.data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return file;
+    }
+
+    file.size = (u64)size.QuadPart;
+    file.file = handle;
+    file.mapping = mapping;
+#else
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) return file;
+
+    struct stat attrib;
+    if (fstat(fd, &attrib) != 0 || attrib.st_size == 0)
+    {
+        close(fd);
+        return file;
+    }
+
+    void* data = mmap(NULL, attrib.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return file;
+
+    file.data = (const u8*)data;
+    file.size = (u64)attrib.st_size;
+#endif
+
+    return file;
+}
+
+void UnmapFile(MappedFile& file)
+{
+    if (!file.data) return;
+
+    if (file.origin != MFO_DISK)
+    {
+        if (file.origin == MFO_DECOMPRESSED) free((void*)file.data);
+        if (file.origin == MFO_PACK) ReleasePackMapping((PackMapping*)file.mapping);
+        file = {};
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mapping);
+    CloseHandle((HANDLE)file.file);
+#else
+    munmap((void*)file.data, file.size);
+#endif
+
+    file = {};
+}
+
+bool MountAssetPack(const char* filepath)
+{
+    UnmountAssetPack();
+
+    MappedFile pack = MapFile(filepath);
+    if (!pack.data) return false;
+
+    const PackHeader* header = (const PackHeader*)pack.data;
+    const bool valid = pack.size >= sizeof(PackHeader) && header->magic == PACK_MAGIC && header->version == PACK_VERSION &&
+        header->tableSize > 0 && (header->tableSize & (header->tableSize - 1)) == 0 &&
+        header->namesOffset == sizeof(PackHeader) + (u64)header->tableSize * sizeof(PackEntry) &&
+        header->namesOffset + header->namesBytes <= pack.size;
+    if (!valid)
+    {
+        ELOG("%s is not a valid asset pack", filepath);
+        UnmapFile(pack);
+        return false;
+    }
+
+    // Entries are validated once, lookups trust them
+    const PackEntry* table = (const PackEntry*)(pack.data + sizeof(PackHeader));
+    for (u32 i = 0; i < header->tableSize; ++i)
+    {
+        const PackEntry& entry = table[i];
+        if (!(entry.flags & PACK_ENTRY_USED)) continue;
+        if (entry.offset + entry.size > pack.size || entry.nameOffset >= header->namesBytes || entry.originalSize > 0xffffffffull)
+        {
+            ELOG("%s is corrupt", filepath);
+            UnmapFile(pack);
+            return false;
+        }
+    }
+    if (header->namesBytes > 0 && pack.data[header->namesOffset + header->namesBytes - 1] != '\0')
+    {
+        ELOG("%s is corrupt", filepath);
+        UnmapFile(pack);
+        return false;
+    }
+
+    PackMapping* mapping = new PackMapping;
+    mapping->file = pack;
+    mapping->references = 1;
+
+    std::lock_guard<std::mutex> lock(mountedPackMutex);
+    mountedPack = mapping;
+    return true;
+}
+
+void UnmountAssetPack()
+{
+    PackMapping* pack = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mountedPackMutex);
+        std::swap(pack, mountedPack);
+    }
+    if (pack) ReleasePackMapping(pack);
+}
+
+bool SetWorkingDirectory(const char* directory)
+{
+#ifdef _WIN32
+    return SetCurrentDirectoryA(directory) != 0;
+#else
+    return chdir(directory) == 0;
+#endif
+}
+
+bool CreateDirectoryPath(const char* directory)
+{
+#ifdef _WIN32
+    return CreateDirectoryA(directory, nullptr) != 0 || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(directory, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+bool MoveFileOver(const char* from, const char* to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+void ListFiles(const char* directory, std::vector<std::string>& files)
+{
+    // Directories still to visit, relative to the root
+    std::vector<std::string> pending(1, std::string());
+    while (!pending.empty())
+    {
+        const std::string relative = pending.back();
+        pending.pop_back();
+        const std::string path = relative.empty() ? std::string(directory) : std::string(directory) + "/" + relative;
+        const std::string prefix = relative.empty() ? relative : relative + "/";
+
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE find = FindFirstFileA((path + "/*").c_str(), &data);
+        if (find == INVALID_HANDLE_VALUE) continue;
+
+        do
+        {
+            if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0) continue;
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) pending.push_back(prefix + data.cFileName);
+            else files.push_back(prefix + data.cFileName);
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+#else
+        DIR* dir = opendir(path.c_str());
+        if (!dir) continue;
+
+        while (dirent* entry = readdir(dir))
+        {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+            struct stat attrib;
+            if (stat((path + "/" + entry->d_name).c_str(), &attrib) != 0) continue;
+            if (S_ISDIR(attrib.st_mode)) pending.push_back(prefix + entry->d_name);
+            else if (S_ISREG(attrib.st_mode)) files.push_back(prefix + entry->d_name);
+        }
+        closedir(dir);
+#endif
+    }
+}
+
+f64 GetPerformanceTime()
+{
+    using namespace std::chrono;
+    return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+u64 GetResidentMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.WorkingSetSize;
+#else
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+
+    unsigned long long pages = 0, residentPages = 0;
+    int read = fscanf(file, "%llu %llu", &pages, &residentPages);
+    fclose(file);
+
+    return read == 2 ? residentPages * (u64)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+u64 GetPeakResidentMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file) return 0;
+
+    char line[256];
+    unsigned long long kilobytes = 0;
+    while (fgets(line, sizeof(line), file))
+        if (sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1) break;
+    fclose(file);
+
+    return kilobytes * 1024;
+#endif
+}
+
+void LogString(const char* str)
+{
+#if defined(_WIN32) && !defined(ASSET_COOKER)
     OutputDebugStringA(str);
     OutputDebugStringA("\n");
 #else
@@ -112,8 +112,9 @@ void GetFileName(std::string* string, const char* name);
 /**
  * Reads a whole file and returns a string with its contents. The returned string
  * is temporary and should be copied if it needs to persist for several frames.
+ * The mounted asset pack is looked up first, unless allowPack is false (hot reloads).
  */
-String ReadTextFile(const char *filepath);
+String ReadTextFile(const char *filepath, bool allowPack = true);
 
 /**
  * It retrieves a timestamp indicating the last time the file was modified.
@@ -121,6 +122,94 @@ String ReadTextFile(const char *filepath);
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+/**
+ * Where the data of a MappedFile lives, it decides what UnmapFile() releases.
+ */
+enum MappedFileOrigin
+{
+    MFO_DISK,         // Own mapping of the file
+    MFO_PACK,         // View into the mounted asset pack
+    MFO_DECOMPRESSED, // Heap copy of a compressed pack entry
+};
+
+/**
+ * Read-only view of a whole file mapped into the address space of the process.
+ * The data stays valid until UnmapFile() is called on it.
+ */
+struct MappedFile
+{
+    const u8*        data;
+    u64              size;
+    void*            file;
+    void*            mapping;
+    MappedFileOrigin origin;
+};
+
+/**
+ * It maps a whole file in read-only mode. Files in the mounted asset pack are served
+ * from it (without touching the disk), the rest is mapped from disk.
+ * On failure (or if the file is empty) the returned view has a null data pointer.
+ */
+MappedFile MapFile(const char* filepath);
+
+void UnmapFile(MappedFile& file);
+
+/**
+ * It maps an asset pack (see AssetPack.h) that MapFile() and ReadTextFile() look files
+ * up in before going to disk. Only one pack is mounted at a time, mounting replaces it.
+ * Returns false if the file doesn't exist or isn't a valid pack.
+ * Mounting and unmounting are safe while other threads map files, views already given out of
+ * a pack keep it mapped until they are unmapped.
+ */
+bool MountAssetPack(const char* filepath);
+
+void UnmountAssetPack();
+
+/**
+ * It returns the address of an OpenGL function of the current context, for the ones the loader doesn't know.
+ * Returns null if the driver doesn't have it.
+ */
+void* GetGlProcAddress(const char* name);
+
+/**
+ * It changes the directory relative paths are resolved from. Returns false if it doesn't exist.
+ */
+bool SetWorkingDirectory(const char* directory);
+
+/**
+ * It creates a directory (not its parents). Returns true if it exists afterwards.
+ */
+bool CreateDirectoryPath(const char* directory);
+
+/**
+ * It renames a file over another one in a single step, readers see either the old file or the
+ * new one. On Windows it fails while the replaced file is open or mapped.
+ */
+bool MoveFileOver(const char* from, const char* to);
+
+/**
+ * It appends the paths of every file under the directory (recursively) to the list,
+ * relative to it and with forward slashes.
+ */
+void ListFiles(const char* directory, std::vector<std::string>& files);
+
+/**
+ * It returns a high resolution timestamp in seconds, meant to measure elapsed times.
+ */
+f64 GetPerformanceTime();
+
+/**
+ * It returns the physical memory currently used by the process (working set), in bytes.
+ * Returns 0 if the platform can't tell.
+ */
+u64 GetResidentMemory();
+
+/**
+ * It returns the highest working set the process reached so far, in bytes.
+ * Returns 0 if the platform can't tell.
+ */
+u64 GetPeakResidentMemory();
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
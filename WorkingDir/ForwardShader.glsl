@@ -31,6 +31,19 @@ layout(location=0) in vec3 aPosition;
 layout(location=1) in vec3 aNormal;
 layout(location=2) in vec2 aTexCoord;
 
+// Vertex decode (see VertexFormat.h): positions may be quantized to the mesh AABB
+// and normals octahedral encoded in two components
+uniform vec3 uPositionOffset;
+uniform vec3 uPositionScale;
+uniform bool uOctahedralNormals;
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+	return normalize(n);
+}
+
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 uCameraPosition;
@@ -56,11 +69,14 @@ out vec3 vViewDir;
 
 void main()
 {
+	vec3 position = uPositionOffset + aPosition * uPositionScale;
+	vec3 normal   = uOctahedralNormals ? DecodeOctahedral(aNormal.xy) : aNormal;
+
 	vTexCoord   = aTexCoord;
-	vPosition   = vec3( uWorldMatrix * vec4(aPosition, 1.0) );
-	vNormal     = normalize(vec3( uWorldMatrix * vec4(aNormal, 0.0) ));
+	vPosition   = vec3( uWorldMatrix * vec4(position, 1.0) );
+	vNormal     = normalize(vec3( uWorldMatrix * vec4(normal, 0.0) ));
 	vViewDir    = normalize(uCameraPosition - vPosition);
-	gl_Position = uGlobalMatrix * vec4(aPosition, 1.0);
+	gl_Position = uGlobalMatrix * vec4(position, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
@@ -70,9 +86,41 @@ in vec3 vPosition;
 in vec3 vNormal;
 in vec3 vViewDir;
 
-// getting the id of the texture using -> glGetUniformLocation(texturedGeometryProgram.handle, "uTexture");
-// sending the texture data glUniform1i(app->programUniformTexture, 0);
-uniform sampler2D uTexture;
+// Diffuse texture of every material, indexed by the material of the draw (see TextureStorage.h):
+// a bindless handle, or the unit of a texture array and the layer in it
+struct MaterialTexture
+{
+	uvec2 reference;
+	float minLod; // Finest level uploaded, the finer ones are still streaming in
+	uint  pad;
+};
+
+layout(binding = 0, std430) readonly buffer MaterialTable
+{
+	MaterialTexture uMaterials[];
+};
+
+uniform uint uMaterialIndex;
+
+#if defined(BINDLESS_TEXTURES)
+vec4 SampleMaterialTexture(vec2 uv)
+{
+	MaterialTexture t = uMaterials[uMaterialIndex];
+	sampler2D tex = sampler2D(t.reference);
+	if (t.minLod > 0.0) return textureLod(tex, uv, max(textureQueryLod(tex, uv).y, t.minLod));
+	return texture(tex, uv);
+}
+#else
+layout(binding = 0) uniform sampler2DArray uTextureArrays[TEXTURE_ARRAY_UNITS];
+
+vec4 SampleMaterialTexture(vec2 uv)
+{
+	MaterialTexture t = uMaterials[uMaterialIndex];
+	vec3 coord = vec3(uv, float(t.reference.y));
+	if (t.minLod > 0.0) return textureLod(uTextureArrays[t.reference.x], coord, max(textureQueryLod(uTextureArrays[t.reference.x], uv).y, t.minLod));
+	return texture(uTextureArrays[t.reference.x], coord);
+}
+#endif
 
 layout(binding = 0, std140) uniform GlobalParams
 {
@@ -179,7 +227,7 @@ vec4 CalculateLightOnly(float thrhld, vec3 clr)
 
 void main()
 {
-	albedo = texture(uTexture, vTexCoord);
+	albedo = SampleMaterialTexture(vTexCoord);
 	albedo.w = 1;
 	normals = vec4(vNormal, 1);
 	position = vec4(vPosition, 1);